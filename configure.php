@@ -249,6 +249,7 @@ function add_cc_link_build($config)
 	$obj_ext = $config['obj_ext'] ?? '.o';
 	$dep_path = $config['dep_path'] ?? null;
 	$obj_deps_map = $config['obj_deps'] ?? [];
+	$obj_cflags_map = $config['obj_cflags'] ?? [];
 
 	$opts_ns = $config['name'] ?? null;
 	if ($opts_ns) {
@@ -287,7 +288,7 @@ function add_cc_link_build($config)
 				->set_var('cflags', $cflags . ' -D__ASSEMBLY__');
 		} else if (preg_match('#\\.c$#', $s)) {
 			$b = $n->add_build('cc' . $suffix, [$obj], [$s], $obj_deps)
-				->set_var('cflags', $cflags);
+				->set_var('cflags', $obj_cflags_map[$s] ?? $cflags);
 			if ($depfile)
 				$b->set_var('depfile', $depfile);
 		} else if (preg_match('#\\.(cpp|cc)$#', $s)) {
@@ -384,20 +385,156 @@ add_cc_link_build([
 $n->add_rule('addegon', $mkboot_out . ' --default-dt sd $in $out')
 	->set_var('description', 'EGON $out');
 
+// DSI fast init tables generator
+
+$dsi_gen_out = '$builddir/dsi-gen';
+add_cc_link_build([
+	'name' => 'dsi_gen',
+	'toolchain' => 'native',
+	'output' => $dsi_gen_out,
+	'sources' => ['$srcdir/dsi-gen.c'],
+	'cflags' => '-DDSI_GEN -I$srcdir',
+	'ldflags' => '',
+]);
+
+$n->add_rule('dsigen', $dsi_gen_out . ' > $out')
+	->set_var('description', 'DSIGEN $out');
+
+$n->add_build('dsigen', ['$builddir/dsi-init-seq.h'], [], [$dsi_gen_out]);
+
+// p-boot-conf pre-bakes static FDT fixups into DTBs using libfdt
+
+$bconf_sources = [
+	'$srcdir/conf.c',
+	'$ubootdir/lib/libfdt/fdt.c',
+	'$ubootdir/lib/libfdt/fdt_ro.c',
+	'$ubootdir/lib/libfdt/fdt_rw.c',
+	'$ubootdir/lib/libfdt/fdt_wip.c',
+	'$ubootdir/lib/libfdt/fdt_strerror.c',
+];
+$bconf_cflags = '-DSERIAL_CONSOLE -include $ubootdir/scripts/dtc/libfdt/libfdt_env.h -I$ubootdir/scripts/dtc/libfdt -idirafter $ubootdir/include';
+
 $all_deps[] = add_cc_link_build([
 	'name' => 'bconf_native',
 	'toolchain' => 'native',
 	'output' => '$builddir/p-boot-conf-native',
-	'sources' => ['$srcdir/conf.c'],
-	'cflags' => '-Og -g',
+	'sources' => $bconf_sources,
+	'cflags' => '-Og -g ' . $bconf_cflags,
+	'ldflags' => '',
+]);
+
+$bprof_out = add_cc_link_build([
+	'name' => 'bprof_native',
+	'toolchain' => 'native',
+	'output' => '$builddir/p-boot-prof-native',
+	'sources' => ['$srcdir/prof.c'],
+	'cflags' => '-O2',
+	'ldflags' => '',
+]);
+
+$all_deps[] = $bprof_out;
+
+// parser test on boot profiles captured in example/prof/
+
+add_command('test-prof', 'sh example/prof/test.sh ' . $bprof_out, [$bprof_out]);
+
+// FDT edit list benchmark, uses host build of libfdt
+
+$all_deps[] = add_cc_link_build([
+	'name' => 'fdtedit_bench',
+	'toolchain' => 'native',
+	'output' => '$builddir/fdtedit-bench',
+	'sources' => [
+		'$srcdir/fdtedit-bench.c',
+		'$ubootdir/lib/libfdt/fdt.c',
+		'$ubootdir/lib/libfdt/fdt_ro.c',
+		'$ubootdir/lib/libfdt/fdt_rw.c',
+		'$ubootdir/lib/libfdt/fdt_wip.c',
+		'$ubootdir/lib/libfdt/fdt_addresses.c',
+	],
+	'cflags' => '-O2 -DFDTEDIT_BENCH -I$srcdir -include $ubootdir/scripts/dtc/libfdt/libfdt_env.h -I$ubootdir/scripts/dtc/libfdt -idirafter $ubootdir/include',
+	'ldflags' => '',
+]);
+
+// Byte exact tests of lib.c string functions against libc (ninja test-lib),
+// and an arm64 build that can be run under qemu-aarch64 (ninja test-lib-qemu)
+
+$lib_test_renames = implode(' ', array_map(function($f) {
+	return "-D$f=lib_$f";
+}, ['memcpy', 'memset', 'memmove', 'memcmp', 'strlen', 'memchr', 'strchr',
+    'strcmp', 'strstr', 'simple_strtoul']));
+
+$lib_test_cflags = [
+	'$srcdir/lib.c' => '-O2 -Wall -DLIB_TEST -fno-builtin -fno-tree-loop-distribute-patterns ' . $lib_test_renames,
+];
+
+$lib_test_out = add_cc_link_build([
+	'name' => 'lib_test',
+	'toolchain' => 'native',
+	'output' => '$builddir/lib-test',
+	'sources' => ['$srcdir/lib-test.c', '$srcdir/lib.c'],
+	'obj_cflags' => $lib_test_cflags,
+	'cflags' => '-O2 -Wall',
+	'ldflags' => '',
+]);
+
+$all_deps[] = $lib_test_out;
+
+add_command('test-lib', $lib_test_out, [$lib_test_out]);
+
+$lib_test_arm64_out = add_cc_link_build([
+	'name' => 'lib_test_arm64',
+	'output' => '$builddir/lib-test-arm64',
+	'sources' => ['$srcdir/lib-test.c', '$srcdir/lib.c'],
+	'obj_cflags' => $lib_test_cflags,
+	'cflags' => '-O2 -Wall',
+	'ldflags' => '-static',
+]);
+
+add_command('test-lib-qemu', "qemu-aarch64 $lib_test_arm64_out && qemu-aarch64 $lib_test_arm64_out -b",
+	[$lib_test_arm64_out]);
+
+// DT overlays shipped with p-boot, and a host test that applies them to
+// a base DTB (BASE_DTB=path/to/board.dtb ninja test-overlays)
+
+$n->add_rule('dtc', 'dtc -@ -q -I dts -O dtb -o $out $in')
+	->set_var('description', 'DTC $out');
+
+$overlays = [];
+foreach (glob("$topdir/example/overlays/*.dts") as $dts) {
+	$dtbo = '$builddir/overlays/' . basename($dts, '.dts') . '.dtbo';
+	$n->add_build('dtc', [$dtbo], ['$topdir/example/overlays/' . basename($dts)]);
+	$overlays[] = $dtbo;
+}
+
+$overlay_test_out = add_cc_link_build([
+	'name' => 'overlay_test',
+	'toolchain' => 'native',
+	'output' => '$builddir/overlay-test',
+	'sources' => [
+		'$srcdir/overlay-test.c',
+		'$ubootdir/lib/libfdt/fdt.c',
+		'$ubootdir/lib/libfdt/fdt_ro.c',
+		'$ubootdir/lib/libfdt/fdt_rw.c',
+		'$ubootdir/lib/libfdt/fdt_wip.c',
+		'$ubootdir/lib/libfdt/fdt_strerror.c',
+		'$ubootdir/lib/libfdt/fdt_overlay.c',
+	],
+	'cflags' => '-O2 -DSERIAL_CONSOLE -include $ubootdir/scripts/dtc/libfdt/libfdt_env.h -I$ubootdir/scripts/dtc/libfdt -idirafter $ubootdir/include',
 	'ldflags' => '',
 ]);
 
+$all_deps[] = $overlay_test_out;
+
+add_command('test-overlays',
+	$overlay_test_out . ' $${BASE_DTB:-example/stable/board.dtb} ' . implode(' ', $overlays),
+	array_merge([$overlay_test_out], $overlays));
+
 $all_deps[] = add_cc_link_build([
 	'name' => 'bconf',
 	'output' => '$builddir/p-boot-conf',
-	'sources' => ['$srcdir/conf.c'],
-	'cflags' => '',
+	'sources' => $bconf_sources,
+	'cflags' => $bconf_cflags,
 	'ldflags' => '-static -s',
 ]);
 
@@ -459,12 +596,11 @@ $configs = [
 	'FDT_ASSUME_MASK=0xff',
 ];
 
-$cflags = [
-	array_map(function($i) {
-		return '-D' . $i;
-	}, $configs),
+$defines = array_map(function($i) {
+	return '-D' . $i;
+}, $configs);
 
-	// includes
+$includes = [
 	'-include linux/kconfig.h',
 	'-I$builddir',
 	'-I$srcdir',
@@ -477,6 +613,11 @@ $cflags = [
 	'-I$ubootdir/arch/arm/include/asm/arch-sunxi',
 	'-I$ubootdir/scripts/dtc/libfdt',
 	'-I$ubootdir/lib/libfdt',
+];
+
+$cflags = [
+	$defines,
+	$includes,
 
 	// warnings
 	'-Wall',
@@ -552,10 +693,16 @@ function p_boot($conf) {
 			'$srcdir/lib.c',
 			'$srcdir/pmic.c',
 			'$srcdir/mmu.c',
+			'$srcdir/smp.c',
+			'$srcdir/sched.c',
+			'$srcdir/timeline.c',
 			'$srcdir/lradc.c',
 			'$srcdir/ccu.c',
 			'$srcdir/storage.c',
+			'$srcdir/resident.c',
+			'$srcdir/fdtedit.c',
 			'$srcdir/display.c',
+			'$srcdir/dsi.c',
 			'$srcdir/vidconsole.c',
 			'$srcdir/strbuf.c',
 			'$srcdir/gui.c',
@@ -581,6 +728,7 @@ function p_boot($conf) {
 			'$ubootdir/lib/libfdt/fdt_wip.c',
 			'$ubootdir/lib/libfdt/fdt_region.c',
 			'$ubootdir/lib/libfdt/fdt_ro.c',
+			'$ubootdir/lib/libfdt/fdt_overlay.c',
 			'$ubootdir/drivers/gpio/sunxi_gpio.c',
 			'$ubootdir/drivers/mmc/mmc.c',
 			'$ubootdir/drivers/mmc/sunxi_mmc.c',
@@ -589,6 +737,7 @@ function p_boot($conf) {
 		],
 		'obj_deps' => [
 			$main_c => '$builddir/build-ver.h',
+			'$srcdir/display.c' => '$builddir/dsi-init-seq.h',
 			'$srcdir/start.S' => $GLOBALS['start32_bin'],
 		],
 		'cflags' => implode(' ', flat($conf['cflags'])),
@@ -622,6 +771,15 @@ p_boot([
 //		 '-DVIDEO_CONSOLE',
 		 '-DSERIAL_CONSOLE',
 		 '-DENABLE_GUI',
+		 // not validated on hardware yet, see main_sram_only()
+//		 '-DCPU_FAST_CLOCK=1152000000',
+		 // don't fit into SRAM together with the GUI
+//		 '-DBOOT_TASKS',
+//		 '-DGUI_DOUBLE_BUFFER',
+//		 '-DGUI_SELECTION_PLANE',
+//		 '-DDRAM_PARAM_CACHE',
+//		 '-DMBUS_BOOT_PROFILE',
+//		 '-DRESIDENT_IMAGES',
 		 '-DRETURN_TO_DRAM_MAIN',
 		 '-DDRAM_STACK_SWITCH',
 //		 '-DDE2_RESIZE=1',
@@ -637,8 +795,35 @@ p_boot([
 		 '-DSERIAL_CONSOLE',
 		 '-DNORMAL_LOGGING',
 		 '-DPBOOT_FDT_LOG',
+		 '-DASYNC_SERIAL',
+		 '-DCPU_FAST_CLOCK=1152000000',
+		 '-DDRAM_PARAM_CACHE',
+		 '-DMBUS_BOOT_PROFILE',
+		 '-DRESIDENT_IMAGES',
+		 '-DBOOT_TASKS',
 		 '-DRETURN_TO_DRAM_MAIN',
 		 '-DDRAM_STACK_SWITCH',
+		 '-DPMIC_SHADOW',
+	],
+	'ldflags' => ['$pboot_ldflags'],
+]);
+
+p_boot([
+	'name' => 'p-boot-log',
+	'main' => '$srcdir/main.c',
+	'cflags' => [
+		'$pboot_cflags',
+		 '-DNORMAL_LOGGING',
+		 '-DPBOOT_FDT_LOG',
+		 '-DDEFERRED_LOGGING',
+		 '-DBOOT_TIMELINE',
+		 '-DDRAM_PARAM_CACHE',
+		 '-DMBUS_BOOT_PROFILE',
+		 '-DRESIDENT_IMAGES',
+		 '-DBOOT_TASKS',
+		 '-DRETURN_TO_DRAM_MAIN',
+		 '-DDRAM_STACK_SWITCH',
+		 '-DPMIC_SHADOW',
 	],
 	'ldflags' => ['$pboot_ldflags'],
 ]);
@@ -648,8 +833,12 @@ p_boot([
 	'main' => '$srcdir/main.c',
 	'cflags' => [
 		'$pboot_cflags',
+		 '-DBOOT_TASKS',
 		 '-DRETURN_TO_DRAM_MAIN',
 		 '-DDRAM_STACK_SWITCH',
+		 '-DDT_OVERLAYS',
+		 '-DFW_PRELOAD',
+		 '-DPMIC_SHADOW',
 	],
 	'ldflags' => ['$pboot_ldflags'],
 ]);
@@ -662,13 +851,89 @@ p_boot([
 		 '-DSERIAL_CONSOLE',
 		 '-DNORMAL_LOGGING',
 		 '-DVIDEO_CONSOLE',
-//		 '-DDUMP_DSI_INIT=1',
 		 '-DDSI_FULL_INIT=1',
 		 '-DDE2_RESIZE=1',
+		 '-DSMP_WORKERS',
 	],
 	'ldflags' => ['$pboot_ldflags'],
 ]);
 
+p_boot([
+	'name' => 'p-boot-bench',
+	'main' => '$srcdir/bench.c',
+	'cflags' => [
+		'$pboot_cflags',
+		 '-DSERIAL_CONSOLE',
+		 '-DNORMAL_LOGGING',
+		 '-DCPU_FAST_CLOCK=1152000000',
+	],
+	'ldflags' => ['$pboot_ldflags'],
+]);
+
+// p-boot-sim: runs the boot flow on the host against SD/eMMC disk images
+// (see src/sim.h)
+
+$all_deps[] = add_cc_link_build([
+	'name' => 'p_boot_sim',
+	'toolchain' => 'native',
+	'output' => '$builddir/p-boot-sim',
+	'sources' => [
+		'$srcdir/sim-host.c',
+		'$srcdir/sim.c',
+		'$srcdir/main.c',
+		'$srcdir/sched.c',
+		'$srcdir/timeline.c',
+		'$srcdir/storage.c',
+		'$srcdir/resident.c',
+		'$srcdir/fdtedit.c',
+		'$srcdir/strbuf.c',
+
+		'$ubootdir/lib/libfdt/fdt.c',
+		'$ubootdir/lib/libfdt/fdt_addresses.c',
+		'$ubootdir/lib/libfdt/fdt_empty_tree.c',
+		'$ubootdir/lib/libfdt/fdt_rw.c',
+		'$ubootdir/lib/libfdt/fdt_strerror.c',
+		'$ubootdir/lib/libfdt/fdt_sw.c',
+		'$ubootdir/lib/libfdt/fdt_wip.c',
+		'$ubootdir/lib/libfdt/fdt_ro.c',
+		'$ubootdir/lib/libfdt/fdt_overlay.c',
+		'$ubootdir/common/fdt_support.c',
+	],
+	'obj_deps' => [
+		'$srcdir/main.c' => '$builddir/build-ver.h',
+	],
+	'obj_cflags' => [
+		'$srcdir/sim-host.c' => '-O2 -g -Wall',
+	],
+	'cflags' => implode(' ', flat([
+		$defines,
+		$includes,
+		'-Wall',
+		'-Wno-unused-function',
+		'-Wno-unused-but-set-variable',
+		'-Wno-unused-variable',
+		'-fno-builtin',
+		'-fno-strict-aliasing',
+		'-fno-common',
+		'-O2',
+		'-g',
+		'-DPBOOT_SIM',
+		'-DSERIAL_CONSOLE',
+		'-DNORMAL_LOGGING',
+		'-DRESIDENT_IMAGES',
+		'-DDT_OVERLAYS',
+		'-DFW_PRELOAD',
+		'-DBOOT_TIMELINE',
+		'-DBOOT_TASKS',
+		// keep p-boot's entry point and heap apart from the host libc ones
+		'-Dmain=pboot_main',
+		'-Dmalloc=pboot_malloc',
+		'-Dfree=pboot_free',
+		'-include sim.h',
+	])),
+	'ldflags' => '-Wl,--gc-sections',
+]);
+
 $n->add_build('mkver', ['$builddir/build-ver.h'], ['always']);
 
 $n->default = 'all';
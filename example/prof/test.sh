@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Runs p-boot-prof on the captured boot profiles in this directory and
+# compares its output against the expected report and CSV.
+#
+# Usage: test.sh path/to/p-boot-prof-native
+
+prof=$(realpath "$1") || exit 1
+cd "$(dirname "$0")" || exit 1
+
+out=$(mktemp)
+trap 'rm -f $out' EXIT
+
+baseline=$(for f in base/*; do echo "-b $f"; done)
+status=0
+
+fail() {
+	echo "FAIL: $1"
+	status=1
+}
+
+$prof base/* > $out || fail "report exited with $?"
+diff -u report.txt $out || fail "report differs"
+
+# the slow SD card set must be reported as a regression (exit status 2)
+$prof -c $baseline slow/* > $out
+rc=$?
+[ $rc = 2 ] || fail "compare exited with $rc, expected 2"
+diff -u compare.csv $out || fail "compare CSV differs"
+
+# no regressions against itself
+$prof -c $baseline base/* > /dev/null || fail "self-compare exited with $?"
+
+[ $status = 0 ] && echo "p-boot-prof: all tests passed"
+exit $status
@@ -0,0 +1,431 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark battery for DRAM, caches and MMC. Results are printed to the
+ * serial console as "bench: <name> <value> <unit>" lines, so that logs from
+ * different boards/SD cards/builds can be compared with a simple diff.
+ */
+
+#include <common.h>
+#include <asm/arch/gpio.h>
+#include <asm/arch/clock.h>
+#include <asm-generic/gpio.h>
+#include <asm/arch/dram.h>
+#include <asm/armv8/mmu.h>
+#include <cpu_func.h>
+#include <asm/system.h>
+#include <arm_neon.h>
+#include <build-ver.h>
+#include "debug.h"
+#include "mmu.h"
+#include "pmic.h"
+#include "ccu.h"
+#include "lradc.h"
+#include "storage.h"
+#include "resident.h"
+#include "display.h"
+
+// each measurement is repeated and the best run is reported
+#define BENCH_RUNS	5
+
+#define BENCH_BUF_SIZE	(16u << 20)
+#define LAT_STEPS	(1u << 20)
+
+// where to read from on the MMC, and how much per transfer size
+#define MMC_BENCH_OFF	(1u << 20)
+#define MMC_BENCH_LEN	(16u << 20)
+
+static uint8_t* heap_end = (uint8_t*)(uintptr_t)0x40000000u;
+
+void* malloc(size_t len)
+{
+	void* p = heap_end;
+	heap_end += ALIGN(len, 64);
+	return p;
+}
+
+void* zalloc(size_t len)
+{
+	void* p = malloc(len);
+	memset(p, 0, len);
+	return p;
+}
+
+void free(void* p)
+{
+}
+
+static void green_led_set(bool on)
+{
+	gpio_direction_output(SUNXI_GPD(18), on); // green pinephone led
+}
+
+static void red_led_set(bool on)
+{
+	gpio_direction_output(SUNXI_GPD(19), on); // red on
+}
+
+void panic_shutdown(uint32_t code)
+{
+	green_led_set(0);
+	red_led_set(1);
+
+	puts("Power off!\n");
+	pmic_poweroff();
+}
+
+// {{{ DRAM bandwidth
+
+typedef void (*bench_fn)(void* dst, const void* src, size_t len);
+
+static void neon_read(void* dst, const void* src, size_t len)
+{
+	const uint64_t* s = src;
+	uint64x2_t a = vdupq_n_u64(0), b = a, c = a, d = a;
+
+	for (size_t i = 0; i < len / 8; i += 8) {
+		a = veorq_u64(a, vld1q_u64(s + i));
+		b = veorq_u64(b, vld1q_u64(s + i + 2));
+		c = veorq_u64(c, vld1q_u64(s + i + 4));
+		d = veorq_u64(d, vld1q_u64(s + i + 6));
+	}
+
+	// keep the loads from being optimized out
+	vst1q_u64(dst, veorq_u64(veorq_u64(a, b), veorq_u64(c, d)));
+}
+
+static void neon_write(void* dst, const void* src, size_t len)
+{
+	uint64_t* p = dst;
+	uint64x2_t v = vdupq_n_u64(0x5aa5a55a5aa5a55aull);
+
+	for (size_t i = 0; i < len / 8; i += 8) {
+		vst1q_u64(p + i, v);
+		vst1q_u64(p + i + 2, v);
+		vst1q_u64(p + i + 4, v);
+		vst1q_u64(p + i + 6, v);
+	}
+}
+
+static void neon_copy(void* dst, const void* src, size_t len)
+{
+	const uint64_t* s = src;
+	uint64_t* p = dst;
+
+	for (size_t i = 0; i < len / 8; i += 8) {
+		uint64x2_t a = vld1q_u64(s + i);
+		uint64x2_t b = vld1q_u64(s + i + 2);
+		uint64x2_t c = vld1q_u64(s + i + 4);
+		uint64x2_t d = vld1q_u64(s + i + 6);
+
+		vst1q_u64(p + i, a);
+		vst1q_u64(p + i + 2, b);
+		vst1q_u64(p + i + 4, c);
+		vst1q_u64(p + i + 6, d);
+	}
+}
+
+// resident image checksum, paid on each image load on a cold boot
+static void csum_read(void* dst, const void* src, size_t len)
+{
+	*(uint64_t*)dst = resident_csum(src, len);
+}
+
+static ulong bench_run(bench_fn fn, void* dst, const void* src, size_t len)
+{
+	ulong best = ~0ul;
+
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		ulong ts = timer_get_boot_us();
+		fn(dst, src, len);
+		ulong t = timer_get_boot_us() - ts;
+
+		if (t < best)
+			best = t;
+	}
+
+	return best ?: 1;
+}
+
+static void bench_bw(const char* name, bench_fn fn, void* dst,
+		     const void* src, size_t len)
+{
+	ulong us = bench_run(fn, dst, src, len);
+
+	printf("bench: %s %llu MiB/s\n", name,
+	       ((uint64_t)len * 1000000 / us) >> 20);
+}
+
+// }}}
+// {{{ Memory latency
+
+/*
+ * Link cache lines of buf into a single randomly ordered cycle and
+ * measure average time of a dependent load, when following it.
+ */
+static ulong bench_latency_ns(uint8_t* buf, size_t len)
+{
+	unsigned n = len / 64;
+	uint32_t* order = malloc(n * sizeof *order);
+	uint32_t seed = 1;
+	ulong best = ~0ul;
+
+	for (unsigned i = 0; i < n; i++)
+		order[i] = i;
+
+	for (unsigned i = n - 1; i > 0; i--) {
+		seed = seed * 1103515245 + 12345;
+
+		unsigned j = (seed >> 8) % (i + 1);
+		uint32_t t = order[i];
+
+		order[i] = order[j];
+		order[j] = t;
+	}
+
+	for (unsigned i = 0; i < n; i++)
+		*(void**)(buf + order[i] * 64) = buf + order[(i + 1) % n] * 64;
+
+	for (int r = 0; r < BENCH_RUNS; r++) {
+		void** p = (void**)(buf + order[0] * 64);
+
+		ulong ts = timer_get_boot_us();
+		for (unsigned i = 0; i < LAT_STEPS; i++)
+			p = *p;
+		ulong t = timer_get_boot_us() - ts;
+
+		__asm__ __volatile__("" : : "r" (p));
+
+		if (t < best)
+			best = t;
+	}
+
+	return best * 1000 / LAT_STEPS;
+}
+
+// }}}
+// {{{ Cache maintenance before ATF jump
+
+/*
+ * Compare the full set/way clean+invalidate of the data cache that p-boot
+ * used to do before jumping to ATF (dcache_disable()) with cleaning only
+ * the CPU-written ranges by VA (mmu_clean_dirty()). Caches are filled with
+ * dirty lines before each run.
+ */
+static ulong bench_cache_clean(uint8_t* buf, size_t len)
+{
+	ulong best = ~0ul;
+
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		neon_write(buf, NULL, 1u << 20);
+
+		ulong ts = timer_get_boot_us();
+		if (len) {
+			mmu_mark_dirty((uintptr_t)buf, len);
+			mmu_clean_dirty();
+		} else {
+			flush_dcache_all();
+		}
+		ulong t = timer_get_boot_us() - ts;
+
+		if (t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+// }}}
+// {{{ MBUS
+
+/*
+ * Toggle MBUS bandwidth limit for the CPU port (port 0), to see the effect
+ * of the limits programmed by mctl_set_master_priority_a64().
+ */
+static void mbus_cpu_bwlimit(bool on)
+{
+	struct sunxi_mctl_com_reg * const mctl_com =
+			(struct sunxi_mctl_com_reg *)SUNXI_DRAM_COM_BASE;
+
+	if (on)
+		setbits_le32(&mctl_com->mcr[0][0], 1);
+	else
+		clrbits_le32(&mctl_com->mcr[0][0], 1);
+}
+
+// }}}
+// {{{ MMC
+
+static uint64_t bench_mmc_read(struct mmc* mmc, uint8_t* buf, uint32_t size)
+{
+	ulong ts = timer_get_boot_us();
+
+	for (uint32_t done = 0; done < MMC_BENCH_LEN; done += size)
+		if (!mmc_read_data(mmc, (uintptr_t)buf,
+				   MMC_BENCH_OFF + done, size))
+			return 0;
+
+	ulong us = (timer_get_boot_us() - ts) ?: 1;
+
+	return (uint64_t)MMC_BENCH_LEN * 1000000 / us / 1024;
+}
+
+static struct mmc* bench_mmc(int mmc_no, uint8_t* buf)
+{
+	ulong ts = timer_get_boot_us();
+	struct mmc* mmc = mmc_probe(mmc_no);
+	if (!mmc)
+		return NULL;
+
+	printf("bench: mmc%d probe %lu us\n", mmc_no, timer_get_boot_us() - ts);
+
+	for (uint32_t size = 4096; size <= 4u << 20; size <<= 2) {
+		uint64_t kbps = bench_mmc_read(mmc, buf, size);
+		if (!kbps) {
+			printf("bench: mmc%d read %u KiB failed\n",
+			       mmc_no, size / 1024);
+			return NULL;
+		}
+
+		printf("bench: mmc%d read %u KiB %llu KiB/s\n", mmc_no,
+		       size / 1024, kbps);
+	}
+
+	return mmc;
+}
+
+// }}}
+
+void main(void)
+{
+	int ret;
+	ulong dram_size;
+
+	green_led_set(1);
+	ccu_init();
+	console_init();
+	lradc_enable();
+
+	puts("p-boot benchmark program (version " VERSION " built " BUILD_DATE ")\n");
+
+	ret = rsb_init();
+	if (ret)
+		panic(9, "rsb init failed %d\n", ret);
+
+	pmic_init();
+	udelay(500);
+
+	dram_size = sunxi_dram_init();
+	if (!dram_size)
+		panic(3, "DRAM not detected");
+
+	icache_enable();
+	mmu_setup(dram_size);
+
+	ccu_upclock();
+	ret = ccu_set_cpux_opp(CPU_FAST_CLOCK, 1300);
+	if (ret)
+		panic(10, "CPU clock setup failed %d\n", ret);
+
+	printf("bench: dram size %lu MiB\n", dram_size >> 20);
+	printf("bench: cpu clock %u MHz\n", CPU_FAST_CLOCK / 1000000);
+
+	uint8_t* b1 = malloc(BENCH_BUF_SIZE);
+	uint8_t* b2 = malloc(BENCH_BUF_SIZE);
+	uint8_t sink[16] __attribute__((aligned(16)));
+
+	memset(b1, 0, BENCH_BUF_SIZE);
+	memset(b2, 0, BENCH_BUF_SIZE);
+
+	bench_bw("dram read", neon_read, sink, b1, BENCH_BUF_SIZE);
+	bench_bw("dram write", neon_write, b1, NULL, BENCH_BUF_SIZE);
+	bench_bw("dram copy", neon_copy, b1, b2, BENCH_BUF_SIZE);
+	bench_bw("l2 read", neon_read, sink, b1, 256 * 1024);
+	bench_bw("l1 read", neon_read, sink, b1, 16 * 1024);
+	bench_bw("resident csum", csum_read, sink, b1, BENCH_BUF_SIZE);
+
+	mbus_cpu_bwlimit(false);
+	bench_bw("dram read (no cpu bwlimit)", neon_read, sink, b1, BENCH_BUF_SIZE);
+	bench_bw("dram copy (no cpu bwlimit)", neon_copy, b1, b2, BENCH_BUF_SIZE);
+	mbus_cpu_bwlimit(true);
+
+	uint8_t* nc = mmu_fb_alloc(4u << 20);
+
+	bench_bw("nc read", neon_read, sink, nc, 4u << 20);
+	bench_bw("nc write", neon_write, nc, NULL, 4u << 20);
+
+	printf("bench: l1 latency %lu ns\n", bench_latency_ns(b1, 16 * 1024));
+	printf("bench: l2 latency %lu ns\n", bench_latency_ns(b1, 256 * 1024));
+	printf("bench: dram latency %lu ns\n", bench_latency_ns(b1, BENCH_BUF_SIZE));
+	printf("bench: nc latency %lu ns\n", bench_latency_ns(nc, 4u << 20));
+
+	// FDT only, and FDT plus a relocated kernel image
+	printf("bench: cache flush set/way %lu us\n", bench_cache_clean(b1, 0));
+	printf("bench: cache clean 64 KiB %lu us\n", bench_cache_clean(b1, 64 * 1024));
+	printf("bench: cache clean 16 MiB %lu us\n", bench_cache_clean(b1, BENCH_BUF_SIZE));
+
+	struct mmc* sd = bench_mmc(0, b1);
+	struct mmc* emmc = bench_mmc(2, b1);
+
+	// compare MBUS profiles under boot-like load, that is image loads
+	// and copies while the splash screen is scanned out
+	uint32_t* splash = (uint32_t*)(uintptr_t)FB_REGION_PA;
+	for (int i = 0; i < PANEL_WIDTH * PANEL_HEIGHT; i++)
+		splash[i] = 0xff000000 | (i * 3);
+
+	display_init();
+	backlight_enable(50);
+
+	struct display* d = zalloc(sizeof *d);
+	d->planes[0].fb_start = FB_REGION_PA;
+	d->planes[0].fb_pitch = PANEL_WIDTH * 4;
+	d->planes[0].src_w = PANEL_WIDTH;
+	d->planes[0].src_h = PANEL_HEIGHT;
+	d->planes[0].dst_w = PANEL_WIDTH;
+	d->planes[0].dst_h = PANEL_HEIGHT;
+	display_commit(d);
+
+	static const char* const profiles[] = {
+		[MBUS_PROFILE_LINUX] = "linux",
+		[MBUS_PROFILE_BOOT] = "boot",
+	};
+
+	for (int p = 0; p < ARRAY_SIZE(profiles); p++) {
+		mctl_set_mbus_profile(p);
+
+		if (sd)
+			printf("bench: splash mbus %s mmc0 read %llu KiB/s\n",
+			       profiles[p], bench_mmc_read(sd, b1, 4u << 20));
+		if (emmc)
+			printf("bench: splash mbus %s mmc2 read %llu KiB/s\n",
+			       profiles[p], bench_mmc_read(emmc, b1, 4u << 20));
+
+		ulong us = bench_run(neon_copy, b1, b2, BENCH_BUF_SIZE);
+		printf("bench: splash mbus %s dram copy %llu MiB/s\n",
+		       profiles[p], ((uint64_t)BENCH_BUF_SIZE * 1000000 / us) >> 20);
+	}
+
+	mctl_set_mbus_profile(MBUS_PROFILE_LINUX);
+
+	puts("bench: done\n");
+
+	green_led_set(0);
+	pmic_poweroff();
+}
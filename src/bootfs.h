@@ -25,10 +25,11 @@
 
 struct bootfs_sb {
 	uint8_t magic[8]; // :BOOTFS:
-	uint32_t version; // 1
+	uint32_t version; // 2
 	uint32_t default_conf;
 	uint8_t device_id[32];
-	uint8_t res[2048-8-4-4-32];
+	uint32_t generation; // changes on each p-boot-conf run, 0 = unknown
+	uint8_t res[2048-8-4-4-32-4];
 };
 
 struct bootfs_image {
@@ -38,10 +39,14 @@ struct bootfs_image {
 };
 
 // takes 2048B
+//
+// Version 1 had no overlays/preload, boot_args took their space.
 struct bootfs_conf {
 	uint8_t magic[8]; // :BFCONF:
 	struct bootfs_image images[8]; // type=0 == unused entry
-	uint8_t boot_args[2048 - 8 - 8 * sizeof(struct bootfs_image) - 96]; // null terminated string
+	uint8_t boot_args[2048 - 8 - 8 * sizeof(struct bootfs_image) - 128 - 256 - 96]; // null terminated string
+	uint8_t overlays[128]; // DT overlay file names, null terminated strings, ends with an empty string
+	uint8_t preload[256]; // "file:compatible" null terminated strings, ends with an empty string
 	uint8_t name[96];
 };
 
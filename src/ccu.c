@@ -20,6 +20,7 @@
 #include "ccu.h"
 #include <asm/io.h>
 #include <asm/arch/prcm.h>
+#include "pmic.h"
 
 void ccu_set_pll_cpux(unsigned int clk)
 {
@@ -104,6 +105,27 @@ void ccu_upclock(void)
 	writel((1 << 0 /* ahb2 source: 0=ahb1 1=pll_periph0(1x)/2 */), CCU_AHB2_CFG);
 }
 
+/*
+ * Switch CPU to a higher OPP. PLL_CPUX only feeds CPUX/AXI and the CPUX
+ * APB, so this doesn't touch AHB1/APB1/APB2 or MMC module clocks, which
+ * run from PLL_PERIPH0/OSC24M. AXI stays at PLL_CPUX/3 (384MHz max).
+ *
+ * On failure to set and confirm the voltage, CPU stays at the current
+ * clock.
+ */
+int ccu_set_cpux_opp(unsigned int clk, unsigned int mv)
+{
+	int ret;
+
+	ret = pmic_set_cpux_voltage(mv);
+	if (ret)
+		return ret;
+
+	pmic_wait_cpux_voltage();
+	ccu_set_pll_cpux(clk);
+	return 0;
+}
+
 void ccu_dump(void)
 {
 	unsigned long regs[] = {
@@ -43,5 +43,6 @@
 void ccu_set_pll_cpux(unsigned int clk);
 void ccu_init(void);
 void ccu_upclock(void);
+int ccu_set_cpux_opp(unsigned int clk, unsigned int mv);
 
 void ccu_dump(void);
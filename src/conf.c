@@ -27,10 +27,12 @@
 #include <stddef.h>
 #include <endian.h>
 #include <string.h>
+#include <time.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <libfdt.h>
 
 #include "bootfs.h"
 #ifndef PATH_MAX
@@ -54,6 +56,7 @@
 struct data {
 	char path[PATH_MAX];
 	int fd;
+	void* buf; // generated data (pre-baked DTB), fd is -1
 	uint32_t offset;
 	uint32_t size;
 	struct data* next;
@@ -76,6 +79,10 @@ struct bconf {
 	char path[1024];
 	char name[1024];
 	char bootargs[4096];
+	char overlays[128];
+	int overlays_len;
+	char preload[256];
+	int preload_len;
 	struct bconf_image* images;
 };
 
@@ -261,6 +268,46 @@ static bool parse_conf(const char* conf_dir, const char* conf_filename)
 			if (!strcmp(name, "bootargs"))
 				snprintf(conf.bootargs, sizeof conf.bootargs, "%s", val);
 
+			if (!strcmp(name, "overlay")) {
+				if (strlen(val) > 31) {
+					printf("ERROR: %s[%d]: overlay file name is too long (max 31 chars)", conf.path, line_no);
+					exit(1);
+				}
+
+				// keep space for the terminating empty string
+				int len = strlen(val) + 1;
+				if (conf.overlays_len + len + 1 > sizeof conf.overlays) {
+					printf("ERROR: %s[%d]: too many overlays for no=%d", conf.path, line_no, conf.index);
+					exit(1);
+				}
+
+				memcpy(conf.overlays + conf.overlays_len, val, len);
+				conf.overlays_len += len;
+			}
+
+			if (!strcmp(name, "preload")) {
+				char* colon = strchr(val, ':');
+				if (!colon || colon == val || !colon[1]) {
+					printf("ERROR: %s[%d]: preload must be in the form file:compatible", conf.path, line_no);
+					exit(1);
+				}
+
+				if (colon - val > 31) {
+					printf("ERROR: %s[%d]: preload file name is too long (max 31 chars)", conf.path, line_no);
+					exit(1);
+				}
+
+				// keep space for the terminating empty string
+				int len = strlen(val) + 1;
+				if (conf.preload_len + len + 1 > sizeof conf.preload) {
+					printf("ERROR: %s[%d]: too many preload entries for no=%d", conf.path, line_no, conf.index);
+					exit(1);
+				}
+
+				memcpy(conf.preload + conf.preload_len, val, len);
+				conf.preload_len += len;
+			}
+
 			for (int i = 0; i < sizeof(image_types) / sizeof(image_types[0]); i++) {
 				if (strcmp(name, image_types[i].conf_var))
 					continue;
@@ -354,6 +401,195 @@ static void include_files(const char* dir)
 	closedir(d);
 }
 
+// }}}
+// {{{ Pre-bake DTBs
+
+/*
+ * FDT fixups that only depend on the contents of the bootfs are applied to
+ * the DTBs here, at image-build time, so that p-boot only needs to apply the
+ * dynamic ones (memory size, MAC addresses, initrd, framebuffer, log, ...)
+ * during boot. Pre-baked DTBs are marked by /p-boot/pre-baked property.
+ */
+
+static struct data* data_add_buffer(const char* path, void* buf, uint32_t size)
+{
+	struct data* d, *last_d;
+
+	// avoid dups based on content, configs with the same DTB and bootargs
+	// will share the pre-baked DTB
+	for (d = data_list, last_d = d; d; last_d = d, d = d->next) {
+		if (d->buf && d->size == size && !memcmp(d->buf, buf, size)) {
+			free(buf);
+			return d;
+		}
+	}
+
+	d = malloc(sizeof *d);
+	assert(d != NULL);
+	memset(d, 0, sizeof *d);
+
+	snprintf(d->path, sizeof d->path, "%s", path);
+	d->fd = -1;
+	d->buf = buf;
+	d->size = size;
+
+	if (last_d)
+		last_d->next = d;
+	else
+		data_list = d;
+
+	return d;
+}
+
+static bool data_is_used(struct data* d)
+{
+	for (int i = 0; i < 32; i++)
+		for (struct bconf_image* im = confs[i].images; im; im = im->next)
+			if (im->data == d)
+				return true;
+
+	for (int i = 0; i < n_files; i++)
+		if (files[i].data == d)
+			return true;
+
+	return false;
+}
+
+static void* read_data(struct data* d, uint32_t* size)
+{
+	struct stat st;
+
+	if (fstat(d->fd, &st) < 0) {
+		printf("ERROR: Can't stat file '%s' (%s)\n", d->path, strerror(errno));
+		exit(1);
+	}
+
+	void* buf = malloc(st.st_size);
+	assert(buf != NULL);
+
+	if (pread(d->fd, buf, st.st_size, 0) != st.st_size) {
+		printf("ERROR: Can't read file '%s' (%s)\n", d->path, strerror(errno));
+		exit(1);
+	}
+
+	*size = st.st_size;
+	return buf;
+}
+
+static int fdt_find_or_add_subnode(void* fdt, int parent, const char* name)
+{
+	int off = fdt_subnode_offset(fdt, parent, name);
+	if (off == -FDT_ERR_NOTFOUND)
+		return fdt_add_subnode(fdt, parent, name);
+
+	return off;
+}
+
+static int prebake_fdt(void* fdt, const char* bootargs, const char* configs, int configs_len)
+{
+	int err;
+
+	int pboot_off = fdt_find_or_add_subnode(fdt, 0, "p-boot");
+	if (pboot_off < 0)
+		return pboot_off;
+
+	// list of boot configurations for the OS
+	err = fdt_setprop(fdt, pboot_off, "configs", configs, configs_len);
+	if (err < 0)
+		return err;
+
+	int chosen_off = fdt_find_or_add_subnode(fdt, 0, "chosen");
+	if (chosen_off < 0)
+		return chosen_off;
+
+	err = fdt_setprop_string(fdt, chosen_off, "bootargs", bootargs);
+	if (err < 0)
+		return err;
+
+	// p-boot configures TS correctly and we want battery thermal
+	// protection to function correctly
+	int adc_off = fdt_path_offset(fdt, "/soc/rsb@1f03400/pmic@3a3/adc");
+	if (adc_off >= 0) {
+		err = fdt_delprop(fdt, adc_off, "x-powers,ts-as-gpadc");
+		if (err < 0 && err != -FDT_ERR_NOTFOUND)
+			return err;
+	}
+
+	err = fdt_setprop_empty(fdt, pboot_off, "pre-baked");
+	if (err < 0)
+		return err;
+
+	return fdt_pack(fdt);
+}
+
+static void prebake_dtbs(void)
+{
+	char configs[32 * 128];
+	int configs_len = 0;
+
+	// same format as p-boot used to generate at boot: "no:name\n"
+	for (int i = 0; i < 32; i++) {
+		if (!confs[i].used)
+			continue;
+
+		configs_len += snprintf(configs + configs_len, sizeof configs - configs_len,
+					"%d:%.*s\n", i, (int)sizeof(((struct bootfs_conf*)0)->name) - 1,
+					confs[i].name);
+	}
+
+	for (int i = 0; i < 32; i++) {
+		if (!confs[i].used)
+			continue;
+
+		// bootargs as p-boot will see them in bootfs_conf
+		char bootargs[sizeof(((struct bootfs_conf*)0)->boot_args)];
+		snprintf(bootargs, sizeof bootargs, "%s", confs[i].bootargs);
+
+		for (struct bconf_image* im = confs[i].images; im; im = im->next) {
+			if (im->type != 'D' && im->type != '2')
+				continue;
+
+			uint32_t size;
+			void* dtb = read_data(im->data, &size);
+			if (fdt_check_header(dtb) < 0) {
+				printf("ERROR: %s: '%s' is not a valid DTB\n", confs[i].path, im->data->path);
+				exit(1);
+			}
+
+			int buf_size = size + configs_len + strlen(bootargs) + 4096;
+			void* fdt = malloc(buf_size);
+			assert(fdt != NULL);
+
+			int err = fdt_open_into(dtb, fdt, buf_size);
+			if (err == 0)
+				err = prebake_fdt(fdt, bootargs, configs, configs_len);
+			if (err < 0) {
+				printf("ERROR: %s: Can't pre-bake DTB '%s' for no=%d (%s)\n", confs[i].path, im->data->path, confs[i].index, fdt_strerror(err));
+				exit(1);
+			}
+
+			free(dtb);
+
+			char path[PATH_MAX + 32];
+			snprintf(path, sizeof path, "%s [pre-baked no=%d]", im->data->path, confs[i].index);
+			im->data = data_add_buffer(path, fdt, fdt_totalsize(fdt));
+		}
+	}
+
+	// drop original DTBs that are no longer referenced
+	for (struct data** pd = &data_list; *pd;) {
+		struct data* d = *pd;
+
+		if (!d->buf && !data_is_used(d)) {
+			*pd = d->next;
+			close(d->fd);
+			free(d);
+		} else {
+			pd = &d->next;
+		}
+	}
+}
+
 // }}}
 // {{{ Write filesystem
 
@@ -462,6 +698,41 @@ int main(int ac, char* av[])
 	snprintf(path, sizeof path, "%s/files", conf_dir);
 	include_files(path);
 
+	/* check that overlay files exist */
+	for (int i = 0; i < 32; i++) {
+		for (char* p = confs[i].overlays; *p; p += strlen(p) + 1) {
+			int j;
+
+			for (j = 0; j < n_files; j++)
+				if (!strcmp(files[j].name, p))
+					break;
+
+			if (j == n_files) {
+				printf("ERROR: %s: overlay file '%s' for no=%d is not in files/\n", confs[i].path, p, confs[i].index);
+				exit(1);
+			}
+		}
+	}
+
+	/* check that preloaded firmware files exist */
+	for (int i = 0; i < 32; i++) {
+		for (char* p = confs[i].preload; *p; p += strlen(p) + 1) {
+			int name_len = strchr(p, ':') - p;
+			int j;
+
+			for (j = 0; j < n_files; j++)
+				if (strlen(files[j].name) == name_len && !strncmp(files[j].name, p, name_len))
+					break;
+
+			if (j == n_files) {
+				printf("ERROR: %s: preload file '%.*s' for no=%d is not in files/\n", confs[i].path, name_len, p, confs[i].index);
+				exit(1);
+			}
+		}
+	}
+
+	prebake_dtbs();
+
 	/* open bootfs partition block device */
 	int fd = open(blk_dev, O_RDWR | O_CREAT | O_TRUNC, 0666);
 	if (fd < 0) {
@@ -473,7 +744,9 @@ int main(int ac, char* av[])
 
 	struct bootfs_sb sb = {
 		.magic = ":BOOTFS:",
-		.version = htobe32(1),
+		.version = htobe32(2),
+		// lets p-boot know that images may have changed
+		.generation = htobe32((uint32_t)time(NULL) ^ (uint32_t)getpid() << 20),
 	};
 	
 	if (device_id)
@@ -489,10 +762,14 @@ int main(int ac, char* av[])
 	printf("Data space:\n\n");
 	for (struct data* d = data_list; d; d = d->next) {
 		lseek_checked(fd, off_i);
-		lseek_checked(d->fd, 0);
 
 		d->offset = off_i;
-		d->size = write_fd_checked(fd, d->fd, d->path);
+		if (d->buf) {
+			write_checked(fd, d->buf, d->size);
+		} else {
+			lseek_checked(d->fd, 0);
+			d->size = write_fd_checked(fd, d->fd, d->path);
+		}
 
 		off_i += d->size;
 		if (off_i % 512)
@@ -523,6 +800,14 @@ int main(int ac, char* av[])
 				printf("  %c %08x-%08x %s\n", im->type, im->data->offset, im->data->offset + im->data->size, im->data->path);
 			}
 
+			memcpy(bc.overlays, confs[i].overlays, sizeof bc.overlays);
+			for (char* p = confs[i].overlays; *p; p += strlen(p) + 1)
+				printf("  O %s\n", p);
+
+			memcpy(bc.preload, confs[i].preload, sizeof bc.preload);
+			for (char* p = confs[i].preload; *p; p += strlen(p) + 1)
+				printf("  P %s\n", p);
+
 			lseek_checked(fd, off_c);
 			write_checked(fd, &bc, sizeof bc);
 
@@ -23,6 +23,10 @@
 #include "debug.h"
 #include "ccu.h"
 #include "vidconsole.h"
+#ifdef ASYNC_SERIAL
+#include <cpu_func.h>
+#include "dma.h"
+#endif
 
 #define UART0_BASE	0x01c28000
 
@@ -35,6 +39,7 @@
 #define UART0_FCR	(UART0_BASE + 0x8)    /* fifo control register */
 #define UART0_LCR	(UART0_BASE + 0xc)    /* line control register */
 #define UART0_LSR	(UART0_BASE + 0x14)   /* line status register */
+#define UART0_USR	(UART0_BASE + 0x7c)   /* uart status register */
 
 #define BAUD_115200	(0xd) /* 24 * 1000 * 1000 / 16 / 115200 = 13 */
 #define NO_PARITY	(0)
@@ -68,14 +73,141 @@ void console_init(void)
 struct vidconsole* sys_console;
 #endif
 
-#if defined(SERIAL_CONSOLE) || defined(PBOOT_FDT_LOG) || defined(VIDEO_CONSOLE)
+#ifdef ASYNC_SERIAL
 
-void real_putc(char c)
+/*
+ * Asynchronous serial output
+ *
+ * Once console_set_tx_buffer() is called, characters are queued into a ring
+ * buffer in DRAM, that is drained to UART0 by a DMA channel paced by the
+ * UART's TX DRQ. There are no interrupts in p-boot, so the next transfer
+ * is started from uart_putc() or console_flush() whenever the previous one
+ * has finished. uart_putc() only blocks if the ring is full.
+ */
+
+#define UART_DMA_CH	7
+#define DRQ_UART0	6
+
+static char* tx_buf;
+static unsigned tx_size;
+static unsigned tx_head; // next free slot
+static unsigned tx_tail; // start of the data not yet sent
+static unsigned tx_dma_len; // length of the transfer in progress
+static struct dma_lli* tx_lli;
+
+static void uart_tx_kick(void)
+{
+	if (tx_dma_len) {
+		if (readl(DMA_STATUS) & BIT(UART_DMA_CH))
+			return;
+
+		writel(0, DMA_CH_EN(UART_DMA_CH));
+		tx_tail += tx_dma_len;
+		if (tx_tail == tx_size)
+			tx_tail = 0;
+		tx_dma_len = 0;
+	}
+
+	if (tx_head == tx_tail)
+		return;
+
+	// send the contiguous part of the ring
+	unsigned len = tx_head > tx_tail ? tx_head - tx_tail : tx_size - tx_tail;
+	uintptr_t src = (uintptr_t)tx_buf + tx_tail;
+
+	tx_lli->cfg = SRC_DRQ(DRQ_SDRAM) | SRC_MODE(LINEAR_MODE) |
+		SRC_BURST(BURST_1B) | SRC_WIDTH(WIDTH_1B) |
+		DST_DRQ(DRQ_UART0) | DST_MODE(IO_MODE) |
+		DST_BURST(BURST_1B) | DST_WIDTH(WIDTH_1B);
+	tx_lli->src = src;
+	tx_lli->dst = UART0_THR;
+	tx_lli->len = len;
+	tx_lli->para = 8; // normal wait
+	tx_lli->p_lli_next = 0xfffff800; // last item
+
+	flush_dcache_range(src, src + len);
+	flush_dcache_range((uintptr_t)tx_lli, (uintptr_t)(tx_lli + 1));
+
+	writel((uintptr_t)tx_lli, DMA_CH_DESC_ADDR(UART_DMA_CH));
+	writel(1, DMA_CH_EN(UART_DMA_CH));
+	tx_dma_len = len;
+}
+
+void console_set_tx_buffer(void* buf, size_t size)
+{
+	// wait for the transmitter to become idle
+	while (!TX_READY);
+
+	dma_init();
+
+	// FIFO enable, DMA mode 1, TX empty trigger at 1/4 full
+	writel(BIT(0) | BIT(3) | (2 << 4), UART0_FCR);
+
+	// first cache line holds the DMA descriptor
+	tx_lli = buf;
+	tx_buf = (char*)buf + 64;
+	tx_size = size - 64;
+	tx_head = tx_tail = tx_dma_len = 0;
+}
+
+void console_flush(void)
+{
+	log_flush();
+
+	if (!tx_buf)
+		return;
+
+	while (tx_head != tx_tail)
+		uart_tx_kick();
+
+	while (!TX_READY);
+
+	// leave the UART in a state the kernel expects
+	writel(BIT(0), UART0_FCR);
+	tx_buf = NULL;
+}
+
+static void uart_putc(char c)
+{
+	if (tx_buf) {
+		unsigned next = tx_head + 1 == tx_size ? 0 : tx_head + 1;
+
+		while (next == tx_tail)
+			uart_tx_kick();
+
+		tx_buf[tx_head] = c;
+		tx_head = next;
+		uart_tx_kick();
+		return;
+	}
+
+	while (!TX_READY);
+
+	writel(c, UART0_THR);
+}
+
+#elif defined(SERIAL_CONSOLE)
+
+static void uart_putc(char c)
 {
-#ifdef SERIAL_CONSOLE
 	while (!TX_READY);
 
 	writel(c, UART0_THR);
+}
+
+void console_flush(void)
+{
+	log_flush();
+}
+
+#endif
+
+#if defined(SERIAL_CONSOLE) || defined(PBOOT_FDT_LOG) || defined(VIDEO_CONSOLE)
+
+static void emit_putc(char c)
+{
+#ifdef SERIAL_CONSOLE
+	uart_putc(c);
 #endif
 #ifdef PBOOT_FDT_LOG
 	append_log(c);
@@ -85,12 +217,12 @@ void real_putc(char c)
 #endif
 }
 
-void real_puts(const char* s)
+static void emit_puts(const char* s)
 {
 	while (*s) {
 		if (*s == '\n')
-			real_putc('\r');
-		real_putc(*s++);
+			emit_putc('\r');
+		emit_putc(*s++);
 	}
 }
 
@@ -112,15 +244,15 @@ static void put_uint(unsigned long long value, int align, int pad0)
 
 	int len = &buf[BUF_LEN - 1] - p;
 	for (int i = 0; i < align - len; i++)
-		real_putc(pad0 ? '0' : ' ');
+		emit_putc(pad0 ? '0' : ' ');
 
-	real_puts(p);
+	emit_puts(p);
 }
 
 static void put_int(long long v, int align, int pad0)
 {
 	if (v < 0) {
-		real_putc('-');
+		emit_putc('-');
 		v = -v;
 		align--;
 	}
@@ -133,36 +265,45 @@ static void put_uint_div_by_1000(unsigned int value)
 	if (value >= 1000)
 		put_uint(value / 1000, 0, 0);
 	else
-		real_putc('0');
+		emit_putc('0');
 
-	real_putc('.');
+	emit_putc('.');
 	put_uint(value % 1000, 0, 0);
 }
 
-void real_put_hex(unsigned long long hex, int align, int pad0)
+static void emit_put_hex(unsigned long long hex, int align, int pad0)
 {
 	int i;
 	int skip_nibbles = hex > 0 ? __builtin_clzll(hex) / 4 : 15;
 
 	for (i = 0; i < align - (16 - skip_nibbles); i++)
-		real_putc(pad0 ? '0' : ' ');
+		emit_putc(pad0 ? '0' : ' ');
 
 	for (i = skip_nibbles; i < 16; i++) {
 		unsigned nibble = (hex >> (4 * (15 - i))) & 0xf;
 
 		if (nibble < 10)
-			real_putc('0' + nibble);
+			emit_putc('0' + nibble);
 		else
-			real_putc('a' + (nibble - 10));
+			emit_putc('a' + (nibble - 10));
 	}
 }
 
-void real_printf(const char* fmt, ...)
-{
+/*
+ * Arguments come either from the caller's va_list, or from a deferred
+ * log record, where each argument is stored as one 64-bit word.
+ */
+struct fmt_args {
+	const uint64_t* words;
 	va_list ap;
-	const char* p = fmt;
+};
 
-	va_start(ap, fmt);
+#define FMT_ARG(a, type) \
+	((a)->words ? (type)*(a)->words++ : va_arg((a)->ap, type))
+
+static void format(const char* fmt, struct fmt_args* a)
+{
+	const char* p = fmt;
 
 	while (1) {
 		if (*p == '%') {
@@ -190,74 +331,275 @@ void real_printf(const char* fmt, ...)
 				p++;
 
 			if (l > 2)
-				goto end;
+				return;
 
 			switch (*p) {
 				case 'c':
-					real_putc(va_arg(ap, int));
+					emit_putc(FMT_ARG(a, int));
 					break;
 				case 's':
-					real_puts(va_arg(ap, char*));
+					emit_puts(FMT_ARG(a, char*));
 					break;
 				case 'u':
 				case 'x': {
 					unsigned long long val = 0;
 
 					if (l == 0)
-						val = va_arg(ap, unsigned int);
+						val = FMT_ARG(a, unsigned int);
 					else if (l == 1)
-						val = va_arg(ap, unsigned long);
+						val = FMT_ARG(a, unsigned long);
 					else if (l == 2)
-						val = va_arg(ap, unsigned long long);
+						val = FMT_ARG(a, unsigned long long);
 
 					if (*p == 'u')
 						put_uint(val, align, pad0);
 					else
-						real_put_hex(val, align, pad0);
+						emit_put_hex(val, align, pad0);
 					break;
 				}
 				case 'd': {
 					long long val = 0;
 
 					if (l == 0)
-						val = va_arg(ap, int);
+						val = FMT_ARG(a, int);
 					else if (l == 1)
-						val = va_arg(ap, long);
+						val = FMT_ARG(a, long);
 					else if (l == 2)
-						val = va_arg(ap, long long);
+						val = FMT_ARG(a, long long);
 
 					put_int(val, align, pad0);
 					break;
 				}
 				case 'f':
-					put_uint_div_by_1000(va_arg(ap, uint32_t));
+					put_uint_div_by_1000(FMT_ARG(a, uint32_t));
 					break;
 				case 'p':
-					real_put_hex(va_arg(ap, unsigned long long), 8, 1);
+					emit_put_hex(FMT_ARG(a, unsigned long long), 8, 1);
 					break;
 				case '%':
-					real_putc(*p);
+					emit_putc(*p);
 					break;
 				case '\0':
-					goto end;
+					return;
 				default:
-					real_putc('%');
-					real_putc(*p);
+					emit_putc('%');
+					emit_putc(*p);
 			}
 		} else if (*p == '\n') {
-			real_putc('\r');
-			real_putc(*p);
+			emit_putc('\r');
+			emit_putc(*p);
 		} else if (*p == '\0') {
-			goto end;
+			return;
 		} else {
-			real_putc(*p);
+			emit_putc(*p);
 		}
 
 		p++;
 	}
+}
+
+#ifdef DEFERRED_LOGGING
+
+/*
+ * Deferred logging
+ *
+ * Once log_set_buffer() is called, messages are not formatted. Only the
+ * format string pointer and raw argument words are stored into the log
+ * buffer, and everything is formatted and output at once by log_flush().
+ * Format strings must be constant, %s strings are copied into the record,
+ * because they may not outlive the call.
+ */
+
+#define DLOG_MAX_ARGS 16
+
+struct dlog_rec {
+	const char* fmt; // NULL for put_hex()
+	uint32_t size;
+	uint32_t n_words;
+	uint64_t words[];
+};
 
-end:
+static uint8_t* dlog_start;
+static uint8_t* dlog_pos;
+static uint8_t* dlog_end;
+
+void log_set_buffer(void* buf, size_t size)
+{
+	dlog_start = dlog_pos = buf;
+	dlog_end = dlog_start + size;
+}
+
+void log_flush(void)
+{
+	uint8_t* pos = dlog_start;
+
+	while (pos < dlog_pos) {
+		struct dlog_rec* r = (struct dlog_rec*)pos;
+		struct fmt_args a = { .words = r->words };
+
+		if (r->fmt)
+			format(r->fmt, &a);
+		else
+			emit_put_hex(r->words[0], r->words[1], r->words[2]);
+
+		pos += r->size;
+	}
+
+	dlog_pos = dlog_start;
+}
+
+// returns false if the record doesn't fit into an empty buffer
+static bool dlog_append(const char* fmt, uint64_t* words, unsigned n_words,
+			uint32_t str_mask)
+{
+	size_t size = sizeof(struct dlog_rec) + n_words * 8;
+
+	for (unsigned i = 0; i < n_words; i++)
+		if (str_mask & BIT(i))
+			size += strlen((char*)words[i]) + 1;
+
+	size = ALIGN(size, 8);
+	if (size > dlog_end - dlog_start)
+		return false;
+	if (size > dlog_end - dlog_pos)
+		log_flush();
+
+	struct dlog_rec* r = (struct dlog_rec*)dlog_pos;
+	char* str = (char*)&r->words[n_words];
+
+	r->fmt = fmt;
+	r->size = size;
+	r->n_words = n_words;
+	for (unsigned i = 0; i < n_words; i++) {
+		if (str_mask & BIT(i)) {
+			size_t len = strlen((char*)words[i]) + 1;
+
+			memcpy(str, (char*)words[i], len);
+			r->words[i] = (uintptr_t)str;
+			str += len;
+		} else {
+			r->words[i] = words[i];
+		}
+	}
+
+	dlog_pos += size;
+	return true;
+}
+
+// walks the format the same way as format(), but only collects arguments
+static bool dlog_vprintf(const char* fmt, va_list ap)
+{
+	uint64_t words[DLOG_MAX_ARGS];
+	uint32_t str_mask = 0;
+	unsigned n = 0;
+
+	for (const char* p = fmt; *p; p++) {
+		int l = 0;
+
+		if (*p != '%')
+			continue;
+
+		p++;
+		while (*p >= '0' && *p <= '9')
+			p++;
+		while (*p == 'l')
+			l++, p++;
+		while (*p == 'h')
+			p++;
+
+		if (!*p || l > 2)
+			break;
+		if (n == DLOG_MAX_ARGS)
+			return false;
+
+		switch (*p) {
+			case 's':
+				str_mask |= BIT(n);
+				/* fallthrough */
+			case 'p':
+				words[n++] = va_arg(ap, uintptr_t);
+				break;
+			case 'c':
+			case 'd':
+				words[n++] = l == 0 ? va_arg(ap, int) : va_arg(ap, long long);
+				break;
+			case 'u':
+			case 'x':
+			case 'f':
+				words[n++] = l == 0 ? va_arg(ap, unsigned int) : va_arg(ap, unsigned long long);
+				break;
+		}
+	}
+
+	return dlog_append(fmt, words, n, str_mask);
+}
+
+static bool dlog_printf(const char* fmt, ...)
+{
+	va_list ap;
+	bool ret;
+
+	va_start(ap, fmt);
+	ret = dlog_vprintf(fmt, ap);
 	va_end(ap);
+
+	return ret;
+}
+
+#define dlog_active() (dlog_start != NULL)
+
+#else
+
+#define dlog_active() false
+#define dlog_printf(a...) false
+#define dlog_vprintf(a...) false
+
+#endif
+
+void real_putc(char c)
+{
+	if (dlog_active() && dlog_printf("%c", c))
+		return;
+
+	emit_putc(c);
+}
+
+void real_puts(const char* s)
+{
+	if (dlog_active() && dlog_printf("%s", s))
+		return;
+
+	emit_puts(s);
+}
+
+void real_put_hex(unsigned long long hex, int align, int pad0)
+{
+#ifdef DEFERRED_LOGGING
+	uint64_t words[3] = { hex, align, pad0 };
+
+	if (dlog_active() && dlog_append(NULL, words, 3, 0))
+		return;
+#endif
+
+	emit_put_hex(hex, align, pad0);
+}
+
+void real_printf(const char* fmt, ...)
+{
+	struct fmt_args a = {};
+	bool done = false;
+
+	va_start(a.ap, fmt);
+	if (dlog_active())
+		done = dlog_vprintf(fmt, a.ap);
+	va_end(a.ap);
+
+	if (done)
+		return;
+
+	va_start(a.ap, fmt);
+	format(fmt, &a);
+	va_end(a.ap);
 }
 
 #endif
@@ -21,6 +21,24 @@
 
 void console_init(void);
 
+/*
+ * ASYNC_SERIAL queues serial output into a DRAM ring drained by DMA, once
+ * console_set_tx_buffer() is called. console_flush() outputs any deferred
+ * messages and waits until everything is sent.
+ */
+
+#ifdef SERIAL_CONSOLE
+void console_flush(void);
+#else
+#define console_flush() log_flush()
+#endif
+
+#ifdef ASYNC_SERIAL
+void console_set_tx_buffer(void* buf, size_t size);
+#else
+#define console_set_tx_buffer(a...)
+#endif
+
 #ifdef PBOOT_FDT_LOG
 void append_log(char c);
 #endif
@@ -50,6 +68,23 @@ void real_put_hex(unsigned long long value, int align, int pad0);
 
 #endif
 
+/*
+ * DEFERRED_LOGGING stores messages unformatted into a DRAM buffer once
+ * log_set_buffer() is called. They are output by log_flush().
+ */
+
+#if defined(DEFERRED_LOGGING) && (defined(SERIAL_CONSOLE) || defined(PBOOT_FDT_LOG) || defined(VIDEO_CONSOLE))
+
+void log_set_buffer(void* buf, size_t size);
+void log_flush(void);
+
+#else
+
+#define log_set_buffer(a...)
+#define log_flush()
+
+#endif
+
 /*
  * NORMAL_LOGGING redirects output of printf() and friends to the
  * real logging functions.
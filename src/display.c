@@ -50,10 +50,9 @@
 #include "pmic.h"
 #include "ccu.h"
 #include "display.h"
-
-#ifndef DUMP_DSI_INIT
-#define DUMP_DSI_INIT 0
-#endif
+#include "dsi.h"
+#include "sched.h"
+#include "timeline.h"
 
 #ifndef DSI_FULL_INIT
 #define DSI_FULL_INIT 0
@@ -80,169 +79,6 @@
 // * run dsi commands on the panel to initialize it/turn it on
 //
 
-// {{{ PANEL
-
-#define PANEL_HDISPLAY		(720)
-#define PANEL_HSYNC_START	(720 + 30)
-#define PANEL_HSYNC_END		(720 + 30 + 28)
-#define PANEL_HTOTAL		(720 + 30 + 28 + 30)
-#define PANEL_VDISPLAY		(1440)
-#define PANEL_VSYNC_START	(1440 + 18)
-#define PANEL_VSYNC_END		(1440 + 18 + 10)
-#define PANEL_VTOTAL		(1440 + 18 + 10 + 17)
-//#define PANEL_CLOCK		(PANEL_HTOTAL * PANEL_VTOTAL * 60 / 1000)
-#define PANEL_CLOCK		(72000)
-#define PANEL_LANES		4
-#define PANEL_DSI_BPP		24
-#define PANEL_BURST		0
-
-/*
- * Init sequence was supplied by the panel vendor:
- */
-
-/* Manufacturer specific Commands send via DSI */
-#define ST7703_CMD_ALL_PIXEL_OFF 0x22
-#define ST7703_CMD_ALL_PIXEL_ON  0x23
-#define ST7703_CMD_SETDISP       0xB2
-#define ST7703_CMD_SETRGBIF      0xB3
-#define ST7703_CMD_SETCYC        0xB4
-#define ST7703_CMD_SETBGP        0xB5
-#define ST7703_CMD_SETVCOM       0xB6
-#define ST7703_CMD_SETOTP        0xB7
-#define ST7703_CMD_SETPOWER_EXT  0xB8
-#define ST7703_CMD_SETEXTC       0xB9
-#define ST7703_CMD_SETMIPI       0xBA
-#define ST7703_CMD_SETVDC        0xBC
-#define ST7703_CMD_SETSCR        0xC0
-#define ST7703_CMD_SETPOWER      0xC1
-#define ST7703_CMD_UNK_C6        0xC6
-#define ST7703_CMD_SETPANEL      0xCC
-#define ST7703_CMD_SETGAMMA      0xE0
-#define ST7703_CMD_SETEQ         0xE3
-#define ST7703_CMD_SETGIP1       0xE9
-#define ST7703_CMD_SETGIP2       0xEA
-
-#define MIPI_DCS_SET_DISPLAY_ON	 0x29
-#define MIPI_DCS_EXIT_SLEEP_MODE 0x11
-
-struct dcs_seq {
-	u8 len;
-	const u8 *data;
-	u8 type;
-};
-
-#define dcs_seq_data(cmd, data...) \
-	static const u8 panel_dcs_initlist_data_##cmd[] = { cmd, data };
-#define dcs_seq_desc(cmd, data...) \
-	{ sizeof(panel_dcs_initlist_data_##cmd), panel_dcs_initlist_data_##cmd },
-
-dcs_seq_data(ST7703_CMD_SETEXTC,
-	     0xF1, 0x12, 0x83)
-dcs_seq_data(ST7703_CMD_SETMIPI,
-	     0x33, 0x81, 0x05, 0xF9, 0x0E, 0x0E, 0x20, 0x00,
-	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x44, 0x25,
-	     0x00, 0x91, 0x0a, 0x00, 0x00, 0x02, 0x4F, 0x11,
-	     0x00, 0x00, 0x37);
-dcs_seq_data(ST7703_CMD_SETPOWER_EXT,
-	     0x25, 0x22, 0x20, 0x03)
-dcs_seq_data(ST7703_CMD_SETRGBIF,
-	     0x10, 0x10, 0x05, 0x05, 0x03, 0xFF, 0x00, 0x00,
-	     0x00, 0x00)
-
-dcs_seq_data(ST7703_CMD_SETSCR,
-	     0x73, 0x73, 0x50, 0x50, 0x00, 0xC0, 0x08, 0x70,
-	     0x00)
-dcs_seq_data(ST7703_CMD_SETVDC, 0x4E)
-dcs_seq_data(ST7703_CMD_SETPANEL, 0x0B)
-dcs_seq_data(ST7703_CMD_SETCYC, 0x80)
-dcs_seq_data(ST7703_CMD_SETDISP, 0xF0, 0x12, 0xF0)
-dcs_seq_data(ST7703_CMD_SETEQ,
-	     0x00, 0x00, 0x0B, 0x0B, 0x10, 0x10, 0x00, 0x00,
-	     0x00, 0x00, 0xFF, 0x00, 0xC0, 0x10)
-dcs_seq_data(0xC6, 0x01, 0x00, 0xFF, 0xFF, 0x00)
-dcs_seq_data(ST7703_CMD_SETPOWER,
-	     0x74, 0x00, 0x32, 0x32, 0x77, 0xF1, 0xFF, 0xFF,
-	     0xCC, 0xCC, 0x77, 0x77)
-dcs_seq_data(ST7703_CMD_SETBGP, 0x07, 0x07)
-dcs_seq_data(ST7703_CMD_SETVCOM, 0x2C, 0x2C)
-dcs_seq_data(0xBF, 0x02, 0x11, 0x00)
-
-dcs_seq_data(ST7703_CMD_SETGIP1,
-	     0x82, 0x10, 0x06, 0x05, 0xA2, 0x0A, 0xA5, 0x12,
-	     0x31, 0x23, 0x37, 0x83, 0x04, 0xBC, 0x27, 0x38,
-	     0x0C, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0C, 0x00,
-	     0x03, 0x00, 0x00, 0x00, 0x75, 0x75, 0x31, 0x88,
-	     0x88, 0x88, 0x88, 0x88, 0x88, 0x13, 0x88, 0x64,
-	     0x64, 0x20, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
-	     0x02, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00)
-dcs_seq_data(ST7703_CMD_SETGIP2,
-	     0x02, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	     0x00, 0x00, 0x00, 0x00, 0x02, 0x46, 0x02, 0x88,
-	     0x88, 0x88, 0x88, 0x88, 0x88, 0x64, 0x88, 0x13,
-	     0x57, 0x13, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
-	     0x75, 0x88, 0x23, 0x14, 0x00, 0x00, 0x02, 0x00,
-	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x0A,
-	     0xA5, 0x00, 0x00, 0x00, 0x00)
-dcs_seq_data(ST7703_CMD_SETGAMMA,
-	     0x00, 0x09, 0x0D, 0x23, 0x27, 0x3C, 0x41, 0x35,
-	     0x07, 0x0D, 0x0E, 0x12, 0x13, 0x10, 0x12, 0x12,
-	     0x18, 0x00, 0x09, 0x0D, 0x23, 0x27, 0x3C, 0x41,
-	     0x35, 0x07, 0x0D, 0x0E, 0x12, 0x13, 0x10, 0x12,
-	     0x12, 0x18)
-dcs_seq_data(MIPI_DCS_EXIT_SLEEP_MODE)
-dcs_seq_data(MIPI_DCS_SET_DISPLAY_ON)
-
-static const struct dcs_seq panel_dcs_seq_initlist[] = {
-	dcs_seq_desc(ST7703_CMD_SETEXTC)
-	dcs_seq_desc(ST7703_CMD_SETMIPI)
-	dcs_seq_desc(ST7703_CMD_SETPOWER_EXT)
-	dcs_seq_desc(ST7703_CMD_SETRGBIF)
-	dcs_seq_desc(ST7703_CMD_SETSCR)
-	dcs_seq_desc(ST7703_CMD_SETVDC)
-	dcs_seq_desc(ST7703_CMD_SETPANEL)
-	dcs_seq_desc(ST7703_CMD_SETCYC)
-	dcs_seq_desc(ST7703_CMD_SETDISP)
-	dcs_seq_desc(ST7703_CMD_SETEQ)
-	dcs_seq_desc(0xC6)
-	dcs_seq_desc(ST7703_CMD_SETPOWER)
-	dcs_seq_desc(ST7703_CMD_SETBGP)
-	dcs_seq_desc(ST7703_CMD_SETVCOM)
-	dcs_seq_desc(0xBF)
-	dcs_seq_desc(ST7703_CMD_SETGIP1)
-	dcs_seq_desc(ST7703_CMD_SETGIP2)
-	dcs_seq_desc(ST7703_CMD_SETGAMMA)
-	dcs_seq_desc(MIPI_DCS_EXIT_SLEEP_MODE)
-	{ .type = 1, .len = 120 },
-	dcs_seq_desc(MIPI_DCS_SET_DISPLAY_ON)
-};
-
-ssize_t mipi_dsi_dcs_write(const u8 *data, size_t len);
-
-static void panel_init(void)
-{
-	int i, ret;
-
-	// run panel init
-
-	for (i = 0; i < ARRAY_SIZE(panel_dcs_seq_initlist); i++) {
-		const struct dcs_seq* s = &panel_dcs_seq_initlist[i];
-
-		if (s->type) {
-			udelay(s->len * 1000);
-			continue;
-		}
-
-                ret = mipi_dsi_dcs_write(s->data, s->len);
-                if (ret < 0) {
-			printf("DCS failed\n");
-                        return;
-		}
-	}
-}
-
-// }}}
 // {{{ DPHY
 
 #define DPHY_GCTL_REG             0x00
@@ -426,813 +262,6 @@ static void dphy_enable(void)
 // }}}
 // {{{ DSI
 
-#define SUN6I_DSI_CTL_REG               0x000
-#define SUN6I_DSI_CTL_EN                        BIT(0)
-
-#define SUN6I_DSI_BASIC_CTL_REG         0x00c
-#define SUN6I_DSI_BASIC_CTL_TRAIL_INV(n)                (((n) & 0xf) << 4)
-#define SUN6I_DSI_BASIC_CTL_TRAIL_FILL          BIT(3)
-#define SUN6I_DSI_BASIC_CTL_HBP_DIS             BIT(2)
-#define SUN6I_DSI_BASIC_CTL_HSA_HSE_DIS         BIT(1)
-#define SUN6I_DSI_BASIC_CTL_VIDEO_BURST         BIT(0)
-
-#define SUN6I_DSI_BASIC_CTL0_REG        0x010
-#define SUN6I_DSI_BASIC_CTL0_HS_EOTP_EN         BIT(18)
-#define SUN6I_DSI_BASIC_CTL0_CRC_EN             BIT(17)
-#define SUN6I_DSI_BASIC_CTL0_ECC_EN             BIT(16)
-#define SUN6I_DSI_BASIC_CTL0_INST_ST            BIT(0)
-
-#define SUN6I_DSI_BASIC_CTL1_REG        0x014
-#define SUN6I_DSI_BASIC_CTL1_VIDEO_ST_DELAY(n)  (((n) & 0x1fff) << 4)
-#define SUN6I_DSI_BASIC_CTL1_VIDEO_FILL         BIT(2)
-#define SUN6I_DSI_BASIC_CTL1_VIDEO_PRECISION    BIT(1)
-#define SUN6I_DSI_BASIC_CTL1_VIDEO_MODE         BIT(0)
-
-#define SUN6I_DSI_BASIC_SIZE0_REG       0x018
-#define SUN6I_DSI_BASIC_SIZE0_VBP(n)            (((n) & 0xfff) << 16)
-#define SUN6I_DSI_BASIC_SIZE0_VSA(n)            ((n) & 0xfff)
-
-#define SUN6I_DSI_BASIC_SIZE1_REG       0x01c
-#define SUN6I_DSI_BASIC_SIZE1_VT(n)             (((n) & 0xfff) << 16)
-#define SUN6I_DSI_BASIC_SIZE1_VACT(n)           ((n) & 0xfff)
-
-#define SUN6I_DSI_INST_FUNC_REG(n)      (0x020 + (n) * 0x04)
-#define SUN6I_DSI_INST_FUNC_INST_MODE(n)        (((n) & 0xf) << 28)
-#define SUN6I_DSI_INST_FUNC_ESCAPE_ENTRY(n)     (((n) & 0xf) << 24)
-#define SUN6I_DSI_INST_FUNC_TRANS_PACKET(n)     (((n) & 0xf) << 20)
-#define SUN6I_DSI_INST_FUNC_LANE_CEN            BIT(4)
-#define SUN6I_DSI_INST_FUNC_LANE_DEN(n)         ((n) & 0xf)
-
-#define SUN6I_DSI_INST_LOOP_SEL_REG     0x040
-
-#define SUN6I_DSI_INST_LOOP_NUM_REG(n)  (0x044 + (n) * 0x10)
-#define SUN6I_DSI_INST_LOOP_NUM_N1(n)           (((n) & 0xfff) << 16)
-#define SUN6I_DSI_INST_LOOP_NUM_N0(n)           ((n) & 0xfff)
-
-#define SUN6I_DSI_INST_JUMP_SEL_REG     0x048
-
-#define SUN6I_DSI_INST_JUMP_CFG_REG(n)  (0x04c + (n) * 0x04)
-#define SUN6I_DSI_INST_JUMP_CFG_TO(n)           (((n) & 0xf) << 20)
-#define SUN6I_DSI_INST_JUMP_CFG_POINT(n)        (((n) & 0xf) << 16)
-#define SUN6I_DSI_INST_JUMP_CFG_NUM(n)          ((n) & 0xffff)
-
-#define SUN6I_DSI_TRANS_START_REG       0x060
-
-#define SUN6I_DSI_TRANS_ZERO_REG        0x078
-
-#define SUN6I_DSI_TCON_DRQ_REG          0x07c
-#define SUN6I_DSI_TCON_DRQ_ENABLE_MODE          BIT(28)
-#define SUN6I_DSI_TCON_DRQ_SET(n)               ((n) & 0x3ff)
-
-#define SUN6I_DSI_PIXEL_CTL0_REG        0x080
-#define SUN6I_DSI_PIXEL_CTL0_PD_PLUG_DISABLE    BIT(16)
-#define SUN6I_DSI_PIXEL_CTL0_FORMAT(n)          ((n) & 0xf)
-
-#define SUN6I_DSI_PIXEL_CTL1_REG        0x084
-
-#define SUN6I_DSI_PIXEL_PH_REG          0x090
-#define SUN6I_DSI_PIXEL_PH_ECC(n)               (((n) & 0xff) << 24)
-#define SUN6I_DSI_PIXEL_PH_WC(n)                (((n) & 0xffff) << 8)
-#define SUN6I_DSI_PIXEL_PH_VC(n)                (((n) & 3) << 6)
-#define SUN6I_DSI_PIXEL_PH_DT(n)                ((n) & 0x3f)
-
-#define SUN6I_DSI_PIXEL_PF0_REG         0x098
-#define SUN6I_DSI_PIXEL_PF0_CRC_FORCE(n)        ((n) & 0xffff)
-
-#define SUN6I_DSI_PIXEL_PF1_REG         0x09c
-#define SUN6I_DSI_PIXEL_PF1_CRC_INIT_LINEN(n)   (((n) & 0xffff) << 16)
-#define SUN6I_DSI_PIXEL_PF1_CRC_INIT_LINE0(n)   ((n) & 0xffff)
-
-#define SUN6I_DSI_SYNC_HSS_REG          0x0b0
-
-#define SUN6I_DSI_SYNC_HSE_REG          0x0b4
-
-#define SUN6I_DSI_SYNC_VSS_REG          0x0b8
-
-#define SUN6I_DSI_SYNC_VSE_REG          0x0bc
-
-#define SUN6I_DSI_BLK_HSA0_REG          0x0c0
-
-#define SUN6I_DSI_BLK_HSA1_REG          0x0c4
-#define SUN6I_DSI_BLK_PF(n)                     (((n) & 0xffff) << 16)
-#define SUN6I_DSI_BLK_PD(n)                     ((n) & 0xff)
-
-#define SUN6I_DSI_BLK_HBP0_REG          0x0c8
-
-#define SUN6I_DSI_BLK_HBP1_REG          0x0cc
-
-#define SUN6I_DSI_BLK_HFP0_REG          0x0d0
-
-#define SUN6I_DSI_BLK_HFP1_REG          0x0d4
-
-#define SUN6I_DSI_BLK_HBLK0_REG         0x0e0
-
-#define SUN6I_DSI_BLK_HBLK1_REG         0x0e4
-
-#define SUN6I_DSI_BLK_VBLK0_REG         0x0e8
-
-#define SUN6I_DSI_BLK_VBLK1_REG         0x0ec
-
-#define SUN6I_DSI_BURST_LINE_REG        0x0f0
-#define SUN6I_DSI_BURST_LINE_SYNC_POINT(n)      (((n) & 0xffff) << 16)
-#define SUN6I_DSI_BURST_LINE_NUM(n)             ((n) & 0xffff)
-
-#define SUN6I_DSI_BURST_DRQ_REG         0x0f4
-#define SUN6I_DSI_BURST_DRQ_EDGE1(n)            (((n) & 0xffff) << 16)
-#define SUN6I_DSI_BURST_DRQ_EDGE0(n)            ((n) & 0xffff)
-
-#define SUN6I_DSI_CMD_CTL_REG           0x200
-#define SUN6I_DSI_CMD_CTL_RX_OVERFLOW           BIT(26)
-#define SUN6I_DSI_CMD_CTL_RX_FLAG               BIT(25)
-#define SUN6I_DSI_CMD_CTL_TX_FLAG               BIT(9)
-
-#define SUN6I_DSI_CMD_RX_REG(n)         (0x240 + (n) * 0x04)
-
-#define SUN6I_DSI_DEBUG_DATA_REG        0x2f8
-
-#define SUN6I_DSI_CMD_TX_REG(n)         (0x300 + (n) * 0x04)
-
-#define SUN6I_DSI_SYNC_POINT            40
-
-#define DSI_BASE 0x01ca0000u
-
-#define MIPI_DSI_BLANKING_PACKET 0x19
-#define MIPI_DSI_PACKED_PIXEL_STREAM_24	0x3e
-#define MIPI_DSI_V_SYNC_START	 0x01
-#define MIPI_DSI_V_SYNC_END	 0x11
-#define MIPI_DSI_H_SYNC_START	 0x21
-#define MIPI_DSI_H_SYNC_END	 0x31
-#define MIPI_DSI_DCS_LONG_WRITE	       0x39
-#define MIPI_DSI_DCS_SHORT_WRITE_PARAM 0x15
-#define MIPI_DSI_DCS_SHORT_WRITE       0x05
-
-enum sun6i_dsi_start_inst {
-        DSI_START_LPRX,
-        DSI_START_LPTX,
-        DSI_START_HSC,
-        DSI_START_HSD,
-};
-
-enum sun6i_dsi_inst_id {
-        DSI_INST_ID_LP11        = 0,
-        DSI_INST_ID_TBA,
-        DSI_INST_ID_HSC,
-        DSI_INST_ID_HSD,
-        DSI_INST_ID_LPDT,
-        DSI_INST_ID_HSCEXIT,
-        DSI_INST_ID_NOP,
-        DSI_INST_ID_DLY,
-        DSI_INST_ID_END         = 15,
-};
-
-enum sun6i_dsi_inst_mode {
-        DSI_INST_MODE_STOP      = 0,
-        DSI_INST_MODE_TBA,
-        DSI_INST_MODE_HS,
-        DSI_INST_MODE_ESCAPE,
-        DSI_INST_MODE_HSCEXIT,
-        DSI_INST_MODE_NOP,
-};
-
-enum sun6i_dsi_inst_escape {
-        DSI_INST_ESCA_LPDT      = 0,
-        DSI_INST_ESCA_ULPS,
-        DSI_INST_ESCA_UN1,
-        DSI_INST_ESCA_UN2,
-        DSI_INST_ESCA_RESET,
-        DSI_INST_ESCA_UN3,
-        DSI_INST_ESCA_UN4,
-        DSI_INST_ESCA_UN5,
-};
-
-enum sun6i_dsi_inst_packet {
-        DSI_INST_PACK_PIXEL     = 0,
-        DSI_INST_PACK_COMMAND,
-};
-
-static const u32 sun6i_dsi_ecc_array[] = {
-        [0] = (BIT(0) | BIT(1) | BIT(2) | BIT(4) | BIT(5) | BIT(7) | BIT(10) |
-               BIT(11) | BIT(13) | BIT(16) | BIT(20) | BIT(21) | BIT(22) |
-               BIT(23)),
-        [1] = (BIT(0) | BIT(1) | BIT(3) | BIT(4) | BIT(6) | BIT(8) | BIT(10) |
-               BIT(12) | BIT(14) | BIT(17) | BIT(20) | BIT(21) | BIT(22) |
-               BIT(23)),
-        [2] = (BIT(0) | BIT(2) | BIT(3) | BIT(5) | BIT(6) | BIT(9) | BIT(11) |
-               BIT(12) | BIT(15) | BIT(18) | BIT(20) | BIT(21) | BIT(22)),
-        [3] = (BIT(1) | BIT(2) | BIT(3) | BIT(7) | BIT(8) | BIT(9) | BIT(13) |
-               BIT(14) | BIT(15) | BIT(19) | BIT(20) | BIT(21) | BIT(23)),
-        [4] = (BIT(4) | BIT(5) | BIT(6) | BIT(7) | BIT(8) | BIT(9) | BIT(16) |
-               BIT(17) | BIT(18) | BIT(19) | BIT(20) | BIT(22) | BIT(23)),
-        [5] = (BIT(10) | BIT(11) | BIT(12) | BIT(13) | BIT(14) | BIT(15) |
-               BIT(16) | BIT(17) | BIT(18) | BIT(19) | BIT(21) | BIT(22) |
-               BIT(23)),
-};
-
-static u32 sun6i_dsi_ecc_compute(unsigned int data)
-{
-        int i;
-        u8 ecc = 0;
-
-        for (i = 0; i < ARRAY_SIZE(sun6i_dsi_ecc_array); i++) {
-                u32 field = sun6i_dsi_ecc_array[i];
-                bool init = false;
-                u8 val = 0;
-                int j;
-
-                for (j = 0; j < 24; j++) {
-                        if (!(BIT(j) & field))
-                                continue;
-
-                        if (!init) {
-                                val = (BIT(j) & data) ? 1 : 0;
-                                init = true;
-                        } else {
-                                val ^= (BIT(j) & data) ? 1 : 0;
-                        }
-                }
-
-                ecc |= val << i;
-        }
-
-        return ecc;
-}
-
-static u16 const crc_ccitt_table[256] = {
-	0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
-	0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
-	0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
-	0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
-	0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
-	0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
-	0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
-	0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
-	0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
-	0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
-	0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
-	0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
-	0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
-	0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
-	0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
-	0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
-	0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
-	0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
-	0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
-	0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
-	0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
-	0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
-	0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
-	0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
-	0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
-	0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
-	0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
-	0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
-	0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
-	0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
-	0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
-	0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
-};
-
-static inline u16 crc_ccitt_byte(u16 crc, const u8 c)
-{
-	return (crc >> 8) ^ crc_ccitt_table[(crc ^ c) & 0xff];
-}
-
-static u16 crc_ccitt(u16 crc, u8 const *buffer, size_t len)
-{
-	while (len--)
-		crc = crc_ccitt_byte(crc, *buffer++);
-	return crc;
-}
-
-static u16 sun6i_dsi_crc_compute(u8 const *buffer, size_t len)
-{
-        return crc_ccitt(0xffff, buffer, len);
-}
-
-static u16 sun6i_dsi_crc_repeat(u8 pd, u8 *buffer, size_t len)
-{
-        memset(buffer, pd, len);
-
-        return sun6i_dsi_crc_compute(buffer, len);
-}
-
-static u32 sun6i_dsi_build_sync_pkt(u8 dt, u8 vc, u8 d0, u8 d1)
-{
-        u32 val = dt & 0x3f;
-
-        val |= (vc & 3) << 6;
-        val |= (d0 & 0xff) << 8;
-        val |= (d1 & 0xff) << 16;
-        val |= sun6i_dsi_ecc_compute(val) << 24;
-
-        return val;
-}
-
-static u32 sun6i_dsi_build_blk0_pkt(u8 vc, u16 wc)
-{
-        return sun6i_dsi_build_sync_pkt(MIPI_DSI_BLANKING_PACKET, vc,
-                                        wc & 0xff, wc >> 8);
-}
-
-static u32 sun6i_dsi_build_blk1_pkt(u16 pd, u8 *buffer, size_t len)
-{
-        u32 val = SUN6I_DSI_BLK_PD(pd);
-
-        return val | SUN6I_DSI_BLK_PF(sun6i_dsi_crc_repeat(pd, buffer, len));
-}
-
-static uint32_t dsi_read(unsigned long reg)
-{
-	return readl(DSI_BASE + reg);
-}
-
-static void dsi_write(unsigned long reg, uint32_t val)
-{
-#if DUMP_DSI_INIT
-	bool skip = (reg == 0x0200 && val == 0x06000200) || (reg == 0x0048 && val == 0x000f0004);
-	if (!skip)
-		printf("\t{ 0x%04lx, 0x%08x },\n", reg, val);
-#endif
-	writel(val, DSI_BASE + reg);
-}
-
-static void dsi_update_bits(unsigned long reg, uint32_t mask, uint32_t val)
-{
-	uint32_t tmp = readl(DSI_BASE + reg);
-#if DUMP_DSI_INIT
-	if (reg == 0x10 && mask == 1 && val == 1) {
-		printf("\t{ MAGIC_COMMIT, 0 },\n");
-	} else {
-		printf("dsi_update_bits: 0x%08lx : %08x -> (%08x) %08x\n", DSI_BASE + reg, tmp, mask, val);
-	}
-#endif
-	tmp &= ~mask;
-	writel(tmp | val, DSI_BASE + reg);
-}
-
-static void sun6i_dsi_inst_setup(enum sun6i_dsi_inst_id id,
-				 enum sun6i_dsi_inst_mode mode,
-				 bool clock, u8 data,
-				 enum sun6i_dsi_inst_packet packet,
-				 enum sun6i_dsi_inst_escape escape)
-{
-	dsi_write(SUN6I_DSI_INST_FUNC_REG(id),
-		  SUN6I_DSI_INST_FUNC_INST_MODE(mode) |
-		  SUN6I_DSI_INST_FUNC_ESCAPE_ENTRY(escape) |
-		  SUN6I_DSI_INST_FUNC_TRANS_PACKET(packet) |
-		  (clock ? SUN6I_DSI_INST_FUNC_LANE_CEN : 0) |
-		  SUN6I_DSI_INST_FUNC_LANE_DEN(data));
-}
-
-static void sun6i_dsi_inst_init(void)
-{
-        u8 lanes_mask = GENMASK(PANEL_LANES - 1, 0);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_LP11, DSI_INST_MODE_STOP,
-			     true, lanes_mask, 0, 0);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_TBA, DSI_INST_MODE_TBA,
-			     false, 1, 0, 0);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_HSC, DSI_INST_MODE_HS,
-			     true, 0, DSI_INST_PACK_PIXEL, 0);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_HSD, DSI_INST_MODE_HS,
-			     false, lanes_mask, DSI_INST_PACK_PIXEL, 0);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_LPDT, DSI_INST_MODE_ESCAPE,
-			     false, 1, DSI_INST_PACK_COMMAND,
-			     DSI_INST_ESCA_LPDT);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_HSCEXIT, DSI_INST_MODE_HSCEXIT,
-			     true, 0, 0, 0);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_NOP, DSI_INST_MODE_STOP,
-			     false, lanes_mask, 0, 0);
-
-	sun6i_dsi_inst_setup(DSI_INST_ID_DLY, DSI_INST_MODE_NOP,
-			     true, lanes_mask, 0, 0);
-
-	dsi_write(SUN6I_DSI_INST_JUMP_CFG_REG(0),
-		  SUN6I_DSI_INST_JUMP_CFG_POINT(DSI_INST_ID_NOP) |
-		  SUN6I_DSI_INST_JUMP_CFG_TO(DSI_INST_ID_HSCEXIT) |
-		  SUN6I_DSI_INST_JUMP_CFG_NUM(1));
-};
-
-static u16 sun6i_dsi_get_line_num(void)
-{
-	unsigned int Bpp = PANEL_DSI_BPP / 8;
-
-	return PANEL_HTOTAL * Bpp / PANEL_LANES;
-}
-
-#define SUN6I_DSI_TCON_DIV	6
-
-static u16 sun6i_dsi_get_drq_edge0(u16 line_num, u16 edge1)
-{
-	u16 edge0 = edge1;
-
-	edge0 += (PANEL_HDISPLAY + 40) * SUN6I_DSI_TCON_DIV / 8;
-
-	if (edge0 > line_num)
-		return edge0 - line_num;
-
-	return 1;
-}
-
-static u16 sun6i_dsi_get_drq_edge1(u16 line_num)
-{
-	unsigned int Bpp = PANEL_DSI_BPP / 8;
-	unsigned int hbp = PANEL_HTOTAL - PANEL_HSYNC_END;
-	u16 edge1;
-
-	edge1 = SUN6I_DSI_SYNC_POINT;
-	edge1 += (PANEL_HDISPLAY + hbp + 20) * Bpp / PANEL_LANES;
-
-	if (edge1 > line_num)
-		return line_num;
-
-	return edge1;
-}
-
-static void sun6i_dsi_setup_burst(void)
-{
-        u32 val = 0;
-
-        if (PANEL_BURST) {
-                u16 line_num = sun6i_dsi_get_line_num();
-                u16 edge0, edge1;
-
-                edge1 = sun6i_dsi_get_drq_edge1(line_num);
-                edge0 = sun6i_dsi_get_drq_edge0(line_num, edge1);
-
-                dsi_write(SUN6I_DSI_BURST_DRQ_REG,
-                             SUN6I_DSI_BURST_DRQ_EDGE0(edge0) |
-                             SUN6I_DSI_BURST_DRQ_EDGE1(edge1));
-
-                dsi_write(SUN6I_DSI_BURST_LINE_REG,
-                             SUN6I_DSI_BURST_LINE_NUM(line_num) |
-                             SUN6I_DSI_BURST_LINE_SYNC_POINT(SUN6I_DSI_SYNC_POINT));
-
-                val = SUN6I_DSI_TCON_DRQ_ENABLE_MODE;
-        } else if ((PANEL_HSYNC_START - PANEL_HDISPLAY) > 20) {
-                /* Maaaaaagic */
-                u16 drq = (PANEL_HSYNC_START - PANEL_HDISPLAY) - 20;
-
-                drq *= PANEL_DSI_BPP;
-                drq /= 32;
-
-                val = (SUN6I_DSI_TCON_DRQ_ENABLE_MODE |
-                       SUN6I_DSI_TCON_DRQ_SET(drq));
-        }
-
-        dsi_write(SUN6I_DSI_TCON_DRQ_REG, val);
-}
-
-static void sun6i_dsi_setup_inst_loop(void)
-{
-        u16 delay = 50 - 1;
-
-        if (PANEL_BURST) {
-                u32 hsync_porch = (PANEL_HTOTAL - PANEL_HDISPLAY) * 150;
-
-                delay = (hsync_porch / ((PANEL_CLOCK / 1000) * 8));
-                delay -= 50;
-        }
-
-	dsi_write(SUN6I_DSI_INST_LOOP_SEL_REG,
-		  2 << (4 * DSI_INST_ID_LP11) |
-		  3 << (4 * DSI_INST_ID_DLY));
-
-	dsi_write(SUN6I_DSI_INST_LOOP_NUM_REG(0),
-		  SUN6I_DSI_INST_LOOP_NUM_N0(50 - 1) |
-		  SUN6I_DSI_INST_LOOP_NUM_N1(delay));
-	dsi_write(SUN6I_DSI_INST_LOOP_NUM_REG(1),
-		  SUN6I_DSI_INST_LOOP_NUM_N0(50 - 1) |
-		  SUN6I_DSI_INST_LOOP_NUM_N1(delay));
-}
-
-static void sun6i_dsi_setup_format(unsigned channel)
-{
-        u32 val = SUN6I_DSI_PIXEL_PH_VC(channel);
-        u8 dt, fmt;
-        u16 wc;
-
-        /* MIPI_DSI_FMT_RGB888 */
-	dt = MIPI_DSI_PACKED_PIXEL_STREAM_24;
-	fmt = 8;
-
-        val |= SUN6I_DSI_PIXEL_PH_DT(dt);
-
-	wc = PANEL_HDISPLAY * PANEL_DSI_BPP / 8;
-	val |= SUN6I_DSI_PIXEL_PH_WC(wc);
-	val |= SUN6I_DSI_PIXEL_PH_ECC(sun6i_dsi_ecc_compute(val));
-
-	dsi_write(SUN6I_DSI_PIXEL_PH_REG, val);
-
-	dsi_write(SUN6I_DSI_PIXEL_PF0_REG,
-		  SUN6I_DSI_PIXEL_PF0_CRC_FORCE(0xffff));
-
-	dsi_write(SUN6I_DSI_PIXEL_PF1_REG,
-		  SUN6I_DSI_PIXEL_PF1_CRC_INIT_LINE0(0xffff) |
-		  SUN6I_DSI_PIXEL_PF1_CRC_INIT_LINEN(0xffff));
-
-	dsi_write(SUN6I_DSI_PIXEL_CTL0_REG,
-		  SUN6I_DSI_PIXEL_CTL0_PD_PLUG_DISABLE |
-		  SUN6I_DSI_PIXEL_CTL0_FORMAT(fmt));
-}
-
-static void sun6i_dsi_setup_timings(unsigned channel)
-{
-        unsigned int Bpp = PANEL_DSI_BPP / 8;
-        u16 hbp = 0, hfp = 0, hsa = 0, hblk = 0, vblk = 0;
-        u32 basic_ctl = 0;
-        size_t bytes;
-        u8 *buffer;
-
-        /* Do all timing calculations up front to allocate buffer space */
-
-        if (PANEL_BURST) {
-                hblk = PANEL_HDISPLAY * Bpp;
-                basic_ctl = SUN6I_DSI_BASIC_CTL_VIDEO_BURST |
-                            SUN6I_DSI_BASIC_CTL_HSA_HSE_DIS |
-                            SUN6I_DSI_BASIC_CTL_HBP_DIS;
-
-                if (PANEL_LANES == 4)
-                        basic_ctl |= SUN6I_DSI_BASIC_CTL_TRAIL_FILL |
-                                     SUN6I_DSI_BASIC_CTL_TRAIL_INV(0xc);
-        } else {
-                /*
-                 * A sync period is composed of a blanking packet (4
-                 * bytes + payload + 2 bytes) and a sync event packet
-                 * (4 bytes). Its minimal size is therefore 10 bytes
-                 */
-#define HSA_PACKET_OVERHEAD     10
-                hsa = max((unsigned int)HSA_PACKET_OVERHEAD,
-                          (PANEL_HSYNC_END - PANEL_HSYNC_START) * Bpp - HSA_PACKET_OVERHEAD);
-
-                /*
-                 * The backporch is set using a blanking packet (4
-                 * bytes + payload + 2 bytes). Its minimal size is
-                 * therefore 6 bytes
-                 */
-#define HBP_PACKET_OVERHEAD     6
-                hbp = max((unsigned int)HBP_PACKET_OVERHEAD,
-                          (PANEL_HTOTAL - PANEL_HSYNC_END) * Bpp - HBP_PACKET_OVERHEAD);
-
-                /*
-                 * The frontporch is set using a sync event (4 bytes)
-                 * and two blanking packets (each one is 4 bytes +
-                 * payload + 2 bytes). Its minimal size is therefore
-                 * 16 bytes
-                 */
-#define HFP_PACKET_OVERHEAD     16
-                hfp = max((unsigned int)HFP_PACKET_OVERHEAD,
-                          (PANEL_HSYNC_START - PANEL_HDISPLAY) * Bpp - HFP_PACKET_OVERHEAD);
-
-                /*
-                 * The blanking is set using a sync event (4 bytes)
-                 * and a blanking packet (4 bytes + payload + 2
-                 * bytes). Its minimal size is therefore 10 bytes.
-                 */
-#define HBLK_PACKET_OVERHEAD    10
-                hblk = max((unsigned int)HBLK_PACKET_OVERHEAD,
-                           (PANEL_HTOTAL - (PANEL_HSYNC_END - PANEL_HSYNC_START)) * Bpp -
-                           HBLK_PACKET_OVERHEAD);
-
-                /*
-                 * And I'm not entirely sure what vblk is about. The driver in
-                 * Allwinner BSP is using a rather convoluted calculation
-                 * there only for 4 lanes. However, using 0 (the !4 lanes
-                 * case) even with a 4 lanes screen seems to work...
-                 */
-                vblk = 0;
-        }
-
-        /* How many bytes do we need to send all payloads? */
-        bytes = max_t(size_t, max(max(hfp, hblk), max(hsa, hbp)), vblk);
-	buffer = malloc(bytes);
-
-        dsi_write(SUN6I_DSI_BASIC_CTL_REG, basic_ctl);
-
-	dsi_write(SUN6I_DSI_SYNC_HSS_REG,
-		  sun6i_dsi_build_sync_pkt(MIPI_DSI_H_SYNC_START,
-					   channel,
-					   0, 0));
-
-	dsi_write(SUN6I_DSI_SYNC_HSE_REG,
-		  sun6i_dsi_build_sync_pkt(MIPI_DSI_H_SYNC_END,
-					   channel,
-					   0, 0));
-
-	dsi_write(SUN6I_DSI_SYNC_VSS_REG,
-		  sun6i_dsi_build_sync_pkt(MIPI_DSI_V_SYNC_START,
-					   channel,
-					   0, 0));
-
-	dsi_write(SUN6I_DSI_SYNC_VSE_REG,
-		  sun6i_dsi_build_sync_pkt(MIPI_DSI_V_SYNC_END,
-					   channel,
-					   0, 0));
-
-	dsi_write(SUN6I_DSI_BASIC_SIZE0_REG,
-		  SUN6I_DSI_BASIC_SIZE0_VSA(PANEL_VSYNC_END -
-					    PANEL_VSYNC_START) |
-		  SUN6I_DSI_BASIC_SIZE0_VBP(PANEL_VTOTAL -
-					    PANEL_VSYNC_END));
-
-	dsi_write(SUN6I_DSI_BASIC_SIZE1_REG,
-		  SUN6I_DSI_BASIC_SIZE1_VACT(PANEL_VDISPLAY) |
-		  SUN6I_DSI_BASIC_SIZE1_VT(PANEL_VTOTAL));
-
-	/* sync */
-	dsi_write(SUN6I_DSI_BLK_HSA0_REG,
-		  sun6i_dsi_build_blk0_pkt(channel, hsa));
-	dsi_write(SUN6I_DSI_BLK_HSA1_REG,
-		  sun6i_dsi_build_blk1_pkt(0, buffer, hsa));
-
-	/* backporch */
-	dsi_write(SUN6I_DSI_BLK_HBP0_REG,
-		  sun6i_dsi_build_blk0_pkt(channel, hbp));
-	dsi_write(SUN6I_DSI_BLK_HBP1_REG,
-		  sun6i_dsi_build_blk1_pkt(0, buffer, hbp));
-
-	/* frontporch */
-	dsi_write(SUN6I_DSI_BLK_HFP0_REG,
-		  sun6i_dsi_build_blk0_pkt(channel, hfp));
-	dsi_write(SUN6I_DSI_BLK_HFP1_REG,
-		  sun6i_dsi_build_blk1_pkt(0, buffer, hfp));
-
-	/* hblk */
-	dsi_write(SUN6I_DSI_BLK_HBLK0_REG,
-		  sun6i_dsi_build_blk0_pkt(channel, hblk));
-	dsi_write(SUN6I_DSI_BLK_HBLK1_REG,
-		  sun6i_dsi_build_blk1_pkt(0, buffer, hblk));
-
-	/* vblk */
-	dsi_write(SUN6I_DSI_BLK_VBLK0_REG,
-		  sun6i_dsi_build_blk0_pkt(channel, vblk));
-	dsi_write(SUN6I_DSI_BLK_VBLK1_REG,
-		  sun6i_dsi_build_blk1_pkt(0, buffer, vblk));
-}
-
-static u16 sun6i_dsi_get_video_start_delay(void)
-{
-        u16 delay = PANEL_VTOTAL - (PANEL_VSYNC_START - PANEL_VDISPLAY) + 1;
-        if (delay > PANEL_VTOTAL)
-                delay = delay % PANEL_VTOTAL;
-	if (delay < 1)
-		delay = 1;
-
-        return delay;
-}
-
-static void sun6i_dsi_inst_abort(void)
-{
-	dsi_update_bits(SUN6I_DSI_BASIC_CTL0_REG,
-			SUN6I_DSI_BASIC_CTL0_INST_ST, 0);
-}
-
-static void sun6i_dsi_inst_commit(void)
-{
-	dsi_update_bits(SUN6I_DSI_BASIC_CTL0_REG,
-			SUN6I_DSI_BASIC_CTL0_INST_ST,
-			SUN6I_DSI_BASIC_CTL0_INST_ST);
-}
-
-static int sun6i_dsi_inst_wait_for_completion(void)
-{
-	ulong end_ts = timer_get_boot_us() + 5000;
-
-        while (dsi_read(SUN6I_DSI_BASIC_CTL0_REG) & SUN6I_DSI_BASIC_CTL0_INST_ST) {
-		if (end_ts < timer_get_boot_us())
-			return -1;
-	}
-
-	return 0;
-}
-
-static int sun6i_dsi_start(enum sun6i_dsi_start_inst func)
-{
-        switch (func) {
-	case DSI_START_LPTX:
-		dsi_write(SUN6I_DSI_INST_JUMP_SEL_REG,
-			  DSI_INST_ID_LPDT << (4 * DSI_INST_ID_LP11) |
-			  DSI_INST_ID_END  << (4 * DSI_INST_ID_LPDT));
-		break;
-	case DSI_START_LPRX:
-		dsi_write(SUN6I_DSI_INST_JUMP_SEL_REG,
-			  DSI_INST_ID_LPDT << (4 * DSI_INST_ID_LP11) |
-			  DSI_INST_ID_DLY  << (4 * DSI_INST_ID_LPDT) |
-			  DSI_INST_ID_TBA  << (4 * DSI_INST_ID_DLY) |
-			  DSI_INST_ID_END  << (4 * DSI_INST_ID_TBA));
-		break;
-	case DSI_START_HSC:
-		dsi_write(SUN6I_DSI_INST_JUMP_SEL_REG,
-			  DSI_INST_ID_HSC  << (4 * DSI_INST_ID_LP11) |
-			  DSI_INST_ID_END  << (4 * DSI_INST_ID_HSC));
-		break;
-	case DSI_START_HSD:
-		dsi_write(SUN6I_DSI_INST_JUMP_SEL_REG,
-			  DSI_INST_ID_NOP  << (4 * DSI_INST_ID_LP11) |
-			  DSI_INST_ID_HSD  << (4 * DSI_INST_ID_NOP) |
-			  DSI_INST_ID_DLY  << (4 * DSI_INST_ID_HSD) |
-			  DSI_INST_ID_NOP  << (4 * DSI_INST_ID_DLY) |
-			  DSI_INST_ID_END  << (4 * DSI_INST_ID_HSCEXIT));
-		break;
-	default:
-		dsi_write(SUN6I_DSI_INST_JUMP_SEL_REG,
-			  DSI_INST_ID_END  << (4 * DSI_INST_ID_LP11));
-                break;
-        }
-
-        sun6i_dsi_inst_commit();
-
-        if (func == DSI_START_HSC)
-		dsi_update_bits(SUN6I_DSI_INST_FUNC_REG(DSI_INST_ID_LP11),
-				SUN6I_DSI_INST_FUNC_LANE_CEN, 0);
-
-        return 0;
-}
-
-static u32 sun6i_dsi_dcs_build_pkt_hdr(u8 type, const u8* buf, unsigned len)
-{
-        u32 pkt = type;
-
-        if (type == MIPI_DSI_DCS_LONG_WRITE) {
-                pkt |= (len & 0xffff) << 8;
-                pkt |= ((len >> 8) & 0xffff) << 16;
-        } else {
-                pkt |= buf[0] << 8;
-                if (len > 1)
-                        pkt |= buf[1] << 16;
-        }
-
-        pkt |= sun6i_dsi_ecc_compute(pkt) << 24;
-
-        return pkt;
-}
-
-ssize_t mipi_dsi_dcs_write(const u8 *data, size_t len)
-{
-        int ret;
-
-        dsi_write(SUN6I_DSI_CMD_CTL_REG,
-                     SUN6I_DSI_CMD_CTL_RX_OVERFLOW |
-                     SUN6I_DSI_CMD_CTL_RX_FLAG |
-                     SUN6I_DSI_CMD_CTL_TX_FLAG);
-
-	if (len >= 1 && len <= 2) {
-		// short packet
-		dsi_write(SUN6I_DSI_CMD_TX_REG(0),
-			  sun6i_dsi_dcs_build_pkt_hdr(len == 1 ?
-				MIPI_DSI_DCS_SHORT_WRITE : MIPI_DSI_DCS_SHORT_WRITE_PARAM,
-				data, len));
-
-		dsi_write(SUN6I_DSI_CMD_CTL_REG, (4 - 1));
-
-		sun6i_dsi_start(DSI_START_LPTX);
-	} else if (len > 2) {
-		int bounce_len = 0;
-		u8 *bounce;
-		u16 crc;
-
-		dsi_write(SUN6I_DSI_CMD_TX_REG(0),
-			  sun6i_dsi_dcs_build_pkt_hdr(MIPI_DSI_DCS_LONG_WRITE, data, len));
-
-		bounce = zalloc(len + sizeof(crc) + 4);
-
-		memcpy(bounce, data, len);
-		bounce_len += len;
-
-		crc = sun6i_dsi_crc_compute(bounce, len);
-		memcpy(bounce + bounce_len, &crc, sizeof(crc));
-		bounce_len += sizeof(crc);
-
-		for (unsigned i = 0; i < DIV_ROUND_UP(bounce_len, 4); i++)
-			dsi_write(SUN6I_DSI_CMD_TX_REG(1 + i), ((u32*)bounce)[i]);
-
-		dsi_write(SUN6I_DSI_CMD_CTL_REG, bounce_len + 4 - 1);
-
-		sun6i_dsi_start(DSI_START_LPTX);
-		/*
-		 * TODO: There's some bits (reg 0x200, bits 8/9) that
-		 * apparently can be used to check whether the data have been
-		 * sent, but I couldn't get it to work reliably.
-		 */
-	} else {
-		return -1;
-	}
-
-	ret = sun6i_dsi_inst_wait_for_completion();
-	if (ret < 0) {
-		sun6i_dsi_inst_abort();
-		return ret;
-	}
-
-	return 0;
-}
-
 static void dsi_init(void)
 {
 	display_board_init();
@@ -1241,39 +270,7 @@ static void dsi_init(void)
 	setbits_le32(CCU_BUS_CLK_GATE0, 1 << 1);
 	setbits_le32(CCU_BUS_SOFT_RST0, 1 << 1);
 
-        /*
-         * Enable the DSI block.
-         */
-#if DUMP_DSI_INIT
-	printf("struct reg_inst dsi_init_seq[] = {\n");
-#endif
-        dsi_write(SUN6I_DSI_CTL_REG, SUN6I_DSI_CTL_EN);
-
-        dsi_write(SUN6I_DSI_BASIC_CTL0_REG,
-		  SUN6I_DSI_BASIC_CTL0_ECC_EN | SUN6I_DSI_BASIC_CTL0_CRC_EN);
-
-        dsi_write(SUN6I_DSI_TRANS_START_REG, 10);
-        dsi_write(SUN6I_DSI_TRANS_ZERO_REG, 0);
-
-        sun6i_dsi_inst_init();
-
-        dsi_write(SUN6I_DSI_DEBUG_DATA_REG, 0xff);
-
-	u16 delay = sun6i_dsi_get_video_start_delay();
-	dsi_write(SUN6I_DSI_BASIC_CTL1_REG,
-		  SUN6I_DSI_BASIC_CTL1_VIDEO_ST_DELAY(delay) |
-		  SUN6I_DSI_BASIC_CTL1_VIDEO_FILL |
-		  SUN6I_DSI_BASIC_CTL1_VIDEO_PRECISION |
-		  SUN6I_DSI_BASIC_CTL1_VIDEO_MODE);
-
-        sun6i_dsi_setup_burst();
-        sun6i_dsi_setup_inst_loop();
-        sun6i_dsi_setup_format(0);
-        sun6i_dsi_setup_timings(0);
-
-#if DUMP_DSI_INIT
-	printf("};\n");
-#endif
+	dsi_controller_init();
 
 	dphy_enable();
 
@@ -1283,13 +280,7 @@ static void dsi_init(void)
 	// wait for initialization (5-120ms, depending on mode... hmm?)
 	udelay(15000);
 
-#if DUMP_DSI_INIT
-	printf("\nstruct reg_inst dsi_panel_init_seq[] = {\n");
-#endif
-	panel_init();
-#if DUMP_DSI_INIT
-	printf("};\n");
-#endif
+	dsi_panel_init();
 
         sun6i_dsi_start(DSI_START_HSC);
 
@@ -1298,209 +289,12 @@ static void dsi_init(void)
         sun6i_dsi_start(DSI_START_HSD);
 }
 
-// }}}
-// {{{ DSI SMALL
-
-#define MAGIC_COMMIT 0xffffu
-#define MAGIC_SLEEP 0xfffeu
-
-struct reg_inst {
-	u16 inst;
-	u32 val;
-} __packed;
-
-struct reg_inst dsi_init_seq[] = {
-	{ 0x0000, 0x00000001 },
-	{ 0x0010, 0x00030000 },
-	{ 0x0060, 0x0000000a },
-	{ 0x0078, 0x00000000 },
-	{ 0x0020, 0x0000001f },
-	{ 0x0024, 0x10000001 },
-	{ 0x0028, 0x20000010 },
-	{ 0x002c, 0x2000000f },
-	{ 0x0030, 0x30100001 },
-	{ 0x0034, 0x40000010 },
-	{ 0x0038, 0x0000000f },
-	{ 0x003c, 0x5000001f },
-	{ 0x004c, 0x00560001 },
-	{ 0x02f8, 0x000000ff },
-	{ 0x0014, 0x00005bc7 },
-	{ 0x007c, 0x10000007 },
-	{ 0x0040, 0x30000002 },
-	{ 0x0044, 0x00310031 },
-	{ 0x0054, 0x00310031 },
-	{ 0x0090, 0x1308703e },
-	{ 0x0098, 0x0000ffff },
-	{ 0x009c, 0xffffffff },
-	{ 0x0080, 0x00010008 },
-	{ 0x000c, 0x00000000 },
-	{ 0x00b0, 0x12000021 },
-	{ 0x00b4, 0x01000031 },
-	{ 0x00b8, 0x07000001 },
-	{ 0x00bc, 0x14000011 },
-	{ 0x0018, 0x0011000a },
-	{ 0x001c, 0x05cd05a0 },
-	{ 0x00c0, 0x09004a19 },
-	{ 0x00c4, 0x50b40000 },
-	{ 0x00c8, 0x35005419 },
-	{ 0x00cc, 0x757a0000 },
-	{ 0x00d0, 0x09004a19 },
-	{ 0x00d4, 0x50b40000 },
-	{ 0x00e0, 0x0c091a19 },
-	{ 0x00e4, 0x72bd0000 },
-	{ 0x00e8, 0x1a000019 },
-	{ 0x00ec, 0xffff0000 },
-};
-
-struct reg_inst dsi_panel_init_seq[] = {
-	{ 0x0300, 0x2c000439 },
-	{ 0x0304, 0x8312f1b9 },
-	{ 0x0308, 0x00005d84 },
-	{ 0x0200, 0x00000009 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x2f001c39 },
-	{ 0x0304, 0x058133ba },
-	{ 0x0308, 0x200e0ef9 },
-	{ 0x030c, 0x00000000 },
-	{ 0x0310, 0x44000000 },
-	{ 0x0314, 0x0a910025 },
-	{ 0x0318, 0x4f020000 },
-	{ 0x031c, 0x37000011 },
-	{ 0x0320, 0x0000e22c },
-	{ 0x0200, 0x00000021 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x36000539 },
-	{ 0x0304, 0x202225b8 },
-	{ 0x0308, 0x00720303 },
-	{ 0x0200, 0x0000000a },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x2c000b39 },
-	{ 0x0304, 0x051010b3 },
-	{ 0x0308, 0x00ff0305 },
-	{ 0x030c, 0x6f000000 },
-	{ 0x0310, 0x000000bc },
-	{ 0x0200, 0x00000010 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x36000a39 },
-	{ 0x0304, 0x507373c0 },
-	{ 0x0308, 0x08c00050 },
-	{ 0x030c, 0x6a1b0070 },
-	{ 0x0200, 0x0000000f },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x354ebc15 },
-	{ 0x0200, 0x00000003 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x220bcc15 },
-	{ 0x0200, 0x00000003 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x2280b415 },
-	{ 0x0200, 0x00000003 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x2c000439 },
-	{ 0x0304, 0xf012f0b2 },
-	{ 0x0308, 0x00008651 },
-	{ 0x0200, 0x00000009 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x0f000f39 },
-	{ 0x0304, 0x0b0000e3 },
-	{ 0x0308, 0x0010100b },
-	{ 0x030c, 0xff000000 },
-	{ 0x0310, 0x3610c000 },
-	{ 0x0314, 0x0000000f },
-	{ 0x0200, 0x00000014 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x30000639 },
-	{ 0x0304, 0xff0001c6 },
-	{ 0x0308, 0x258e00ff },
-	{ 0x0200, 0x0000000b },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x13000d39 },
-	{ 0x0304, 0x320074c1 },
-	{ 0x0308, 0xfff17732 },
-	{ 0x030c, 0x77ccccff },
-	{ 0x0310, 0x00e46977 },
-	{ 0x0200, 0x00000012 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x09000339 },
-	{ 0x0304, 0x7b0707b5 },
-	{ 0x0308, 0x000000b3 },
-	{ 0x0200, 0x00000008 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x09000339 },
-	{ 0x0304, 0x552c2cb6 },
-	{ 0x0308, 0x00000004 },
-	{ 0x0200, 0x00000008 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x2c000439 },
-	{ 0x0304, 0x001102bf },
-	{ 0x0308, 0x0000e9b5 },
-	{ 0x0200, 0x00000009 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x25004039 },
-	{ 0x0304, 0x061082e9 },
-	{ 0x0308, 0xa50aa205 },
-	{ 0x030c, 0x37233112 },
-	{ 0x0310, 0x27bc0483 },
-	{ 0x0314, 0x03000c38 },
-	{ 0x0318, 0x0c000000 },
-	{ 0x031c, 0x00000300 },
-	{ 0x0320, 0x31757500 },
-	{ 0x0324, 0x88888888 },
-	{ 0x0328, 0x88138888 },
-	{ 0x032c, 0x88206464 },
-	{ 0x0330, 0x88888888 },
-	{ 0x0334, 0x00880288 },
-	{ 0x0338, 0x00000000 },
-	{ 0x033c, 0x00000000 },
-	{ 0x0340, 0x00000000 },
-	{ 0x0344, 0x00000365 },
-	{ 0x0200, 0x00000045 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x1a003e39 },
-	{ 0x0304, 0x002102ea },
-	{ 0x0308, 0x00000000 },
-	{ 0x030c, 0x00000000 },
-	{ 0x0310, 0x02460200 },
-	{ 0x0314, 0x88888888 },
-	{ 0x0318, 0x88648888 },
-	{ 0x031c, 0x88135713 },
-	{ 0x0320, 0x88888888 },
-	{ 0x0324, 0x23887588 },
-	{ 0x0328, 0x02000014 },
-	{ 0x032c, 0x00000000 },
-	{ 0x0330, 0x00000000 },
-	{ 0x0334, 0x00000000 },
-	{ 0x0338, 0x03000000 },
-	{ 0x033c, 0x0000a50a },
-	{ 0x0340, 0x1b240000 },
-	{ 0x0200, 0x00000043 },
-	{ MAGIC_COMMIT, 0 },
-	{ 0x0300, 0x20002339 },
-	{ 0x0304, 0x0d0900e0 },
-	{ 0x0308, 0x413c2723 },
-	{ 0x030c, 0x0e0d0735 },
-	{ 0x0310, 0x12101312 },
-	{ 0x0314, 0x09001812 },
-	{ 0x0318, 0x3c27230d },
-	{ 0x031c, 0x0d073541 },
-	{ 0x0320, 0x1013120e },
-	{ 0x0324, 0x93181212 },
-	{ 0x0328, 0x000000bf },
-	{ 0x0200, 0x00000028 },
-	{ MAGIC_COMMIT, 0 },
-
-	// sleep out
-	{ 0x0300, 0x36001105 },
-	{ 0x0200, 0x00000003 },
-	{ MAGIC_COMMIT, 0 },
-	{ MAGIC_SLEEP, 120000 },
-
-	// display on
-	{ 0x0300, 0x1c002905 },
-	{ 0x0200, 0x00000003 },
-	{ MAGIC_COMMIT, 0 },
-};
+// dsi_init_seq and dsi_panel_init_seq tables are generated from
+// dsi_controller_init() and dsi_panel_init() by dsi-gen at build time
+#include "dsi-init-seq.h"
 
+// runs the sequence up to its end or up to and including the next
+// MAGIC_SLEEP, returns the number of processed instructions or -1 on error
 static int dsi_run_init_seq(struct reg_inst* insts, unsigned len)
 {
 	dsi_write(SUN6I_DSI_CMD_CTL_REG,
@@ -1512,7 +306,7 @@ static int dsi_run_init_seq(struct reg_inst* insts, unsigned len)
 		struct reg_inst* in = &insts[i];
 
 		if (in->inst == MAGIC_SLEEP) {
-			udelay(in->val);
+			return i + 1;
 		} else if (in->inst == MAGIC_COMMIT) {
 			sun6i_dsi_start(DSI_START_LPTX);
 			int ret = sun6i_dsi_inst_wait_for_completion();
@@ -1530,35 +324,7 @@ static int dsi_run_init_seq(struct reg_inst* insts, unsigned len)
 		}
 	}
 
-	return 0;
-}
-
-static int dsi_init_fast(void)
-{
-	/* mipi dsi bus enable */
-	setbits_le32(CCU_BUS_CLK_GATE0, 1 << 1);
-	setbits_le32(CCU_BUS_SOFT_RST0, 1 << 1);
-
-	dsi_run_init_seq(dsi_init_seq, ARRAY_SIZE(dsi_init_seq));
-	display_board_init();
-
-	dphy_enable();
-
-	// deassert reset
-	gpio_direction_output(SUNXI_GPD(23), 1); // PD23 - LCD-RST (active low)
-
-	// wait for initialization (5-120ms, depending on mode... hmm?)
-	udelay(15000);
-
-	dsi_run_init_seq(dsi_panel_init_seq, ARRAY_SIZE(dsi_panel_init_seq));
-
-        sun6i_dsi_start(DSI_START_HSC);
-
-        udelay(1000);
-
-        sun6i_dsi_start(DSI_START_HSD);
-
-	return 0;
+	return len;
 }
 
 // }}}
@@ -1944,7 +710,7 @@ void backlight_enable(uint32_t pct)
 	gpio_direction_output(SUNXI_GPH(10), 1); // enable backlight
 }
 
-void display_board_init(void)
+static void display_board_power_on(void)
 {
         /*
 	 * This needs to handle power on and SoC reset (power supplies
@@ -1973,6 +739,11 @@ void display_board_init(void)
 	pmic_write(0x16, 0x0b);
 	//pmic_write(0x16, 0x1a);
 	pmic_setbits(0x12, BIT(4));
+}
+
+void display_board_init(void)
+{
+	display_board_power_on();
 
 	// wait for power supplies and power-on init
 	udelay(15000);
@@ -1981,20 +752,151 @@ void display_board_init(void)
 // }}}
 // {{{ Display init
 
-// this initializes DE2 + TCON + DSI + PANEL + BACKLIGHT and creates a framebuffer
-bool display_init(void)
+enum {
+	DINIT_START,
+	DINIT_POWER_SETTLE,
+	DINIT_PANEL_SEQ,
+	DINIT_HS_START,
+	DINIT_DONE,
+};
+
+static struct {
+	int state;
+	unsigned seq_pos;
+	uint64_t deadline;
+} dinit;
+
+static void dinit_wait(int next_state, unsigned us)
 {
-	tcon0_init();
+	dinit.state = next_state;
+	dinit.deadline = timer_get_boot_us() + us;
+}
 
+// Non-blocking variant of display_init(). Each call performs at most one
+// step of the panel bring-up and returns immediately if the panel is still
+// in one of its mandatory wait periods, so that the caller can do useful
+// work (like loading images from MMC) in the meantime. Returns true once
+// the display is ready for display_commit().
+bool display_init_step(void)
+{
+	if (dinit.state == DINIT_DONE)
+		return true;
+	if (timer_get_boot_us() < dinit.deadline)
+		return false;
+
+	switch (dinit.state) {
+	case DINIT_START:
+		tl_begin(TL_DISPLAY_INIT, 0);
+		tcon0_init();
 #if DSI_FULL_INIT
-	dsi_init();
+		dsi_init();
+		dinit_wait(DINIT_HS_START, 0);
+		break;
 #else
-	dsi_init_fast();
+		/* mipi dsi bus enable */
+		setbits_le32(CCU_BUS_CLK_GATE0, 1 << 1);
+		setbits_le32(CCU_BUS_SOFT_RST0, 1 << 1);
+
+		dsi_run_init_seq(dsi_init_seq, ARRAY_SIZE(dsi_init_seq));
+		display_board_power_on();
+
+		// wait for power supplies and power-on init
+		dinit_wait(DINIT_POWER_SETTLE, 15000);
+		break;
+
+	case DINIT_POWER_SETTLE:
+		dphy_enable();
+
+		// deassert reset
+		gpio_direction_output(SUNXI_GPD(23), 1); // PD23 - LCD-RST (active low)
+
+		// wait for initialization (5-120ms, depending on mode... hmm?)
+		dinit_wait(DINIT_PANEL_SEQ, 15000);
+		break;
+
+	case DINIT_PANEL_SEQ: {
+		unsigned len = ARRAY_SIZE(dsi_panel_init_seq);
+		int n = dsi_run_init_seq(dsi_panel_init_seq + dinit.seq_pos,
+					 len - dinit.seq_pos);
+
+		// on failure, skip the rest of the sequence, the same as
+		// the blocking init always did
+		dinit.seq_pos = n < 0 ? len : dinit.seq_pos + n;
+		if (dinit.seq_pos < len) {
+			// stopped at MAGIC_SLEEP (sleep out)
+			dinit_wait(DINIT_PANEL_SEQ,
+				   dsi_panel_init_seq[dinit.seq_pos - 1].val);
+			break;
+		}
+
+		sun6i_dsi_start(DSI_START_HSC);
+		dinit_wait(DINIT_HS_START, 1000);
+		break;
+	}
+#endif
+
+	case DINIT_HS_START:
+#if !DSI_FULL_INIT
+		sun6i_dsi_start(DSI_START_HSD);
+#endif
+		de2_init();
+
+		//dump_dsi_registers();
+		//dump_de2_registers();
+
+		dinit.state = DINIT_DONE;
+		tl_end(TL_DISPLAY_INIT, 0);
+		return true;
+	}
+
+	return false;
+}
+
+#ifdef BOOT_TASKS
+
+static struct task dinit_task;
+static struct task* dinit_done_task;
+
+static void dinit_run(struct task* t)
+{
+	if (!display_init_step()) {
+		task_schedule_at(t, dinit.deadline);
+		return;
+	}
+
+	if (dinit_done_task)
+		task_schedule(dinit_done_task, 0);
+}
+
+// Runs display_init_step() as a scheduler task, done (if not NULL) is
+// scheduled once the display is ready for display_commit().
+void display_init_async(struct task* done)
+{
+	if (done)
+		dinit_done_task = done;
+
+	if (dinit.state == DINIT_DONE) {
+		if (done)
+			task_schedule(done, 0);
+		return;
+	}
+
+	dinit_task.run = dinit_run;
+	if (!task_pending(&dinit_task))
+		task_schedule(&dinit_task, 0);
+}
+
 #endif
-	de2_init();
 
-	//dump_dsi_registers();
-	//dump_de2_registers();
+// this initializes DE2 + TCON + DSI + PANEL + BACKLIGHT and creates a framebuffer
+bool display_init(void)
+{
+#ifdef BOOT_TASKS
+	display_init_async(NULL);
+	sched_wait(&dinit_task);
+#else
+	while (!display_init_step());
+#endif
 
 	return true;
 }
@@ -2014,6 +916,14 @@ bool display_frame_done(void)
 	return status & BIT(11);
 }
 
+// returns true until the last display_commit() is latched by DE2 at vblank
+bool display_commit_pending(void)
+{
+	struct de_glb * const de_glb_regs = (struct de_glb *)(SUNXI_DE2_MUX0_BASE + SUNXI_DE2_MUX_GLB_REGS);
+
+	return readl(&de_glb_regs->dbuff) & BIT(0);
+}
+
 void display_commit(struct display* d)
 {
 	ulong de_mux_base = SUNXI_DE2_MUX0_BASE;
@@ -23,6 +23,12 @@
 
 void display_board_init(void);
 bool display_init(void);
+bool display_init_step(void);
+
+#ifdef BOOT_TASKS
+struct task;
+void display_init_async(struct task* done);
+#endif
 void backlight_enable(uint32_t pct);
 
 struct display {
@@ -47,6 +53,7 @@ struct display {
 };
 
 void display_commit(struct display* d);
+bool display_commit_pending(void);
 bool display_frame_done(void);
 
 #define PANEL_WIDTH		(720)
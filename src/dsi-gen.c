@@ -0,0 +1,107 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tool that runs the full DSI init code from dsi.c against a register
+ * recording stub and prints the dsi_init_seq/dsi_panel_init_seq tables that
+ * are replayed by the fast display init in display.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define __packed __attribute__((packed))
+#define BIT(n) (1u << (n))
+#define GENMASK(h, l) (((~0u) << (l)) & (~0u >> (31 - (h))))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define max_t(t, a, b) max((t)(a), (t)(b))
+
+#include "dsi.h"
+
+static uint32_t regs[0x400 / 4];
+
+uint32_t dsi_read(unsigned long reg)
+{
+	return regs[reg / 4];
+}
+
+void dsi_write(unsigned long reg, uint32_t val)
+{
+	if (reg == SUN6I_DSI_BASIC_CTL0_REG && (val & SUN6I_DSI_BASIC_CTL0_INST_ST)) {
+		// dsi_run_init_seq() starts the LPTX instruction on
+		// MAGIC_COMMIT and waits for the controller to clear INST_ST
+		printf("\t{ MAGIC_COMMIT, 0 },\n");
+		val &= ~SUN6I_DSI_BASIC_CTL0_INST_ST;
+	} else if (reg == SUN6I_DSI_CMD_CTL_REG &&
+		   val == (SUN6I_DSI_CMD_CTL_RX_OVERFLOW |
+			   SUN6I_DSI_CMD_CTL_RX_FLAG |
+			   SUN6I_DSI_CMD_CTL_TX_FLAG)) {
+		// flags are cleared by dsi_run_init_seq() itself
+	} else if (reg == SUN6I_DSI_INST_JUMP_SEL_REG &&
+		   val == (DSI_INST_ID_LPDT << (4 * DSI_INST_ID_LP11) |
+			   DSI_INST_ID_END  << (4 * DSI_INST_ID_LPDT))) {
+		// part of MAGIC_COMMIT
+	} else {
+		printf("\t{ 0x%04lx, 0x%08x },\n", reg, val);
+	}
+
+	regs[reg / 4] = val;
+}
+
+static void udelay(unsigned long us)
+{
+	printf("\t{ MAGIC_SLEEP, %lu },\n", us);
+}
+
+static unsigned long timer_get_boot_us(void)
+{
+	return 0;
+}
+
+static void* zalloc(size_t len)
+{
+	return calloc(1, len);
+}
+
+#include "dsi.c"
+
+int main(int ac, char* av[])
+{
+	printf("// generated by dsi-gen from dsi.c, don't edit\n\n");
+
+	printf("struct reg_inst dsi_init_seq[] = {\n");
+	dsi_controller_init();
+	printf("};\n\n");
+
+	printf("struct reg_inst dsi_panel_init_seq[] = {\n");
+	dsi_panel_init();
+	printf("};\n");
+
+	return 0;
+}
@@ -33,12 +33,102 @@
 #include "debug.h"
 #include "mmu.h"
 #include "pmic.h"
+#include "ccu.h"
 #include "lradc.h"
 #include "dma.h"
 #include "display.h"
 #include "vidconsole.h"
 #include "storage.h"
 #include "gui.h"
+#include "smp.h"
+
+#include "font.h"
+
+struct memset_work {
+	void* p;
+	size_t len;
+};
+
+static void memset_work(void* arg)
+{
+	struct memset_work* w = arg;
+
+	memset(w->p, 0x5a, w->len);
+}
+
+/*
+ * vidconsole used to render from a glyph atlas (each glyph pre-expanded
+ * to scaled 32-bit pixel masks) before it switched to expanding 1bpp font
+ * rows during redraw. The atlas version is kept here as a baseline for
+ * the redraw timings.
+ */
+static uint32_t* atlas_build(struct vidconsole* c)
+{
+	unsigned char_stride = FONT_WIDTH * c->scale;
+	unsigned char_size = char_stride * FONT_HEIGHT;
+	uint32_t* atlas = malloc(char_size * FONT_CHARS * 4);
+
+	for (unsigned ch = 0; ch < FONT_CHARS; ch++) {
+		for (unsigned y = 0; y < FONT_HEIGHT; y++) {
+			uint8_t ln_data = c->font[ch * FONT_HEIGHT + y];
+
+			for (unsigned x = 0; x < FONT_WIDTH; x++) {
+				uint32_t pix = ln_data & 0x80 ? 0xffffffff : 0;
+
+				for (unsigned s = 0; s < c->scale; s++)
+					atlas[ch * char_size + y * char_stride + c->scale * x + s] = pix;
+
+				ln_data <<= 1;
+			}
+		}
+	}
+
+	return atlas;
+}
+
+static void atlas_redraw(struct vidconsole* c, uint32_t* atlas)
+{
+	uint32_t* fb = (uint32_t*)(uintptr_t)c->fb_start;
+	unsigned char_stride = FONT_WIDTH * c->scale;
+	unsigned char_size = char_stride * FONT_HEIGHT;
+
+	for (unsigned x = 0; x < c->w; x++) {
+		for (unsigned y = 0; y < c->h; y++) {
+			unsigned pos = y * c->w + x;
+			unsigned ch = c->screen[pos];
+			if (ch >= FONT_CHARS)
+				ch = '?';
+			uint32x4_t bg_v = vdupq_n_u32(c->bg_color[pos]);
+			uint32x4_t fg_v = vdupq_n_u32(c->fg_color[pos]);
+
+			uint32_t *con_p = fb + c->fb_width * y * FONT_HEIGHT * c->scale + x * char_stride;
+
+			for (unsigned cy = 0; cy < FONT_HEIGHT; cy++) {
+				for (unsigned s = 0; s < c->scale; s++) {
+					uint32_t *dst = con_p + c->fb_width * (c->scale * cy + s);
+					uint32_t *src = atlas + char_size * ch + char_stride * cy;
+					uint32_t len = char_stride;
+
+					while (len >= 4 * 2) {
+						uint32x4_t v0 = vld1q_u32(src);
+						v0 = vbslq_u32(v0, fg_v, bg_v);
+						uint32x4_t v1 = vld1q_u32(src + 4);
+						v1 = vbslq_u32(v1, fg_v, bg_v);
+						vst1q_u32(dst, v0);
+						vst1q_u32(dst + 4, v1);
+
+						src += 4 * 2;
+						dst += 4 * 2;
+						len -= 4 * 2;
+					}
+				}
+			}
+		}
+	}
+
+	if (!mmu_is_uncached(c->fb_start))
+		flush_cache(c->fb_start, c->fb_height * c->fb_pitch);
+}
 
 static uint8_t* heap_end = (uint8_t*)(uintptr_t)0x40000000u;
 
@@ -257,8 +347,7 @@ void main(void)
 	}
 
 	ccu_upclock();
-	udelay(160);
-	clock_set_pll1(1152000000);
+	ccu_set_cpux_opp(1152000000, 1300);
 
 	sys_console = zalloc(sizeof *sys_console);
 	vidconsole_init(sys_console, 45, 45, 2, 0xffffeecc, 0xff000000);
@@ -267,11 +356,74 @@ void main(void)
 
 	// 45x45 or 90x90
 	struct vidconsole* tconsole = zalloc(sizeof *tconsole);
+	ulong ts = timer_get_boot_us();
 	vidconsole_init(tconsole, 45, 45, 2, 0xffffeecc, 0xff104010);
+	printf("Console init: %lu us\n", timer_get_boot_us() - ts);
 	for (unsigned x = 0; x < 45; x++)
 		for (unsigned y = 0; y < 45; y++)
 			vidconsole_set_xy(tconsole, x, y, 'q', 0xffffff33, 0);
+
+	// compare redraw into the non-cacheable framebuffer region with
+	// redraw into cacheable DRAM followed by a cache flush
+	// and the font row expansion with the old glyph atlas
+	ts = timer_get_boot_us();
+	uint32_t* atlas = atlas_build(tconsole);
+	printf("Atlas build: %lu us\n", timer_get_boot_us() - ts);
+
+	uint32_t nc_fb = tconsole->fb_start;
+	ts = timer_get_boot_us();
 	vidconsole_redraw(tconsole);
+	printf("Redraw (non-cacheable fb): %lu us\n", timer_get_boot_us() - ts);
+	ts = timer_get_boot_us();
+	atlas_redraw(tconsole, atlas);
+	printf("Atlas redraw (non-cacheable fb): %lu us\n", timer_get_boot_us() - ts);
+
+	tconsole->fb_start = (uintptr_t)malloc(tconsole->fb_pitch * tconsole->fb_height);
+	ts = timer_get_boot_us();
+	vidconsole_redraw(tconsole);
+	printf("Redraw (cacheable fb + flush): %lu us\n", timer_get_boot_us() - ts);
+	ts = timer_get_boot_us();
+	atlas_redraw(tconsole, atlas);
+	printf("Atlas redraw (cacheable fb + flush): %lu us\n", timer_get_boot_us() - ts);
+	tconsole->fb_start = nc_fb;
+
+	// lib.c memory function throughput on cacheable DRAM
+	size_t blen = 4 << 20;
+	uint8_t* b1 = malloc(blen);
+	uint8_t* b2 = malloc(blen);
+
+	ts = timer_get_boot_us();
+	memset(b1, 0, blen);
+	printf("memset 0: %lu us\n", timer_get_boot_us() - ts);
+	ts = timer_get_boot_us();
+	memset(b2, 0x5a, blen);
+	printf("memset: %lu us\n", timer_get_boot_us() - ts);
+	ts = timer_get_boot_us();
+	memcpy(b1, b2, blen);
+	printf("memcpy: %lu us\n", timer_get_boot_us() - ts);
+	ts = timer_get_boot_us();
+	memmove(b1 + 64, b1, blen - 64);
+	printf("memmove: %lu us\n", timer_get_boot_us() - ts);
+	ts = timer_get_boot_us();
+	memcmp(b1 + 64, b2, blen - 64);
+	printf("memcmp: %lu us\n", timer_get_boot_us() - ts);
+
+	// same memset split across all cores
+	struct memset_work mw[SMP_CPUS];
+	smp_init();
+	udelay(1000);
+	ts = timer_get_boot_us();
+	for (int i = 0; i < SMP_CPUS; i++) {
+		mw[i].p = b2 + blen / SMP_CPUS * i;
+		mw[i].len = blen / SMP_CPUS;
+		if (i > 0 && !smp_run(i, memset_work, &mw[i]))
+			memset_work(&mw[i]);
+	}
+	memset_work(&mw[0]);
+	for (int i = 1; i < SMP_CPUS; i++)
+		smp_wait(i);
+	printf("memset (%d cores): %lu us\n", SMP_CPUS, timer_get_boot_us() - ts);
+	smp_fini();
 
 	display_init();
 
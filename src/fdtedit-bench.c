@@ -0,0 +1,391 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tool that applies the same set of fixups that p-boot applies during
+ * boot to a DTB, once via in-place libfdt edits (what fdtedit.c does without
+ * FDT_EDIT_LIST) and then via the FDT edit list from fdtedit.c written out
+ * by the single pass writer, checks that both produce the same tree and
+ * prints how long each method takes.
+ *
+ * Usage: fdtedit-bench board.dtb [board2.dtb ...]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+static void* zalloc(size_t len)
+{
+	return calloc(1, len);
+}
+
+#include "fdtedit.c"
+
+#define ITERATIONS 200
+
+static const char* priv_nodes[] = {
+	"/soc/mmc@1c10000",
+	"/sound",
+	"/soc/serial@1c28400",
+	"/soc/i2c@1c2b000",
+	"/i2c-csi",
+	"/soc/csi@1cb0000",
+};
+
+static const uint8_t mac_addr[6] = { 0x02, 0xba, 0x8c, 0x14, 0x5e, 0x31 };
+static char bootargs[] = "console=ttyS0,115200 console=tty1 root=/dev/mmcblk0p2 rootfstype=f2fs rw rootwait panic=3";
+static char pboot_log[16 * 1024];
+static uint8_t timings[512];
+
+// {{{ node lookups shared by both methods, to tell apart the cost of edits
+
+static int lookups(const void* fdt)
+{
+	int n = 0;
+
+	n += fdt_path_offset(fdt, "/soc/rsb@1f03400/pmic@3a3/adc") >= 0;
+	for (int i = 0; i < ARRAY_SIZE(priv_nodes); i++)
+		n += fdt_path_offset(fdt, priv_nodes[i]) >= 0;
+	n += fdt_path_offset(fdt, "/soc/serial@1c28c00/modem") >= 0;
+	n += fdt_path_offset(fdt, "/vbat-bb") >= 0;
+
+	const char* wifi = fdt_get_alias(fdt, "ethernet0");
+	n += wifi && fdt_path_offset(fdt, wifi) >= 0;
+	n += fdt_subnode_offset(fdt, 0, "p-boot") >= 0;
+	n += fdt_subnode_offset(fdt, 0, "chosen") >= 0;
+	n += fdt_subnode_offset(fdt, 0, "memory") >= 0;
+
+	return n;
+}
+
+// }}}
+// {{{ in-place libfdt edits, as done by p-boot before the edit list
+
+static int fixup_libfdt(void* fdt)
+{
+	int node, chosen, err;
+
+	node = fdt_path_offset(fdt, "/soc/rsb@1f03400/pmic@3a3/adc");
+	if (node >= 0)
+		fdt_delprop(fdt, node, "x-powers,ts-as-gpadc");
+
+	for (int i = 0; i < ARRAY_SIZE(priv_nodes); i++) {
+		node = fdt_path_offset(fdt, priv_nodes[i]);
+		if (node >= 0)
+			fdt_setprop(fdt, node, "status", "disabled", 9);
+	}
+
+	node = fdt_path_offset(fdt, "/soc/serial@1c28c00/modem");
+	if (node >= 0)
+		fdt_del_node(fdt, node);
+
+	node = fdt_path_offset(fdt, "/vbat-bb");
+	if (node >= 0)
+		fdt_setprop(fdt, node, "regulator-always-on", NULL, 0);
+
+	const char* wifi = fdt_get_alias(fdt, "ethernet0");
+	node = wifi ? fdt_path_offset(fdt, wifi) : -1;
+	if (node >= 0) {
+		if (fdt_getprop(fdt, node, "mac-address", NULL))
+			fdt_setprop(fdt, node, "mac-address", mac_addr, 6);
+		fdt_setprop(fdt, node, "local-mac-address", mac_addr, 6);
+	}
+
+	node = fdt_add_subnode(fdt, 0, "p-boot");
+	if (node < 0)
+		return node;
+
+	fdt_setprop(fdt, node, "log", pboot_log, sizeof pboot_log);
+	fdt_setprop(fdt, node, "timings", timings, sizeof timings);
+
+	chosen = fdt_subnode_offset(fdt, 0, "chosen");
+	if (chosen < 0)
+		chosen = fdt_add_subnode(fdt, 0, "chosen");
+	if (chosen < 0)
+		return chosen;
+
+	fdt_setprop_u32(fdt, chosen, "p-boot,framebuffer-start", 0x48000000);
+	fdt_add_mem_rsv(fdt, 0x48000000, 1440 * 720 * 4);
+	fdt_setprop(fdt, chosen, "bootargs", bootargs, sizeof bootargs);
+
+	node = fdt_subnode_offset(fdt, 0, "memory");
+	if (node < 0)
+		node = fdt_add_subnode(fdt, 0, "memory");
+	if (node < 0)
+		return node;
+
+	fdt_setprop_string(fdt, node, "device_type", "memory");
+	fdt_setprop(fdt, node, "reg", NULL, 0);
+	fdt_appendprop_addrrange(fdt, 0, node, "reg", 0x40000000, 0x80000000);
+
+	// adding /memory moves /chosen
+	chosen = fdt_subnode_offset(fdt, 0, "chosen");
+	fdt_add_mem_rsv(fdt, 0x4fe00000, 0x800000);
+	fdt_setprop_u32(fdt, chosen, "linux,initrd-start", 0x4fe00000);
+	fdt_setprop_u32(fdt, chosen, "linux,initrd-end", 0x50600000);
+
+	err = fdt_pack(fdt);
+	if (err < 0)
+		return err;
+
+	return fdt_totalsize(fdt);
+}
+
+// }}}
+// {{{ the same edits via the edit list
+
+static int fixup_edit(const void* fdt, void* out, int out_size)
+{
+	struct fdt_edit* e = fdt_edit_begin(fdt);
+	int node, chosen;
+
+	node = fdt_path_offset(fdt, "/soc/rsb@1f03400/pmic@3a3/adc");
+	if (node >= 0)
+		fdt_edit_delprop(e, node, "x-powers,ts-as-gpadc");
+
+	for (int i = 0; i < ARRAY_SIZE(priv_nodes); i++) {
+		node = fdt_path_offset(fdt, priv_nodes[i]);
+		if (node >= 0)
+			fdt_edit_setprop(e, node, "status", "disabled", 9);
+	}
+
+	node = fdt_path_offset(fdt, "/soc/serial@1c28c00/modem");
+	if (node >= 0)
+		fdt_edit_del_node(e, node);
+
+	node = fdt_path_offset(fdt, "/vbat-bb");
+	if (node >= 0)
+		fdt_edit_setprop(e, node, "regulator-always-on", NULL, 0);
+
+	const char* wifi = fdt_get_alias(fdt, "ethernet0");
+	node = wifi ? fdt_path_offset(fdt, wifi) : -1;
+	if (node >= 0) {
+		if (fdt_getprop(fdt, node, "mac-address", NULL))
+			fdt_edit_setprop(e, node, "mac-address", mac_addr, 6);
+		fdt_edit_setprop(e, node, "local-mac-address", mac_addr, 6);
+	}
+
+	node = fdt_edit_add_subnode(e, 0, "p-boot");
+	if (node < 0)
+		return node;
+
+	fdt_edit_setprop(e, node, "log", pboot_log, sizeof pboot_log);
+	fdt_edit_setprop(e, node, "timings", timings, sizeof timings);
+
+	chosen = fdt_edit_find_or_add_subnode(e, 0, "chosen");
+	if (chosen < 0)
+		return chosen;
+
+	fdt_edit_setprop_u32(e, chosen, "p-boot,framebuffer-start", 0x48000000);
+	fdt_edit_add_mem_rsv(e, 0x48000000, 1440 * 720 * 4);
+	fdt_edit_setprop(e, chosen, "bootargs", bootargs, sizeof bootargs);
+
+	node = fdt_edit_find_or_add_subnode(e, 0, "memory");
+	if (node < 0)
+		return node;
+
+	fdt_edit_setprop_string(e, node, "device_type", "memory");
+	fdt_edit_setprop_reg(e, 0, node, "reg", 0x40000000, 0x80000000);
+
+	fdt_edit_add_mem_rsv(e, 0x4fe00000, 0x800000);
+	fdt_edit_setprop_u32(e, chosen, "linux,initrd-start", 0x4fe00000);
+	fdt_edit_setprop_u32(e, chosen, "linux,initrd-end", 0x50600000);
+
+	return fdt_edit_finish(e, out, out_size);
+}
+
+// }}}
+// {{{ tree comparison, property and subnode order may differ
+
+static bool compare_nodes(const void* a, int na, const void* b, int nb, const char* path)
+{
+	int off, count_a = 0, count_b = 0;
+
+	fdt_for_each_property_offset(off, a, na) {
+		const char* name;
+		int len_a, len_b;
+		const void* val_a = fdt_getprop_by_offset(a, off, &name, &len_a);
+		const void* val_b = fdt_getprop(b, nb, name, &len_b);
+
+		if (!val_b || len_a != len_b || memcmp(val_a, val_b, len_a)) {
+			printf("  property %s/%s differs\n", path, name);
+			return false;
+		}
+
+		count_a++;
+	}
+
+	fdt_for_each_property_offset(off, b, nb)
+		count_b++;
+
+	fdt_for_each_subnode(off, a, na) {
+		int len;
+		const char* name = fdt_get_name(a, off, &len);
+		int sub = fdt_subnode_offset_namelen(b, nb, name, len);
+		char subpath[512];
+
+		snprintf(subpath, sizeof subpath, "%s/%s", path, name);
+		if (sub < 0) {
+			printf("  node %s is missing\n", subpath);
+			return false;
+		}
+
+		if (!compare_nodes(a, off, b, sub, subpath))
+			return false;
+
+		count_a++;
+	}
+
+	fdt_for_each_subnode(off, b, nb)
+		count_b++;
+
+	if (count_a != count_b) {
+		printf("  node %s has extra properties or subnodes\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+static bool compare_fdts(const void* a, const void* b)
+{
+	if (fdt_num_mem_rsv(a) != fdt_num_mem_rsv(b)) {
+		printf("  memory reservations differ\n");
+		return false;
+	}
+
+	for (int i = 0; i < fdt_num_mem_rsv(a); i++) {
+		uint64_t addr_a, size_a, addr_b, size_b;
+
+		fdt_get_mem_rsv(a, i, &addr_a, &size_a);
+		fdt_get_mem_rsv(b, i, &addr_b, &size_b);
+		if (addr_a != addr_b || size_a != size_b) {
+			printf("  memory reservation %d differs\n", i);
+			return false;
+		}
+	}
+
+	return compare_nodes(a, 0, b, 0, "");
+}
+
+// }}}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void* read_file(const char* path, size_t* size)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	void* data = malloc(*size);
+	if (fread(data, 1, *size, f) != *size) {
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+	return data;
+}
+
+int main(int ac, char* av[])
+{
+	int ret = 0;
+
+	if (ac < 2) {
+		fprintf(stderr, "usage: %s board.dtb [board2.dtb ...]\n", av[0]);
+		return 1;
+	}
+
+	for (int i = 1; i < ac; i++) {
+		size_t size;
+		void* dtb = read_file(av[i], &size);
+		if (!dtb || fdt_check_header(dtb) < 0) {
+			printf("%s: not a valid DTB\n", av[i]);
+			ret = 1;
+			continue;
+		}
+
+		int buf_size = size + 256 * 1024;
+		void* in_place = malloc(buf_size);
+		void* edited = malloc(buf_size);
+		int size_libfdt = 0, size_edit = 0;
+		double t, t_lookups, t_libfdt, t_edit;
+		volatile int found = 0;
+
+		// best of ITERATIONS runs, to filter out noise from the host
+		t_lookups = t_libfdt = t_edit = 1e9;
+		for (int j = 0; j < ITERATIONS; j++) {
+			t = now_us();
+			found += lookups(dtb);
+			t_lookups = min(t_lookups, now_us() - t);
+
+			t = now_us();
+			memcpy(in_place, dtb, size);
+			fdt_open_into(in_place, in_place, buf_size);
+			size_libfdt = fixup_libfdt(in_place);
+			t_libfdt = min(t_libfdt, now_us() - t);
+
+			t = now_us();
+			size_edit = fixup_edit(dtb, edited, buf_size);
+			t_edit = min(t_edit, now_us() - t);
+		}
+
+		printf("%s: %zu bytes\n", av[i], size);
+		printf("  node lookups:    %8.1f us\n", t_lookups);
+		printf("  libfdt in place: %8.1f us (edits %.1f us), %d bytes\n",
+		       t_libfdt, t_libfdt - t_lookups, size_libfdt);
+		printf("  edit list:       %8.1f us (edits %.1f us), %d bytes\n",
+		       t_edit, t_edit - t_lookups, size_edit);
+
+		if (size_libfdt < 0 || size_edit < 0) {
+			printf("  fixups failed (%d/%d)\n", size_libfdt, size_edit);
+			ret = 1;
+		} else if (fdt_check_full(edited, size_edit) < 0 ||
+			   !compare_fdts(in_place, edited)) {
+			printf("  results differ\n");
+			ret = 1;
+		} else {
+			printf("  results match\n");
+		}
+
+		free(in_place);
+		free(edited);
+		free(dtb);
+	}
+
+	return ret;
+}
@@ -0,0 +1,781 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FDTEDIT_BENCH
+#include <common.h>
+#include <malloc.h>
+#endif
+#include "fdtedit.h"
+
+#if defined(FDT_EDIT_LIST) || defined(FDTEDIT_BENCH)
+
+#define FDT_EDIT_MAX_OPS	256
+#define FDT_EDIT_MAX_NODES	32
+#define FDT_EDIT_MAX_RSV	8
+
+// handles of nodes added via the edit list start here, way past any
+// offset in the source blob
+#define FDT_EDIT_NODE_BASE	0x40000000
+
+#define FDT_EDIT_ALIGN(len)	(((len) + FDT_TAGSIZE - 1) & ~(FDT_TAGSIZE - 1))
+
+enum {
+	OP_SETPROP,
+	OP_DELPROP,
+	OP_DEL_NODE,
+};
+
+struct fdt_edit_op {
+	int node;
+	int type;
+	const char* name;
+	const void* val;
+	int len;
+	int nameoff;
+	bool done;
+};
+
+struct fdt_edit_node {
+	int parent;
+	const char* name;
+	bool deleted;
+};
+
+struct fdt_edit {
+	const void* fdt;
+
+	int n_ops;
+	struct fdt_edit_op ops[FDT_EDIT_MAX_OPS];
+
+	int n_nodes;
+	struct fdt_edit_node nodes[FDT_EDIT_MAX_NODES];
+
+	int n_rsv;
+	uint64_t rsv[FDT_EDIT_MAX_RSV][2];
+
+	// output state for fdt_edit_finish()
+	int n_ins;
+	struct {
+		int node;
+		int off;
+	} ins[FDT_EDIT_MAX_NODES];
+	char* out;
+	int out_pos;
+	int out_size;
+	char* strings;
+	int strings_len;
+};
+
+struct fdt_edit* fdt_edit_begin(const void* fdt)
+{
+	struct fdt_edit* e = zalloc(sizeof *e);
+
+	e->fdt = fdt;
+	return e;
+}
+
+const void* fdt_edit_fdt(struct fdt_edit* e)
+{
+	return e->fdt;
+}
+
+static struct fdt_edit_node* fdt_edit_new_node(struct fdt_edit* e, int node)
+{
+	if (node < FDT_EDIT_NODE_BASE || node >= FDT_EDIT_NODE_BASE + e->n_nodes)
+		return NULL;
+
+	return &e->nodes[node - FDT_EDIT_NODE_BASE];
+}
+
+static struct fdt_edit_op* fdt_edit_find_op(struct fdt_edit* e, int node,
+					    int type, const char* name)
+{
+	for (int i = 0; i < e->n_ops; i++) {
+		struct fdt_edit_op* op = &e->ops[i];
+
+		if (op->node != node)
+			continue;
+
+		if (type == OP_DEL_NODE) {
+			if (op->type == OP_DEL_NODE)
+				return op;
+		} else if (op->type != OP_DEL_NODE && !strcmp(op->name, name)) {
+			return op;
+		}
+	}
+
+	return NULL;
+}
+
+static struct fdt_edit_op* fdt_edit_add_op(struct fdt_edit* e, int node,
+					   int type, const char* name)
+{
+	struct fdt_edit_op* op = fdt_edit_find_op(e, node, type, name);
+
+	if (!op) {
+		if (e->n_ops == FDT_EDIT_MAX_OPS)
+			return NULL;
+
+		op = &e->ops[e->n_ops++];
+		op->node = node;
+		op->name = name;
+	}
+
+	op->type = type;
+	op->val = NULL;
+	op->len = 0;
+	return op;
+}
+
+static int fdt_edit_find_node(struct fdt_edit* e, int parent, const char* name)
+{
+	int node;
+
+	if (parent < FDT_EDIT_NODE_BASE) {
+		node = fdt_subnode_offset(e->fdt, parent, name);
+		if (node >= 0 && !fdt_edit_find_op(e, node, OP_DEL_NODE, NULL))
+			return node;
+	}
+
+	for (int i = 0; i < e->n_nodes; i++) {
+		struct fdt_edit_node* n = &e->nodes[i];
+
+		if (n->parent == parent && !n->deleted && !strcmp(n->name, name))
+			return FDT_EDIT_NODE_BASE + i;
+	}
+
+	return -FDT_ERR_NOTFOUND;
+}
+
+static int fdt_edit_new_subnode(struct fdt_edit* e, int parent, const char* name)
+{
+	if (e->n_nodes == FDT_EDIT_MAX_NODES)
+		return -FDT_ERR_NOSPACE;
+
+	struct fdt_edit_node* n = &e->nodes[e->n_nodes];
+	n->parent = parent;
+	n->name = name;
+
+	return FDT_EDIT_NODE_BASE + e->n_nodes++;
+}
+
+int fdt_edit_add_subnode(struct fdt_edit* e, int parent, const char* name)
+{
+	if (fdt_edit_find_node(e, parent, name) >= 0)
+		return -FDT_ERR_EXISTS;
+
+	return fdt_edit_new_subnode(e, parent, name);
+}
+
+int fdt_edit_find_or_add_subnode(struct fdt_edit* e, int parent, const char* name)
+{
+	int node = fdt_edit_find_node(e, parent, name);
+	if (node >= 0)
+		return node;
+
+	return fdt_edit_new_subnode(e, parent, name);
+}
+
+int fdt_edit_del_node(struct fdt_edit* e, int node)
+{
+	struct fdt_edit_node* n = fdt_edit_new_node(e, node);
+
+	if (n) {
+		n->deleted = true;
+		return 0;
+	}
+
+	return fdt_edit_add_op(e, node, OP_DEL_NODE, NULL) ? 0 : -FDT_ERR_NOSPACE;
+}
+
+int fdt_edit_setprop(struct fdt_edit* e, int node, const char* name,
+		     const void* val, int len)
+{
+	struct fdt_edit_op* op = fdt_edit_add_op(e, node, OP_SETPROP, name);
+	if (!op)
+		return -FDT_ERR_NOSPACE;
+
+	// callers often pass values on the stack
+	void* copy = malloc(len);
+	memcpy(copy, val, len);
+
+	op->val = copy;
+	op->len = len;
+	return 0;
+}
+
+int fdt_edit_delprop(struct fdt_edit* e, int node, const char* name)
+{
+	return fdt_edit_add_op(e, node, OP_DELPROP, name) ? 0 : -FDT_ERR_NOSPACE;
+}
+
+const void* fdt_edit_getprop(struct fdt_edit* e, int node, const char* name,
+			     int* lenp)
+{
+	struct fdt_edit_op* op = fdt_edit_find_op(e, node, OP_SETPROP, name);
+
+	if (op) {
+		if (op->type != OP_SETPROP)
+			return NULL;
+
+		if (lenp)
+			*lenp = op->len;
+		return op->val;
+	}
+
+	if (node >= FDT_EDIT_NODE_BASE)
+		return NULL;
+
+	return fdt_getprop(e->fdt, node, name, lenp);
+}
+
+static int fdt_edit_get_cells(struct fdt_edit* e, int node, const char* name,
+			      int def)
+{
+	int len;
+	const fdt32_t* val = fdt_edit_getprop(e, node, name, &len);
+
+	if (!val || len != sizeof *val)
+		return def;
+
+	return fdt32_to_cpu(*val);
+}
+
+int fdt_edit_setprop_reg(struct fdt_edit* e, int parent, int node,
+			 const char* name, uint64_t addr, uint64_t size)
+{
+	int ac = fdt_edit_get_cells(e, parent, "#address-cells", 2);
+	int sc = fdt_edit_get_cells(e, parent, "#size-cells", 1);
+	fdt32_t cells[4], *p = cells;
+
+	if (ac < 1 || ac > 2 || sc < 1 || sc > 2)
+		return -FDT_ERR_BADNCELLS;
+
+	if (ac == 2)
+		*p++ = cpu_to_fdt32(addr >> 32);
+	*p++ = cpu_to_fdt32(addr);
+	if (sc == 2)
+		*p++ = cpu_to_fdt32(size >> 32);
+	*p++ = cpu_to_fdt32(size);
+
+	return fdt_edit_setprop(e, node, name, cells, (p - cells) * sizeof *p);
+}
+
+int fdt_edit_add_mem_rsv(struct fdt_edit* e, uint64_t addr, uint64_t size)
+{
+	if (e->n_rsv == FDT_EDIT_MAX_RSV)
+		return -FDT_ERR_NOSPACE;
+
+	e->rsv[e->n_rsv][0] = addr;
+	e->rsv[e->n_rsv++][1] = size;
+	return 0;
+}
+
+// {{{ Output
+
+static void* fdt_edit_emit(struct fdt_edit* e, const void* data, int len)
+{
+	int aligned = FDT_EDIT_ALIGN(len);
+	char* p = e->out + e->out_pos;
+
+	if (e->out_pos + aligned > e->out_size)
+		return NULL;
+
+	if (data)
+		memcpy(p, data, len);
+	memset(p + len, 0, aligned - len);
+
+	e->out_pos += aligned;
+	return p;
+}
+
+static bool fdt_edit_emit_u32(struct fdt_edit* e, uint32_t val)
+{
+	fdt32_t tmp = cpu_to_fdt32(val);
+
+	return fdt_edit_emit(e, &tmp, sizeof tmp);
+}
+
+static bool fdt_edit_emit_prop(struct fdt_edit* e, int nameoff,
+			       const void* val, int len)
+{
+	struct fdt_property* prop = fdt_edit_emit(e, NULL, sizeof *prop);
+	if (!prop)
+		return false;
+
+	prop->tag = cpu_to_fdt32(FDT_PROP);
+	prop->len = cpu_to_fdt32(len);
+	prop->nameoff = cpu_to_fdt32(nameoff);
+
+	return !len || fdt_edit_emit(e, val, len);
+}
+
+// emit properties that are not in the source node
+static bool fdt_edit_emit_new_props(struct fdt_edit* e, int first, int last)
+{
+	for (int i = first; i < last; i++) {
+		struct fdt_edit_op* op = &e->ops[i];
+
+		if (op->type != OP_SETPROP || op->done)
+			continue;
+
+		if (!fdt_edit_emit_prop(e, op->nameoff, op->val, op->len))
+			return false;
+
+		op->done = true;
+	}
+
+	return true;
+}
+
+static bool fdt_edit_emit_new_nodes(struct fdt_edit* e, int parent)
+{
+	for (int i = 0; i < e->n_nodes; i++) {
+		struct fdt_edit_node* n = &e->nodes[i];
+		int handle = FDT_EDIT_NODE_BASE + i;
+
+		if (n->parent != parent || n->deleted)
+			continue;
+
+		if (!fdt_edit_emit_u32(e, FDT_BEGIN_NODE))
+			return false;
+		if (!fdt_edit_emit(e, n->name, strlen(n->name) + 1))
+			return false;
+
+		for (int j = 0; j < e->n_ops; j++) {
+			if (e->ops[j].node == handle &&
+			    !fdt_edit_emit_new_props(e, j, j + 1))
+				return false;
+		}
+
+		if (!fdt_edit_emit_new_nodes(e, handle))
+			return false;
+		if (!fdt_edit_emit_u32(e, FDT_END_NODE))
+			return false;
+	}
+
+	return true;
+}
+
+// string offset for a property name, new names are appended to the strings
+// of the source blob
+static int fdt_edit_nameoff(struct fdt_edit* e, const char* name)
+{
+	const char* strtab = (const char*)e->fdt + fdt_off_dt_strings(e->fdt);
+	int strtab_len = fdt_size_dt_strings(e->fdt);
+	int len = strlen(name) + 1;
+
+	for (int i = 0; i + len <= strtab_len; i += strlen(strtab + i) + 1)
+		if (!memcmp(strtab + i, name, len))
+			return i;
+
+	for (int i = 0; i < e->strings_len; i += strlen(e->strings + i) + 1)
+		if (!strcmp(e->strings + i, name))
+			return strtab_len + i;
+
+	memcpy(e->strings + e->strings_len, name, len);
+	e->strings_len += len;
+	return strtab_len + e->strings_len - len;
+}
+
+// offset of the FDT_END_NODE tag of a node in the source blob
+static int fdt_edit_node_end(const void* fdt, int node)
+{
+	int off = node, next, depth = 0;
+	uint32_t tag;
+
+	// root node ends right before FDT_END
+	if (node == 0) {
+		off = fdt_size_dt_struct(fdt) - 2 * FDT_TAGSIZE;
+		if (fdt_next_tag(fdt, off, &next) == FDT_END_NODE)
+			return off;
+
+		off = 0;
+	}
+
+	while (true) {
+		tag = fdt_next_tag(fdt, off, &next);
+		if (next < 0)
+			return next;
+
+		if (tag == FDT_BEGIN_NODE)
+			depth++;
+		else if (tag == FDT_END_NODE && --depth == 0)
+			return off;
+		else if (tag == FDT_END)
+			return -FDT_ERR_BADSTRUCTURE;
+
+		off = next;
+	}
+}
+
+static bool fdt_edit_copy(struct fdt_edit* e, int from, int to)
+{
+	const char* st = (const char*)e->fdt + fdt_off_dt_struct(e->fdt);
+
+	return to == from || fdt_edit_emit(e, st + from, to - from);
+}
+
+/*
+ * Parts of the source structure block without edits are copied verbatim,
+ * only the nodes that have edits and the places where new nodes are added
+ * are parsed.
+ */
+static int fdt_edit_emit_struct(struct fdt_edit* e)
+{
+	const void* fdt = e->fdt;
+	int src = 0, op = 0, ins = 0, off, next;
+	uint32_t tag;
+
+	while (true) {
+		// skip edits in deleted subtrees
+		while (op < e->n_ops && e->ops[op].node < src)
+			op++;
+		while (ins < e->n_ins && e->ins[ins].off < src)
+			ins++;
+
+		int op_off = INT_MAX, ins_off = INT_MAX;
+		if (op < e->n_ops && e->ops[op].node < FDT_EDIT_NODE_BASE)
+			op_off = e->ops[op].node;
+		if (ins < e->n_ins)
+			ins_off = e->ins[ins].off;
+
+		if (op_off == INT_MAX && ins_off == INT_MAX)
+			break;
+
+		// new subnodes go right before the parent's FDT_END_NODE
+		if (ins_off < op_off) {
+			if (!fdt_edit_copy(e, src, ins_off))
+				return -FDT_ERR_NOSPACE;
+			if (!fdt_edit_emit_new_nodes(e, e->ins[ins].node))
+				return -FDT_ERR_NOSPACE;
+
+			src = ins_off;
+			ins++;
+			continue;
+		}
+
+		int last = op;
+		bool deleted = false;
+		while (last < e->n_ops && e->ops[last].node == op_off)
+			if (e->ops[last++].type == OP_DEL_NODE)
+				deleted = true;
+
+		if (!fdt_edit_copy(e, src, op_off))
+			return -FDT_ERR_NOSPACE;
+
+		if (deleted) {
+			int end = fdt_edit_node_end(fdt, op_off);
+			if (end < 0)
+				return end;
+
+			fdt_next_tag(fdt, end, &src);
+			op = last;
+			continue;
+		}
+
+		tag = fdt_next_tag(fdt, op_off, &next);
+		if (tag != FDT_BEGIN_NODE)
+			return -FDT_ERR_BADOFFSET;
+		if (!fdt_edit_copy(e, op_off, next))
+			return -FDT_ERR_NOSPACE;
+
+		for (off = next; ; off = next) {
+			tag = fdt_next_tag(fdt, off, &next);
+			if (next < 0)
+				return next;
+			if (tag == FDT_NOP)
+				continue;
+			if (tag != FDT_PROP)
+				break;
+
+			const struct fdt_property* prop = fdt_get_property_by_offset(fdt, off, NULL);
+			int nameoff = fdt32_to_cpu(prop->nameoff);
+			const char* name = fdt_string(fdt, nameoff);
+			struct fdt_edit_op* pop = NULL;
+
+			for (int i = op; i < last; i++) {
+				if (e->ops[i].type != OP_DEL_NODE && !e->ops[i].done &&
+				    !strcmp(e->ops[i].name, name)) {
+					pop = &e->ops[i];
+					pop->done = true;
+					break;
+				}
+			}
+
+			if (!pop) {
+				if (!fdt_edit_copy(e, off, next))
+					return -FDT_ERR_NOSPACE;
+			} else if (pop->type == OP_SETPROP) {
+				if (!fdt_edit_emit_prop(e, nameoff, pop->val, pop->len))
+					return -FDT_ERR_NOSPACE;
+			}
+		}
+
+		// properties that are not in the source node
+		if (!fdt_edit_emit_new_props(e, op, last))
+			return -FDT_ERR_NOSPACE;
+
+		src = off;
+		op = last;
+	}
+
+	// the rest, including FDT_END
+	if (!fdt_edit_copy(e, src, fdt_size_dt_struct(fdt)))
+		return -FDT_ERR_NOSPACE;
+
+	return 0;
+}
+
+// new subnodes of nodes in the source blob, ordered by where they are inserted
+static int fdt_edit_find_insertions(struct fdt_edit* e)
+{
+	e->n_ins = 0;
+
+	for (int i = 0; i < e->n_nodes; i++) {
+		int parent = e->nodes[i].parent;
+		int j;
+
+		if (parent >= FDT_EDIT_NODE_BASE || e->nodes[i].deleted)
+			continue;
+
+		for (j = 0; j < e->n_ins; j++)
+			if (e->ins[j].node == parent)
+				break;
+		if (j < e->n_ins)
+			continue;
+
+		int end = fdt_edit_node_end(e->fdt, parent);
+		if (end < 0)
+			return end;
+
+		for (j = e->n_ins++; j > 0 && e->ins[j - 1].off > end; j--)
+			e->ins[j] = e->ins[j - 1];
+
+		e->ins[j].node = parent;
+		e->ins[j].off = end;
+	}
+
+	return 0;
+}
+
+int fdt_edit_finish(struct fdt_edit* e, void* out, int out_size)
+{
+	const void* fdt = e->fdt;
+	struct fdt_header* h = out;
+	int n_rsv = fdt_num_mem_rsv(fdt);
+	int strings_size = 0;
+	int ret;
+
+	if (n_rsv < 0)
+		return n_rsv;
+
+	// needs size_dt_struct
+	if (fdt_version(fdt) < 17)
+		return -FDT_ERR_BADVERSION;
+
+	// sort ops by node, so that they can be applied in the same order
+	// nodes appear in the source blob
+	for (int i = 1; i < e->n_ops; i++) {
+		struct fdt_edit_op tmp = e->ops[i];
+		int j;
+
+		for (j = i; j > 0 && e->ops[j - 1].node > tmp.node; j--)
+			e->ops[j] = e->ops[j - 1];
+		e->ops[j] = tmp;
+	}
+
+	for (int i = 0; i < e->n_ops; i++)
+		if (e->ops[i].type == OP_SETPROP)
+			strings_size += strlen(e->ops[i].name) + 1;
+
+	e->strings = malloc(strings_size + 1);
+	e->strings_len = 0;
+
+	for (int i = 0; i < e->n_ops; i++) {
+		e->ops[i].done = false;
+		if (e->ops[i].type == OP_SETPROP)
+			e->ops[i].nameoff = fdt_edit_nameoff(e, e->ops[i].name);
+	}
+
+	e->out = out;
+	e->out_size = out_size;
+	e->out_pos = sizeof *h;
+
+	if (out_size < sizeof *h)
+		return -FDT_ERR_NOSPACE;
+
+	memset(h, 0, sizeof *h);
+
+	// memory reservations
+	fdt_set_off_mem_rsvmap(out, e->out_pos);
+
+	for (int i = 0; i <= n_rsv + e->n_rsv; i++) {
+		struct fdt_reserve_entry* re = fdt_edit_emit(e, NULL, sizeof *re);
+		uint64_t addr = 0, size = 0;
+
+		if (!re)
+			return -FDT_ERR_NOSPACE;
+
+		if (i < n_rsv)
+			fdt_get_mem_rsv(fdt, i, &addr, &size);
+		else if (i < n_rsv + e->n_rsv)
+			addr = e->rsv[i - n_rsv][0], size = e->rsv[i - n_rsv][1];
+
+		re->address = cpu_to_fdt64(addr);
+		re->size = cpu_to_fdt64(size);
+	}
+
+	// structure block
+	fdt_set_off_dt_struct(out, e->out_pos);
+
+	ret = fdt_edit_find_insertions(e);
+	if (ret < 0)
+		return ret;
+
+	ret = fdt_edit_emit_struct(e);
+	if (ret < 0)
+		return ret;
+
+	fdt_set_size_dt_struct(out, e->out_pos - fdt_off_dt_struct(out));
+
+	// strings block, new names are appended to the source strings
+	int src_strings = fdt_size_dt_strings(fdt);
+	if (e->out_pos + src_strings + e->strings_len > out_size)
+		return -FDT_ERR_NOSPACE;
+
+	fdt_set_off_dt_strings(out, e->out_pos);
+	memcpy(e->out + e->out_pos, (const char*)fdt + fdt_off_dt_strings(fdt), src_strings);
+	memcpy(e->out + e->out_pos + src_strings, e->strings, e->strings_len);
+	e->out_pos += src_strings + e->strings_len;
+	fdt_set_size_dt_strings(out, src_strings + e->strings_len);
+
+	fdt_set_magic(out, FDT_MAGIC);
+	fdt_set_version(out, FDT_LAST_SUPPORTED_VERSION);
+	fdt_set_last_comp_version(out, FDT_FIRST_SUPPORTED_VERSION);
+	fdt_set_boot_cpuid_phys(out, fdt_boot_cpuid_phys(fdt));
+	fdt_set_totalsize(out, e->out_pos);
+
+	return e->out_pos;
+}
+
+// }}}
+
+#else
+
+/*
+ * Without FDT_EDIT_LIST, the edits are applied directly via libfdt to
+ * a copy of the source blob. This is slower, because each edit moves
+ * the rest of the blob, but libfdt is linked in anyway, so it needs much
+ * less space in SRAM.
+ */
+
+struct fdt_edit {
+	void* fdt;
+};
+
+struct fdt_edit* fdt_edit_begin(const void* fdt)
+{
+	struct fdt_edit* e = zalloc(sizeof *e);
+	int size = fdt_totalsize(fdt) + 256 * 1024; // generous
+
+	// the caller has checked the header already
+	e->fdt = malloc(size);
+	fdt_open_into(fdt, e->fdt, size);
+	return e;
+}
+
+const void* fdt_edit_fdt(struct fdt_edit* e)
+{
+	return e->fdt;
+}
+
+int fdt_edit_add_subnode(struct fdt_edit* e, int parent, const char* name)
+{
+	return fdt_add_subnode(e->fdt, parent, name);
+}
+
+int fdt_edit_find_or_add_subnode(struct fdt_edit* e, int parent, const char* name)
+{
+	int node = fdt_subnode_offset(e->fdt, parent, name);
+	if (node == -FDT_ERR_NOTFOUND)
+		return fdt_add_subnode(e->fdt, parent, name);
+
+	return node;
+}
+
+int fdt_edit_del_node(struct fdt_edit* e, int node)
+{
+	return fdt_del_node(e->fdt, node);
+}
+
+int fdt_edit_setprop(struct fdt_edit* e, int node, const char* name,
+		     const void* val, int len)
+{
+	return fdt_setprop(e->fdt, node, name, val, len);
+}
+
+int fdt_edit_delprop(struct fdt_edit* e, int node, const char* name)
+{
+	return fdt_delprop(e->fdt, node, name);
+}
+
+const void* fdt_edit_getprop(struct fdt_edit* e, int node, const char* name,
+			     int* lenp)
+{
+	return fdt_getprop(e->fdt, node, name, lenp);
+}
+
+int fdt_edit_setprop_reg(struct fdt_edit* e, int parent, int node,
+			 const char* name, uint64_t addr, uint64_t size)
+{
+	int ac = fdt_address_cells(e->fdt, parent);
+	int sc = fdt_size_cells(e->fdt, parent);
+	fdt32_t cells[4], *p = cells;
+
+	if (ac < 1 || ac > 2 || sc < 1 || sc > 2)
+		return -FDT_ERR_BADNCELLS;
+
+	if (ac == 2)
+		*p++ = cpu_to_fdt32(addr >> 32);
+	*p++ = cpu_to_fdt32(addr);
+	if (sc == 2)
+		*p++ = cpu_to_fdt32(size >> 32);
+	*p++ = cpu_to_fdt32(size);
+
+	return fdt_setprop(e->fdt, node, name, cells, (p - cells) * sizeof *p);
+}
+
+int fdt_edit_add_mem_rsv(struct fdt_edit* e, uint64_t addr, uint64_t size)
+{
+	return fdt_add_mem_rsv(e->fdt, addr, size);
+}
+
+int fdt_edit_finish(struct fdt_edit* e, void* out, int out_size)
+{
+	int ret = fdt_open_into(e->fdt, out, out_size);
+	if (ret < 0)
+		return ret;
+
+	// drop the free space at the end
+	fdt_set_totalsize(out, fdt_off_dt_strings(out) + fdt_size_dt_strings(out));
+	return fdt_totalsize(out);
+}
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <linux/libfdt.h>
+
+/*
+ * FDT edit list
+ *
+ * Each libfdt edit memmoves the rest of the blob, so with FDT_EDIT_LIST,
+ * fixups are recorded in an edit list instead of patching the FDT in
+ * place, and the final FDT is written out in a single pass by
+ * fdt_edit_finish(). The single pass writer needs about 3 KiB of SRAM,
+ * so without FDT_EDIT_LIST the edits are applied directly via libfdt to
+ * a working copy of the source blob.
+ *
+ * Nodes should be looked up via libfdt in fdt_edit_fdt(), and node
+ * offsets are only valid until the next edit of another node. Nodes added
+ * to the edit list get handles that can be used in place of node offsets
+ * in fdt_edit_* calls, but not in libfdt calls.
+ */
+
+struct fdt_edit;
+
+struct fdt_edit* fdt_edit_begin(const void* fdt);
+
+// the FDT that node lookups should be done in
+const void* fdt_edit_fdt(struct fdt_edit* e);
+
+int fdt_edit_add_subnode(struct fdt_edit* e, int parent, const char* name);
+int fdt_edit_find_or_add_subnode(struct fdt_edit* e, int parent, const char* name);
+int fdt_edit_del_node(struct fdt_edit* e, int node);
+
+int fdt_edit_setprop(struct fdt_edit* e, int node, const char* name,
+		     const void* val, int len);
+int fdt_edit_delprop(struct fdt_edit* e, int node, const char* name);
+const void* fdt_edit_getprop(struct fdt_edit* e, int node, const char* name,
+			     int* lenp);
+
+// encodes reg according to #address-cells/#size-cells of the parent node
+int fdt_edit_setprop_reg(struct fdt_edit* e, int parent, int node,
+			 const char* name, uint64_t addr, uint64_t size);
+
+int fdt_edit_add_mem_rsv(struct fdt_edit* e, uint64_t addr, uint64_t size);
+
+// writes out the edited FDT, returns its size or a negative libfdt error
+int fdt_edit_finish(struct fdt_edit* e, void* out, int out_size);
+
+static inline int fdt_edit_setprop_u32(struct fdt_edit* e, int node,
+				       const char* name, uint32_t val)
+{
+	fdt32_t tmp = cpu_to_fdt32(val);
+
+	return fdt_edit_setprop(e, node, name, &tmp, sizeof tmp);
+}
+
+static inline int fdt_edit_setprop_u64(struct fdt_edit* e, int node,
+				       const char* name, uint64_t val)
+{
+	fdt64_t tmp = cpu_to_fdt64(val);
+
+	return fdt_edit_setprop(e, node, name, &tmp, sizeof tmp);
+}
+
+static inline int fdt_edit_setprop_string(struct fdt_edit* e, int node,
+					  const char* name, const char* str)
+{
+	return fdt_edit_setprop(e, node, name, str, strlen(str) + 1);
+}
@@ -22,6 +22,7 @@
 #include <asm/system.h>
 #include <asm/io.h>
 #include <cpu_func.h>
+#include "mmu.h"
 #include "pmic.h"
 #include "lradc.h"
 #include "display.h"
@@ -119,6 +120,12 @@ void gui_get_events(struct gui* gui)
 	for (int i = 0; i < gui->n_widgets; i++)
 		if (!gui->widgets[i]->disabled)
 			gui->widgets[i]->update(gui->widgets[i]);
+
+	// DE2 latches the new configuration at the next vblank
+	if (gui->needs_commit) {
+		display_commit(gui->display);
+		gui->needs_commit = false;
+	}
 }
 
 void gui_fini(struct gui* gui)
@@ -130,6 +137,8 @@ void gui_fini(struct gui* gui)
 
 // menu
 
+#define MENU_PAD 1
+
 static const double sin_0_90[] = {
 	0,
 	0.17364817768937,
@@ -153,11 +162,21 @@ static double xsin(double v)
 	return s + (e - s) * (d_idx - (double)idx);
 }
 
+#ifdef GUI_SELECTION_PLANE
+// distance left to go during the selection bar slide, in 1/256 of the
+// whole distance, (1 - sin(t * 90°)) for t = 1/8 ... 8/8
+static const uint8_t bar_slide_left[] = {
+	206, 158, 114, 75, 43, 19, 5, 0,
+};
+#endif
+
 void gui_menu_update(struct gui_widget* w)
 {
 	struct gui_menu* m = container_of(w, struct gui_menu, widget);
 	struct display* d = w->gui->display;
 	struct vidconsole* c = &m->con;
+	int menu_x = (720 - c->fb_width) / 2;
+	int menu_y = 1440 - c->fb_height - menu_x;
 
 	m->selection_changed = false;
 
@@ -181,7 +200,11 @@ void gui_menu_update(struct gui_widget* w)
 		// select new item if it's not identical and has text
 		if (new_sel != m->selection && m->items[new_sel].id >= 0) {
 			m->selection = new_sel;
+#ifndef GUI_SELECTION_PLANE
+			// without the overlay plane, the selection bar is
+			// drawn as part of the menu
 			m->changed = true;
+#endif
 			m->selection_changed = true;
 		}
 	}
@@ -196,8 +219,14 @@ void gui_menu_update(struct gui_widget* w)
 	if (prev_scroll_top != m->scroll_top)
 		m->changed = true;
 
+#ifdef GUI_DOUBLE_BUFFER
+	// back buffer is free for rendering only after the previous flip
+	// was latched by the display engine
+	if (m->changed && !display_commit_pending()) {
+#else
 	if (m->changed) {
-		int pad = 1;
+#endif
+		int pad = MENU_PAD;
 		unsigned w = c->w;
 		unsigned h = c->h;
 
@@ -208,7 +237,9 @@ void gui_menu_update(struct gui_widget* w)
 
                         char* line_text = NULL;
 			int line_text_len = 0;
+#ifndef GUI_SELECTION_PLANE
                         bool line_sel = false;
+#endif
 			uint32_t line_fg;
 
                         char* lh_text = NULL;
@@ -239,7 +270,9 @@ void gui_menu_update(struct gui_widget* w)
 					if (it->text[0]) {
 						line_text_len = strlen(it->text);
 						line_text = it->text;
+#ifndef GUI_SELECTION_PLANE
 						line_sel = i == m->selection;
+#endif
 						line_fg = it->active ? it->active_fg : it->fg;
 					}
 				}
@@ -289,12 +322,16 @@ void gui_menu_update(struct gui_widget* w)
 				if (line_text) {
 					if (x >= 1 + pad && x < w - 1 - pad && x - 1 - pad < line_text_len) {
 						ch = line_text[x - 1 - pad];
+#ifndef GUI_SELECTION_PLANE
 						if (line_sel) {
 							bg = line_fg;
 							fg = 0xaa000000;
 						} else {
 							fg = line_fg;
 						}
+#else
+						fg = line_fg;
+#endif
 					}
 				}
 
@@ -303,39 +340,65 @@ void gui_menu_update(struct gui_widget* w)
 		}
 
 		// render items
+#ifdef GUI_DOUBLE_BUFFER
+		c->fb_start = m->fb[m->fb_back];
+#endif
 		vidconsole_redraw(c);
 		m->changed = false;
-	}
-
-	if (w->gui->events & BIT(EV_VBLANK)) {
-		int dur = 15;
 
+		// and show them on plane 1
 		d->planes[1].fb_start = c->fb_start;
 		d->planes[1].fb_pitch = c->fb_pitch;
 		d->planes[1].src_w = c->fb_width;
 		d->planes[1].src_h = c->fb_height;
 		d->planes[1].dst_w = c->fb_width;
 		d->planes[1].dst_h = c->fb_height;
-		d->planes[1].dst_x = (720 - c->fb_width) / 2;
-		d->planes[1].dst_y = (1440 - c->fb_height - d->planes[1].dst_x);
+		d->planes[1].dst_x = menu_x;
+		d->planes[1].dst_y = menu_y;
 		d->planes[1].alpha = 0;
 
-#if 0
-		if (m->anim_ticks < dur) {
-			double pct = 1.0 - xsin((double)m->anim_ticks / dur);
-
-			d->planes[1].alpha = (double)150 * pct;
-
-			d->planes[1].dst_y -= d->planes[1].dst_h * pct / 2;
-			d->planes[1].dst_x -= d->planes[1].dst_w * pct / 2;
+#ifdef GUI_DOUBLE_BUFFER
+		m->fb_back ^= 1;
+#endif
+		m->widget.gui->needs_commit = true;
+	}
 
-			d->planes[1].dst_w += d->planes[1].dst_w * pct;
-			d->planes[1].dst_h += d->planes[1].dst_h * pct;
+#ifdef GUI_SELECTION_PLANE
+	// move the selection bar overlay on plane 2
+	if (m->n_items > 0) {
+		unsigned char_w = c->fb_width / c->w;
+		unsigned char_h = c->fb_height / c->h;
+		int bar_y = menu_y + (m->selection - m->scroll_top + MENU_PAD + 1) * char_h;
+		int dur = ARRAY_SIZE(bar_slide_left);
+
+		if (!d->planes[2].fb_start) {
+			d->planes[2].fb_start = m->bar_fb;
+			d->planes[2].fb_pitch = m->bar_w * 4;
+			d->planes[2].src_w = m->bar_w;
+			d->planes[2].src_h = char_h;
+			d->planes[2].dst_w = m->bar_w;
+			d->planes[2].dst_h = char_h;
+			d->planes[2].dst_x = menu_x + (MENU_PAD + 1) * char_w;
+			d->planes[2].dst_y = bar_y;
+			d->planes[2].alpha = 0;
+
+			m->bar_from = m->bar_to = bar_y;
+			m->anim_ticks = dur;
+			w->gui->needs_commit = true;
+		} else if (bar_y != m->bar_to) {
+			// slide from the current position to the new one
+			m->bar_from = d->planes[2].dst_y;
+			m->bar_to = bar_y;
+			m->anim_ticks = 0;
+		}
 
-			m->anim_ticks++;
+		if (m->anim_ticks < dur && w->gui->events & BIT(EV_VBLANK)) {
+			d->planes[2].dst_y = m->bar_to - (m->bar_to - m->bar_from) *
+				bar_slide_left[m->anim_ticks++] / 256;
+			w->gui->needs_commit = true;
 		}
-#endif
 	}
+#endif
 }
 
 struct gui_menu* gui_menu(struct gui* g)
@@ -353,6 +416,28 @@ struct gui_menu* gui_menu(struct gui* g)
 
 	vidconsole_init(c, w, h, 2, 0xff112233, 0xcc000000);
 
+#ifdef GUI_DOUBLE_BUFFER
+	m->fb[0] = c->fb_start;
+	m->fb[1] = (uintptr_t)mmu_fb_alloc(c->fb_pitch * c->fb_height);
+	if (!m->fb[1])
+		m->fb[1] = (uintptr_t)malloc(c->fb_pitch * c->fb_height);
+#endif
+
+#ifdef GUI_SELECTION_PLANE
+	// selection bar covers the item text area of one line
+	m->bar_w = (w - 2 - 2 * MENU_PAD) * (c->fb_width / w);
+	size_t bar_len = m->bar_w * (c->fb_height / h) * 4;
+	uint32_t* bar = mmu_fb_alloc(bar_len);
+	if (!bar)
+		bar = malloc(bar_len);
+
+	for (unsigned i = 0; i < bar_len / 4; i++)
+		bar[i] = 0x50ffffff;
+	if (!mmu_is_uncached((uintptr_t)bar))
+		flush_cache((uintptr_t)bar, ALIGN(bar_len, CONFIG_SYS_CACHELINE_SIZE));
+	m->bar_fb = (uintptr_t)bar;
+#endif
+
 	return m;
 }
 
@@ -389,7 +474,9 @@ void gui_menu_set_selection(struct gui_menu* m, int id)
 	for (int i = 0; i < m->n_items; i++) {
 		if (m->items[i].id == id) {
 			m->selection = i;
+#ifndef GUI_SELECTION_PLANE
 			m->changed = true;
+#endif
 			break;
 		}
 	}
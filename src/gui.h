@@ -40,6 +40,7 @@ struct gui {
 	bool auto_repeat;
 
 	struct display* display;
+	bool needs_commit; // set by widgets to request display_commit()
 
 	struct gui_widget* widgets[10];
 	int n_widgets;
@@ -74,10 +75,22 @@ struct gui_menu {
 
 	int n_items;
 	struct vidconsole con;
+#ifdef GUI_DOUBLE_BUFFER
+	uint32_t fb[2]; // front/back framebuffers for con
+	int fb_back;
+#endif
 	int selection;
         int scroll_top;
         int scroll_height;
 	bool changed;
+
+#ifdef GUI_SELECTION_PLANE
+	// selection bar overlay
+	uint32_t bar_fb;
+	unsigned bar_w;
+	int bar_from;
+	int bar_to;
+#endif
 	int anim_ticks;
 
 	// events
@@ -0,0 +1,300 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test for memcpy/memset/memmove/memcmp from lib.c. lib.c is built
+ * with -DLIB_TEST and its functions renamed to lib_*, and the results are
+ * compared byte for byte against libc over all small sizes/alignments and
+ * random larger sizes and offsets, including overlapping moves in both
+ * directions. Writes outside of the destination range are detected too.
+ *
+ * The arm64 build can be run under qemu-aarch64, which also exercises
+ * the DC ZVA path of memset. -b runs a simple throughput comparison
+ * against libc (only indicative under qemu).
+ *
+ * Usage: lib-test [-b] [-s seed] [-n iterations]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+void *lib_memcpy(void *dest, const void *src, size_t n);
+void *lib_memset(void *dest, int c, size_t n);
+void *lib_memmove(void *dest, const void *src, size_t n);
+int lib_memcmp(const void *vl, const void *vr, size_t n);
+
+#define BUF_SIZE	(64 * 1024)
+#define GUARD		64
+
+static uint8_t *buf, *ref, *src;
+static unsigned failures;
+
+static uint64_t rnd_state = 1;
+
+static uint64_t rnd(void)
+{
+	// xorshift64
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+// mostly small sizes, sometimes large ones
+static size_t rnd_size(void)
+{
+	switch (rnd() % 4) {
+	case 0:  return rnd() % 64;
+	case 1:  return rnd() % 512;
+	case 2:  return rnd() % 4096;
+	default: return rnd() % (BUF_SIZE - 2 * GUARD);
+	}
+}
+
+static void fill(uint8_t* p, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		p[i] = rnd();
+}
+
+static void fail(const char* fn, size_t doff, size_t soff, size_t n, const char* what)
+{
+	if (failures++ < 20)
+		printf("FAIL: %s(dst+%zu, src+%zu, %zu): %s\n", fn, doff, soff, n, what);
+}
+
+// tests only touch buf[lo, hi), where lo/hi include GUARD bytes around the
+// destination (and source, for memmove)
+static void prepare_buf(size_t lo, size_t hi)
+{
+	fill(buf + lo, hi - lo);
+	memcpy(ref + lo, buf + lo, hi - lo);
+}
+
+static void check_buf(const char* fn, size_t doff, size_t soff, size_t n,
+		      size_t lo, size_t hi)
+{
+	for (size_t i = lo; i < hi; i++) {
+		if (buf[i] != ref[i]) {
+			fail(fn, doff, soff, n, i >= doff && i < doff + n ?
+			     "wrong data" : "write outside of the destination");
+			return;
+		}
+	}
+}
+
+static void test_memcpy(size_t doff, size_t soff, size_t n)
+{
+	size_t lo = doff - GUARD, hi = doff + n + GUARD;
+
+	prepare_buf(lo, hi);
+
+	memcpy(ref + doff, src + soff, n);
+	if (lib_memcpy(buf + doff, src + soff, n) != buf + doff)
+		fail("memcpy", doff, soff, n, "wrong return value");
+
+	check_buf("memcpy", doff, soff, n, lo, hi);
+}
+
+static void test_memset(size_t doff, int c, size_t n)
+{
+	size_t lo = doff - GUARD, hi = doff + n + GUARD;
+
+	prepare_buf(lo, hi);
+
+	memset(ref + doff, c, n);
+	if (lib_memset(buf + doff, c, n) != buf + doff)
+		fail("memset", doff, c, n, "wrong return value");
+
+	check_buf("memset", doff, c, n, lo, hi);
+}
+
+// source and destination are in the same buffer, and may overlap
+static void test_memmove(size_t doff, size_t soff, size_t n)
+{
+	size_t lo = (doff < soff ? doff : soff) - GUARD;
+	size_t hi = (doff > soff ? doff : soff) + n + GUARD;
+
+	prepare_buf(lo, hi);
+
+	memmove(ref + doff, ref + soff, n);
+	if (lib_memmove(buf + doff, buf + soff, n) != buf + doff)
+		fail("memmove", doff, soff, n, "wrong return value");
+
+	check_buf("memmove", doff, soff, n, lo, hi);
+}
+
+static int sign(int v)
+{
+	return v < 0 ? -1 : v > 0;
+}
+
+// @diff is the position of a differing byte, may be past n
+static void test_memcmp(size_t loff, size_t roff, size_t n, size_t diff)
+{
+	uint8_t* l = buf + loff;
+	uint8_t* r = src + roff;
+
+	fill(l, n + 1);
+	memcpy(r, l, n + 1);
+	if (diff <= n)
+		r[diff] = rnd();
+
+	if (sign(lib_memcmp(l, r, n)) != sign(memcmp(l, r, n)))
+		fail("memcmp", loff, roff, n, "wrong result");
+}
+
+static void run_tests(unsigned iterations)
+{
+	// all small sizes and relative alignments
+	for (size_t n = 0; n <= 160; n++) {
+		for (size_t doff = 0; doff < 16; doff++) {
+			for (size_t soff = 0; soff < 16; soff++) {
+				test_memcpy(GUARD + doff, soff, n);
+				test_memmove(GUARD + doff, GUARD + soff, n);
+				test_memcmp(doff, soff, n, rnd() % (n + 2));
+			}
+
+			test_memset(GUARD + doff, 0, n);
+			test_memset(GUARD + doff, rnd(), n);
+		}
+	}
+
+	for (unsigned i = 0; i < iterations; i++) {
+		size_t n = rnd_size();
+		size_t room = BUF_SIZE - 2 * GUARD - n;
+		size_t doff = GUARD + rnd() % (room + 1);
+		size_t soff = GUARD + rnd() % (room + 1);
+
+		test_memcpy(doff, soff, n);
+		test_memset(doff, rnd() % 2 ? 0 : rnd(), n);
+		test_memmove(doff, soff, n);
+
+		// overlapping moves with a small distance, in both directions
+		size_t dist = rnd() % 64;
+		if (dist <= room) {
+			test_memmove(GUARD + dist, GUARD, n);
+			test_memmove(GUARD, GUARD + dist, n);
+		}
+
+		test_memcmp(doff, soff, n, rnd() % (n + 2));
+	}
+}
+
+// {{{ Benchmark
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static volatile uintptr_t sink;
+
+#define BENCH(expr) ({						\
+	uint64_t t0 = now_ns();						\
+	for (unsigned j = 0; j < reps; j++) {				\
+		sink = (uintptr_t)(expr);				\
+		asm volatile("" : : : "memory");			\
+	}								\
+	double s = (now_ns() - t0) / 1e9;				\
+	(double)reps * n / s / (1024 * 1024);				\
+})
+
+static void run_bench(void)
+{
+	static const size_t sizes[] = { 16, 64, 256, 4096, 32768 };
+
+	printf("%-8s %6s %10s %10s  (MiB/s)\n", "func", "size", "lib", "libc");
+
+	for (unsigned i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		size_t n = sizes[i];
+		unsigned reps = 64 * 1024 * 1024 / n;
+		if (reps > 1000000)
+			reps = 1000000;
+
+		printf("%-8s %6zu %10.0f %10.0f\n", "memcpy", n,
+		       BENCH(lib_memcpy(buf, src, n)),
+		       BENCH(memcpy(buf, src, n)));
+		printf("%-8s %6zu %10.0f %10.0f\n", "memset", n,
+		       BENCH(lib_memset(buf, 0, n)),
+		       BENCH(memset(buf, 0, n)));
+		printf("%-8s %6zu %10.0f %10.0f\n", "memmove", n,
+		       BENCH(lib_memmove(buf + 8, buf, n)),
+		       BENCH(memmove(buf + 8, buf, n)));
+
+		memcpy(buf, src, n);
+		printf("%-8s %6zu %10.0f %10.0f\n", "memcmp", n,
+		       BENCH(lib_memcmp(buf, src, n)),
+		       BENCH(memcmp(buf, src, n)));
+	}
+}
+
+// }}}
+
+int main(int ac, char* av[])
+{
+	unsigned iterations = 20000;
+	bool bench = false;
+	int opt;
+
+	while ((opt = getopt(ac, av, "bs:n:")) != -1) {
+		switch (opt) {
+		case 'b':
+			bench = true;
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 0) ?: 1;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			printf("Usage: lib-test [-b] [-s seed] [-n iterations]\n");
+			return 1;
+		}
+	}
+
+	buf = aligned_alloc(4096, BUF_SIZE);
+	ref = aligned_alloc(4096, BUF_SIZE);
+	src = aligned_alloc(4096, BUF_SIZE);
+	fill(src, BUF_SIZE);
+
+	if (bench) {
+		run_bench();
+		return 0;
+	}
+
+	run_tests(iterations);
+
+	if (failures) {
+		printf("%u failures\n", failures);
+		return 1;
+	}
+
+	printf("lib.c: all tests passed\n");
+	return 0;
+}
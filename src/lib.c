@@ -21,7 +21,23 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef LIB_TEST
+// user space build for lib-test.c, with symbols renamed via -D
+#include <stddef.h>
+#include <stdint.h>
+#define BIT(n) (1ul << (n))
+#else
 #include <common.h>
+#include <asm/system.h>
+#endif
+
+// Word sized accesses are only used when both pointers can be aligned
+// together, because we build with -mstrict-align.
+
+typedef uint64_t __attribute__((__may_alias__)) word_t;
+
+#define WS sizeof(word_t)
+#define CO_ALIGNED(a, b) ((((uintptr_t)(a) ^ (uintptr_t)(b)) & (WS - 1)) == 0)
 
 __attribute__((externally_visible))
 void *memcpy(void *dest, const void *src, size_t n)
@@ -29,18 +45,90 @@ void *memcpy(void *dest, const void *src, size_t n)
 	const uint8_t *s = src;
 	uint8_t *d = dest;
 
-	for (size_t i = 0; i < n; i++)
-		d[i] = s[i];
+	if (CO_ALIGNED(d, s)) {
+		for (; n && (uintptr_t)d % WS; n--)
+			*d++ = *s++;
+
+		// 4 words at a time (ldp/stp pairs)
+		for (; n >= 4 * WS; n -= 4 * WS, s += 4 * WS, d += 4 * WS) {
+			word_t w0 = ((const word_t*)s)[0];
+			word_t w1 = ((const word_t*)s)[1];
+			word_t w2 = ((const word_t*)s)[2];
+			word_t w3 = ((const word_t*)s)[3];
+
+			((word_t*)d)[0] = w0;
+			((word_t*)d)[1] = w1;
+			((word_t*)d)[2] = w2;
+			((word_t*)d)[3] = w3;
+		}
+
+		for (; n >= WS; n -= WS, s += WS, d += WS)
+			*(word_t*)d = *(const word_t*)s;
+	}
+
+	for (; n; n--)
+		*d++ = *s++;
 
 	return dest;
 }
 
+// returns DC ZVA block size, or 0 if DC ZVA can't be used (it faults on
+// Device memory, which is all of memory while the MMU or D-cache is off)
+#if defined(LIB_TEST) && !defined(__aarch64__)
+static size_t zva_block_size(void)
+{
+	return 0;
+}
+#else
+static size_t zva_block_size(void)
+{
+	uint64_t dczid;
+
+	// Linux allows DC ZVA from EL0, so lib-test exercises it under qemu
+#ifndef LIB_TEST
+	if ((get_sctlr() & (CR_M | CR_C)) != (CR_M | CR_C))
+		return 0;
+#endif
+
+	asm volatile("mrs %0, dczid_el0" : "=r" (dczid));
+	if (dczid & BIT(4))
+		return 0;
+
+	return 4 << (dczid & 0xf);
+}
+#endif
+
 __attribute__((externally_visible))
 void *memset(void *dest, int c, size_t n)
 {
 	unsigned char *s = dest;
+	word_t w = (unsigned char)c * 0x0101010101010101ull;
+	size_t bs;
+
+	for (; n && (uintptr_t)s % WS; n--)
+		*s++ = c;
+
+	// zero large blocks a cache line at a time
+	if (c == 0 && n >= 256 && (bs = zva_block_size())) {
+		for (; n >= WS && (uintptr_t)s % bs; n -= WS, s += WS)
+			*(word_t*)s = 0;
+
+		for (; n >= bs; n -= bs, s += bs)
+			asm volatile("dc zva, %0" : : "r" (s) : "memory");
+	}
 
-	for (; n; n--, s++) *s = c;
+	for (; n >= 4 * WS; n -= 4 * WS, s += 4 * WS) {
+		((word_t*)s)[0] = w;
+		((word_t*)s)[1] = w;
+		((word_t*)s)[2] = w;
+		((word_t*)s)[3] = w;
+	}
+
+	for (; n >= WS; n -= WS, s += WS)
+		*(word_t*)s = w;
+
+	for (; n; n--)
+		*s++ = c;
 
 	return dest;
 }
@@ -48,6 +136,15 @@ void *memset(void *dest, int c, size_t n)
 int memcmp(const void *vl, const void *vr, size_t n)
 {
         const unsigned char *l=vl, *r=vr;
+
+	if (CO_ALIGNED(l, r)) {
+		for (; n && (uintptr_t)l % WS && *l == *r; n--, l++, r++);
+
+		// skip equal words, the byte loop below finds the difference
+		if ((uintptr_t)l % WS == 0)
+			for (; n >= WS && *(const word_t*)l == *(const word_t*)r; n -= WS, l += WS, r += WS);
+	}
+
         for (; n && *l == *r; n--, l++, r++);
         return n ? *l-*r : 0;
 }
@@ -60,11 +157,17 @@ void *memmove(void *dest, const void *src, size_t n)
         if (d==s) return d;
         if ((uintptr_t)s-(uintptr_t)d-n <= -2*n) return memcpy(d, s, n);
 
-        if (d<s) {
-                for (; n; n--) *d++ = *s++;
-        } else {
-                while (n) n--, d[n] = s[n];
-        }
+	// memcpy copies forward and reads each block before writing it
+        if (d<s) return memcpy(d, s, n);
+
+	if (CO_ALIGNED(d, s)) {
+		for (; n && (uintptr_t)(d + n) % WS; n--)
+			d[n - 1] = s[n - 1];
+
+		while (n >= WS) n -= WS, *(word_t*)(d + n) = *(const word_t*)(s + n);
+	}
+
+        while (n) n--, d[n] = s[n];
 
         return dest;
 }
@@ -84,6 +187,13 @@ void *memchr(const void *src, int c, size_t n)
         return n ? (void *)s : 0;
 }
 
+char *strchr(const char *s, int c)
+{
+        c = (unsigned char)c;
+        for (; *s && *(unsigned char *)s != c; s++);
+        return *(unsigned char *)s == c ? (char *)s : 0;
+}
+
 int strcmp(const char *l, const char *r)
 {
         for (; *l==*r && *l; l++, r++);
@@ -103,3 +213,17 @@ char* strstr(const char *hay, const char *needle)
 
 	return NULL;
 }
+
+// only what libfdt overlay code needs: decimal numbers without sign
+unsigned long simple_strtoul(const char *cp, char **endp, unsigned int base)
+{
+	unsigned long v = 0;
+
+	for (; *cp >= '0' && *cp <= '9'; cp++)
+		v = v * base + (*cp - '0');
+
+	if (endp)
+		*endp = (char *)cp;
+
+	return v;
+}
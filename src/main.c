@@ -36,12 +36,17 @@
 #include "mmu.h"
 #include "pmic.h"
 #include "ccu.h"
+#include "smp.h"
+#include "sched.h"
+#include "timeline.h"
 #include "bootfs.h"
 #include "lradc.h"
 #include "display.h"
 #include "vidconsole.h"
 #include "gui.h"
 #include "storage.h"
+#include "resident.h"
+#include "fdtedit.h"
 #include "strbuf.h"
 #include <build-ver.h>
 
@@ -474,22 +479,22 @@ static int detect_pinephone_revision(void)
 
 // {{{ FDT
 
-static const char* fdt_get_alias_node(void* fdt, const char* alias)
+static int fdt_get_alias_node(const void* fdt, const char* alias)
 {
 	const struct fdt_property *fdt_prop;
 	const char* path = fdt_get_alias(fdt, alias);
 	if (!path)
-		return NULL;
+		return -FDT_ERR_NOTFOUND;
 
 	int node = fdt_path_offset(fdt, path);
 	if (node < 0)
-		return NULL;
+		return node;
 
 	fdt_prop = fdt_get_property(fdt, node, "status", NULL);
 	if (fdt_prop && !strcmp(fdt_prop->data, "disabled"))
-		return NULL;
+		return -FDT_ERR_NOTFOUND;
 
-	return path;
+	return node;
 }
 
 static void print_mac(uint8_t mac[6])
@@ -501,14 +506,24 @@ static void print_mac(uint8_t mac[6])
 	}
 }
 
-static void fdt_fixup_wifi(void* fdt)
+// set a property of a node, optionally only if the property already exists
+static int fdt_edit_update_prop(struct fdt_edit* e, const void* fdt, int node,
+				const char* prop, const void* val, int len,
+				int create)
+{
+	if (!create && !fdt_getprop(fdt, node, prop, NULL))
+		return 0;
+
+	return fdt_edit_setprop(e, node, prop, val, len);
+}
+
+static void fdt_fixup_wifi(struct fdt_edit* e, const void* fdt)
 {
-	const char* path;
 	uint8_t mac_addr[6];
-	int ret;
+	int node, ret;
 
-	path = fdt_get_alias_node(fdt, "ethernet0");
-	if (!path) {
+	node = fdt_get_alias_node(fdt, "ethernet0");
+	if (node < 0) {
 		printf("WiFi node not found\n");
 		return;
 	}
@@ -522,23 +537,22 @@ static void fdt_fixup_wifi(void* fdt)
 	print_mac(mac_addr);
 	puts("\n");
 
-        ret = fdt_find_and_setprop(fdt, path, "mac-address", mac_addr, 6, 0);
+        ret = fdt_edit_update_prop(e, fdt, node, "mac-address", mac_addr, 6, 0);
         if (ret)
                 printf("WiFi MAC addr update failed err=%d\n", ret);
 
-        ret = fdt_find_and_setprop(fdt, path, "local-mac-address", mac_addr, 6, 1);
+        ret = fdt_edit_update_prop(e, fdt, node, "local-mac-address", mac_addr, 6, 1);
         if (ret)
                 printf("WiFi local MAC addr update failed err=%d\n", ret);
 }
 
-static void fdt_fixup_bt(void* fdt)
+static void fdt_fixup_bt(struct fdt_edit* e, const void* fdt)
 {
-	const char* path;
 	uint8_t mac_addr[6];
-	int ret;
+	int node, ret;
 
-	path = fdt_get_alias_node(fdt, "bluetooth0");
-	if (!path) {
+	node = fdt_get_alias_node(fdt, "bluetooth0");
+	if (node < 0) {
 		printf("BT node not found\n");
 		return;
 	}
@@ -559,20 +573,27 @@ static void fdt_fixup_bt(void* fdt)
 		mac_addr[5 - i] = tmp;
 	}
 
-        ret = fdt_find_and_setprop(fdt, path, "local-bd-address", mac_addr, 6, 1);
+        ret = fdt_edit_update_prop(e, fdt, node, "local-bd-address", mac_addr, 6, 1);
         if (ret)
                 printf("BT local MAC addr update failed err=%d\n", ret);
 }
 
-static void fdt_add_pboot_data(void* fdt_blob, struct bootfs* fs)
+static void fdt_add_pboot_data(struct fdt_edit* e, struct bootfs* fs, bool prebaked)
 {
 	struct bootfs_conf* bc = fs->confs_blocks;
 
-        int pboot_off = fdt_find_or_add_subnode(fdt_blob, 0, "p-boot");
+        int pboot_off = fdt_edit_find_or_add_subnode(e, 0, "p-boot");
         if (pboot_off < 0)
 		return;
 
+	// format deferred messages into the log
+	log_flush();
+
 #ifdef PBOOT_FDT_CONFIGS
+	// pre-baked DTBs already have configs from p-boot-conf
+	if (prebaked)
+		goto skip_configs;
+
 	char* configs = malloc(32 * 256);
 	char* p = configs;
 
@@ -598,16 +619,38 @@ static void fdt_add_pboot_data(void* fdt_blob, struct bootfs* fs)
 		}
 	}
 
-	fdt_setprop(fdt_blob, pboot_off, "configs",
-		    configs, p - configs);
+	fdt_edit_setprop(e, pboot_off, "configs",
+			 configs, p - configs);
+skip_configs:
 #endif
 
 #ifdef PBOOT_FDT_LOG
-	fdt_setprop(fdt_blob, pboot_off, "log",
-		    globals->log_start, globals->log_end - globals->log_start);
+	fdt_edit_setprop(e, pboot_off, "log",
+			 globals->log_start, globals->log_end - globals->log_start);
+#endif
+
+#ifdef BOOT_TIMELINE
+	fdt_edit_setprop(e, pboot_off, "timings", tl_data(), tl_size());
 #endif
 }
 
+#ifdef BOOT_TIMELINE
+// refresh /p-boot/timings with records taken after boot_finalize(), which
+// leaves space in the FDT for TL_MAX_LATE more records
+static void fdt_update_pboot_timings(void* fdt_blob)
+{
+	int err;
+
+        int pboot_off = fdt_path_offset(fdt_blob, "/p-boot");
+        if (pboot_off < 0)
+		return;
+
+	err = fdt_setprop(fdt_blob, pboot_off, "timings", tl_data(), tl_size());
+	if (err < 0)
+		printf("Can't update timings: %s\n", fdt_strerror(err));
+}
+#endif
+
 // }}}
 // {{{ ATF entry/exit helpers
 
@@ -621,6 +664,7 @@ static void fdt_add_pboot_data(void* fdt_blob, struct bootfs* fs)
  * 0x40080000 - Linux Image
  * 0x4a000000 - DTB
  * 0x4b000000 - DTB2 (alternative dtb)
+ * 0x4c000000 - preloaded firmware files (reserved for Linux)
  * 0x4fe00000 - initramfs
  *
  * ATF maps 0x4a000000 - 0x4c000000 for main u-boot binary. We don't have u-boot
@@ -633,6 +677,8 @@ static void fdt_add_pboot_data(void* fdt_blob, struct bootfs* fs)
 #define FDT_BLOB_PA	0x4a000000
 #define FDT_BLOB2_PA	0x4b000000
 #define INITRAMFS_PA	0x4fe00000
+#define PRELOAD_PA	0x4c000000
+#define PRELOAD_MAX	16
 
 enum {
 	IMAGE_ATF,
@@ -651,9 +697,17 @@ struct boot
 	uint32_t image_sizes[IMAGE_COUNT];
 	uint32_t image_dests[IMAGE_COUNT];
 	void* fdt;
+	struct fdt_edit* fdt_edit;
+	bool fdt_prebaked; // static fixups were applied by p-boot-conf
 	char bootargs[4096];
 	struct bootfs* fs;
 	struct bootfs_conf* conf;
+#ifdef FW_PRELOAD
+	int n_preloads;
+	const char* preload_names[PRELOAD_MAX];
+	uint32_t preload_dests[PRELOAD_MAX];
+	uint32_t preload_sizes[PRELOAD_MAX];
+#endif
 };
 
 struct kernel_image_hdr {
@@ -677,6 +731,124 @@ static const char* img_names[] = {
 	[IMAGE_INITRD] = "Initrd",
 };
 
+#ifdef FW_PRELOAD
+/*
+ * Firmware files listed in the "preload" config option are loaded back to back
+ * at PRELOAD_PA, so that Linux drivers can take them from memory instead of
+ * waiting for the rootfs to get mounted.
+ */
+static bool boot_load_preloads(struct boot* boot)
+{
+	uint32_t dest = PRELOAD_PA;
+	char* p = (char*)boot->conf->preload;
+	char* end = p + sizeof boot->conf->preload;
+
+	while (p < end && *p && boot->n_preloads < PRELOAD_MAX) {
+		char* colon = strchr(p, ':');
+		if (!colon || colon - p > 31) {
+			printf("Invalid preload entry %s\n", p);
+			return false;
+		}
+
+		char name[32];
+		memcpy(name, p, colon - p);
+		name[colon - p] = 0;
+
+		struct bootfs_file* f = bootfs_find_file(boot->fs, name);
+		if (!f) {
+			printf("Preload file %s not found\n", name);
+			return false;
+		}
+
+		uint32_t size = __be32_to_cpu(f->data_len);
+		if (dest + size > INITRAMFS_PA) {
+			printf("Preload file %s doesn't fit\n", name);
+			return false;
+		}
+
+		if (bootfs_load_image(boot->fs, dest, __be32_to_cpu(f->data_off),
+				      size, name) < 0)
+			return false;
+
+		boot->preload_names[boot->n_preloads] = p;
+		boot->preload_dests[boot->n_preloads] = dest;
+		boot->preload_sizes[boot->n_preloads++] = size;
+
+		dest = ALIGN(dest + size, 4096);
+		p += strlen(p) + 1;
+	}
+
+	return true;
+}
+#endif
+
+#ifdef DT_OVERLAYS
+/*
+ * DT overlays listed in the "overlay" config option are applied to a copy of
+ * the base FDT, so that variants of a config can share a single base DTB.
+ * If any overlay fails to apply, we boot with the unmodified base FDT.
+ */
+static void boot_apply_overlays(struct boot* boot)
+{
+	char* p = (char*)boot->conf->overlays;
+	char* end = p + sizeof boot->conf->overlays;
+	uint32_t total = fdt_totalsize(boot->fdt);
+	void* ovl = NULL;
+	int err;
+
+	for (char* n = p; n < end && *n; n += strlen(n) + 1) {
+		struct bootfs_file* f = bootfs_find_file(boot->fs, n);
+		if (!f) {
+			printf("Overlay %s not found\n", n);
+			return;
+		}
+
+		total += __be32_to_cpu(f->data_len);
+	}
+
+	// fdt_overlay_apply() needs some space for new properties and fixups
+	total += 64 * 1024;
+
+	void* base = malloc(total);
+	err = fdt_open_into(boot->fdt, base, total);
+	if (err < 0)
+		goto err;
+
+	for (; p < end && *p; p += strlen(p) + 1) {
+		struct bootfs_file* f = bootfs_find_file(boot->fs, p);
+		uint32_t size = __be32_to_cpu(f->data_len);
+		// MMC reads whole blocks
+		ovl = malloc(ALIGN(size, 512));
+
+		if (bootfs_load_image(boot->fs, (uintptr_t)ovl,
+				      __be32_to_cpu(f->data_off), size, p) < 0) {
+			err = -FDT_ERR_TRUNCATED;
+			goto err;
+		}
+
+		err = fdt_check_header(ovl);
+		if (err < 0)
+			goto err;
+
+		// on failure, base is left in an undefined state
+		err = fdt_overlay_apply(base, ovl);
+		if (err < 0)
+			goto err;
+
+		free(ovl);
+		ovl = NULL;
+	}
+
+	boot->fdt = base;
+	return;
+
+err:
+	printf("Overlay %s failed: %s\n", p, fdt_strerror(err));
+	free(ovl);
+	free(base);
+}
+#endif
+
 bool boot_prepare(struct boot* boot, struct bootfs* fs, struct bootfs_conf* bc)
 {
 	// read the images from the selected table entry to memory
@@ -746,16 +918,21 @@ bool boot_prepare(struct boot* boot, struct bootfs* fs, struct bootfs_conf* bc)
 			return false;
 	}
 
-	// if alternate FDT is present, assume it's for 1.2 and if 1.2 is detected
-	// use it
-	if (boot->loaded_images & (1 << IMAGE_FDT2)) {
-		if (globals->board_rev == 2) {
-			memcpy((void*)(uintptr_t)boot->image_dests[IMAGE_FDT],
-			       (void*)(uintptr_t)boot->image_dests[IMAGE_FDT2],
-			       boot->image_sizes[IMAGE_FDT2]);
-		}
+	if (bootfs_has_conf_lists(boot->fs) && bc->preload[0]) {
+#ifdef FW_PRELOAD
+		if (!boot_load_preloads(boot))
+			return false;
+#else
+		printf("Firmware preloading is not supported by this build\n");
+#endif
 	}
 
+	// if alternate FDT is present, assume it's for 1.2 and if 1.2 is detected
+	// use it (the final FDT is written to FDT_BLOB_PA by boot_finalize())
+	boot->fdt = (void*)(uintptr_t)boot->image_dests[IMAGE_FDT];
+	if (boot->loaded_images & (1 << IMAGE_FDT2) && globals->board_rev == 2)
+		boot->fdt = (void*)(uintptr_t)boot->image_dests[IMAGE_FDT2];
+
 	struct kernel_image_hdr* h = (void*)(uintptr_t)boot->image_dests[IMAGE_LINUX];
 	if (h->magic != 0x644d5241) {
                 printf("Linux image is not an arm64 kernel image\n");
@@ -769,25 +946,36 @@ bool boot_prepare(struct boot* boot, struct bootfs* fs, struct bootfs_conf* bc)
 		memmove((void*)(uintptr_t)globals->linux_image_pa,
 			(void*)(uintptr_t)boot->image_dests[IMAGE_LINUX],
 			boot->image_sizes[IMAGE_LINUX]);
+		mmu_mark_dirty(globals->linux_image_pa,
+			       boot->image_sizes[IMAGE_LINUX]);
 	}
 
-	boot->fdt = (void*)(uintptr_t)boot->image_dests[IMAGE_FDT];
-
         int err = fdt_check_header(boot->fdt);
         if (err < 0) {
                 printf("Bad FDT hedaer: %s\n", fdt_strerror(err));
 		return false;
 	}
 
-	err = fdt_increase_size(boot->fdt, 1024 * 256); // generous
-        if (err < 0) {
-                printf("Can't expand FDT: %s\n", fdt_strerror(err));
-		return false;
+	if (bootfs_has_conf_lists(boot->fs) && bc->overlays[0]) {
+#ifdef DT_OVERLAYS
+		boot_apply_overlays(boot);
+#else
+		printf("DT overlays are not supported by this build\n");
+#endif
 	}
 
+	int pboot_off = fdt_path_offset(boot->fdt, "/p-boot");
+	if (pboot_off >= 0 && fdt_getprop(boot->fdt, pboot_off, "pre-baked", NULL))
+		boot->fdt_prebaked = true;
+
+	// FDT fixups are collected in an edit list and written out by
+	// boot_finalize(), nodes are looked up in the edit's FDT from now on
+	boot->fdt_edit = fdt_edit_begin(boot->fdt);
+	boot->fdt = (void*)fdt_edit_fdt(boot->fdt_edit);
+
 	memcpy(boot->bootargs, bc->boot_args, strlen((char*)bc->boot_args) + 1);
 
-        int chosen_off = fdt_find_or_add_subnode(boot->fdt, 0, "chosen");
+        int chosen_off = fdt_edit_find_or_add_subnode(boot->fdt_edit, 0, "chosen");
         if (chosen_off < 0) {
                 printf("Can't create /chosen node\n");
 		return false;
@@ -807,28 +995,28 @@ void boot_append_bootargs(struct boot* boot, char* bootargs)
 int fdt_setup_framebuffer(struct boot* boot, uint32_t fb_addr)
 {
 	int ret;
-	void* fdt = boot->fdt;
+	struct fdt_edit* e = boot->fdt_edit;
 	uint32_t size = 1440 * 720 * 4;
 	fdt32_t cells[] = {
 		cpu_to_fdt32(fb_addr),
 		cpu_to_fdt32(size),
 	};
 
-        int chosen_off = fdt_find_or_add_subnode(boot->fdt, 0, "chosen");
+        int chosen_off = fdt_edit_find_or_add_subnode(e, 0, "chosen");
         if (chosen_off < 0) {
                 printf("Can't create /chosen node\n");
 		return false;
 	}
 
-        ret = fdt_setprop(fdt, chosen_off, "p-boot,framebuffer", cells, sizeof cells);
+        ret = fdt_edit_setprop(e, chosen_off, "p-boot,framebuffer", cells, sizeof cells);
         if (ret)
 		goto err;
 
-        ret = fdt_setprop_u32(fdt, chosen_off, "p-boot,framebuffer-start", fb_addr);
+        ret = fdt_edit_setprop_u32(e, chosen_off, "p-boot,framebuffer-start", fb_addr);
         if (ret)
 		goto err;
 
-	ret = fdt_add_mem_rsv(fdt, fb_addr, size);
+	ret = fdt_edit_add_mem_rsv(e, fb_addr, size);
         if (ret)
 		goto err;
 
@@ -839,34 +1027,117 @@ err:
 	return -1;
 }
 
+#ifdef FW_PRELOAD
+// describe preloaded firmware files to Linux
+static int fdt_add_preloads(struct boot* boot)
+{
+	struct fdt_edit* e = boot->fdt_edit;
+	int rm, node, sub, err;
+
+	if (!boot->n_preloads)
+		return 0;
+
+	uint32_t total = boot->preload_dests[boot->n_preloads - 1] +
+			 boot->preload_sizes[boot->n_preloads - 1] - PRELOAD_PA;
+
+	rm = fdt_path_offset(boot->fdt, "/reserved-memory");
+	if (rm < 0) {
+		rm = fdt_edit_add_subnode(e, 0, "reserved-memory");
+		if (rm < 0)
+			return rm;
+
+		fdt_edit_setprop_u32(e, rm, "#address-cells", 2);
+		fdt_edit_setprop_u32(e, rm, "#size-cells", 2);
+		fdt_edit_setprop(e, rm, "ranges", NULL, 0);
+	}
+
+	sub = fdt_edit_add_subnode(e, rm, "pboot-firmware@4c000000");
+	if (sub < 0)
+		return sub;
+
+	err = fdt_edit_setprop_reg(e, rm, sub, "reg", PRELOAD_PA, total);
+	if (err < 0)
+		return err;
+
+	fdt_edit_setprop(e, sub, "no-map", NULL, 0);
+
+	node = fdt_edit_find_or_add_subnode(e, 0, "p-boot");
+	if (node < 0)
+		return node;
+
+	node = fdt_edit_add_subnode(e, node, "firmware");
+	if (node < 0)
+		return node;
+
+	fdt_edit_setprop_u32(e, node, "#address-cells", 1);
+	fdt_edit_setprop_u32(e, node, "#size-cells", 1);
+
+	for (int i = 0; i < boot->n_preloads; i++) {
+		const char* fw = boot->preload_names[i];
+		const char* colon = strchr(fw, ':');
+		struct strbuf* name = strbuf_new(16);
+		char* fw_name = zalloc(colon - fw + 1);
+
+		strbuf_printf(name, "fw%u", i);
+		sub = fdt_edit_add_subnode(e, node, strbuf_to_cstr(name));
+		if (sub < 0)
+			return sub;
+
+		memcpy(fw_name, fw, colon - fw);
+		fdt_edit_setprop(e, sub, "firmware-name", fw_name, colon - fw + 1);
+		fdt_edit_setprop_string(e, sub, "device-compatible", colon + 1);
+		err = fdt_edit_setprop_reg(e, node, sub, "reg", boot->preload_dests[i],
+					   boot->preload_sizes[i]);
+		if (err < 0)
+			return err;
+
+		printf("Preloaded %s at 0x%x (%u KiB)\n", fw,
+		       boot->preload_dests[i], boot->preload_sizes[i] / 1024);
+	}
+
+	return 0;
+}
+#endif
+
 bool boot_finalize(struct boot* boot)
 {
 	int err;
-	void* fdt = boot->fdt;
+	struct fdt_edit* e = boot->fdt_edit;
+	const void* fdt = boot->fdt;
 
         // setup FDT
-	fdt_fixup_wifi(fdt);
+	fdt_fixup_wifi(e, fdt);
 
 	// PinePhone doesn't need BT local address fixup
-	//fdt_fixup_bt(fdt);
-	fdt_add_pboot_data(fdt, boot->fs);
+	//fdt_fixup_bt(e, fdt);
+	fdt_add_pboot_data(e, boot->fs, boot->fdt_prebaked);
 
 	//printf("args: %s\n", boot->bootargs);
 
-        int chosen_off = fdt_find_or_add_subnode(boot->fdt, 0, "chosen");
+        int chosen_off = fdt_edit_find_or_add_subnode(e, 0, "chosen");
         if (chosen_off < 0) {
                 printf("Can't create /chosen node\n");
 		return false;
 	}
 
-	err = fdt_setprop(fdt, chosen_off, "bootargs",
-			  boot->bootargs, strlen(boot->bootargs) + 1);
-	if (err < 0) {
-		printf("Can't set bootargs %d (%s)\n", err, boot->bootargs);
+	// pre-baked DTBs already have bootargs from the boot configuration
+	if (!boot->fdt_prebaked || strcmp(boot->bootargs, (char*)boot->conf->boot_args)) {
+		err = fdt_edit_setprop(e, chosen_off, "bootargs",
+				       boot->bootargs, strlen(boot->bootargs) + 1);
+		if (err < 0) {
+			printf("Can't set bootargs %d (%s)\n", err, boot->bootargs);
+			return false;
+		}
+	}
+
+	int mem_off = fdt_edit_find_or_add_subnode(e, 0, "memory");
+	if (mem_off < 0) {
+		printf("Can't set memory range\n");
 		return false;
 	}
 
-	err = fdt_fixup_memory(fdt, 0x40000000, globals->dram_size);
+	fdt_edit_setprop_string(e, mem_off, "device_type", "memory");
+	err = fdt_edit_setprop_reg(e, 0, mem_off, "reg", 0x40000000, globals->dram_size);
 	if (err < 0) {
 		printf("Can't set memory range\n");
 		return false;
@@ -876,39 +1147,83 @@ bool boot_finalize(struct boot* boot)
 		uint32_t initramfs_start = boot->image_dests[IMAGE_INITRD];
 		uint32_t initramfs_end = initramfs_start + boot->image_sizes[IMAGE_INITRD];
 
-		err = fdt_initrd(fdt, initramfs_start, initramfs_end);
+		// /memory may have been added before /chosen
+		chosen_off = fdt_edit_find_or_add_subnode(e, 0, "chosen");
+
+		err = fdt_edit_add_mem_rsv(e, initramfs_start, initramfs_end - initramfs_start);
 		if (err < 0) {
 			printf("Can't setup initrd\n");
 			return false;
 		}
+
+		if (fdt_address_cells(fdt, 0) == 2) {
+			fdt_edit_setprop_u64(e, chosen_off, "linux,initrd-start", initramfs_start);
+			fdt_edit_setprop_u64(e, chosen_off, "linux,initrd-end", initramfs_end);
+		} else {
+			fdt_edit_setprop_u32(e, chosen_off, "linux,initrd-start", initramfs_start);
+			fdt_edit_setprop_u32(e, chosen_off, "linux,initrd-end", initramfs_end);
+		}
 	}
 
-	// this also sets up reservation for FDT blob
-	err = fdt_shrink_to_minimum(fdt, 0);
+#ifdef FW_PRELOAD
+	err = fdt_add_preloads(boot);
 	if (err < 0) {
-		printf("Can't shrink fdt\n");
+		printf("Can't describe preloaded firmware %d\n", err);
 		return false;
 	}
+#endif
+
+	err = resident_fdt_reserve(e);
+	if (err < 0) {
+		printf("Can't reserve resident images record\n");
+		return false;
+	}
+
+	// write out the final FDT in one pass to where ATF expects it, the
+	// source FDT can only be overwritten via a bounce buffer
+	void* out = (void*)(uintptr_t)FDT_BLOB_PA;
+	int out_size = FDT_BLOB2_PA - FDT_BLOB_PA;
+
+	if (fdt == out) {
+		out_size = fdt_totalsize(fdt) + 1024 * 256; // generous
+		out = malloc(out_size);
+	}
+
+	err = fdt_edit_finish(e, out, out_size);
+	if (err < 0) {
+		printf("Can't write FDT: %s\n", fdt_strerror(err));
+		return false;
+	}
+
+	boot->fdt = (void*)(uintptr_t)FDT_BLOB_PA;
+	if (out != boot->fdt)
+		memcpy(boot->fdt, out, err);
+
+	// the written out FDT has no free space left, leave space for
+	// fdt_update_pboot_timings()
+	fdt_set_totalsize(boot->fdt, err + TL_MAX_LATE * TL_RECORD_SIZE);
 
 	return true;
 }
 
 static inline void raw_write_daif(unsigned int daif)
 {
+#ifndef PBOOT_SIM
         __asm__ __volatile__("msr DAIF, %0\n\t" : : "r" (daif) : "memory");
+#endif
 }
 
+// start.S, disables MMU and caches and enters ATF
+void _atf_handoff(struct entry_point_info *ep_info, void *fdt_blob,
+		  uintptr_t magic, uintptr_t atf_entry) __attribute__((noreturn));
+
 static void jump_to_atf(void)
 {
-	void (*atf_entry_point)(struct entry_point_info *ep_info,
-				void *fdt_blob, uintptr_t magic);
 	/*
 	 * Holds information passed to ATF about where to jump after ATF
 	 * finishes.
 	 */
-	static struct entry_point_info* bl33_ep_info;
-
-	printf("%d us: jumping to ATF\n", timer_get_boot_us() - globals->t0);
+	struct entry_point_info* bl33_ep_info;
 
 	bl33_ep_info = zalloc(sizeof *bl33_ep_info);
 
@@ -921,18 +1236,26 @@ static void jump_to_atf(void)
 	bl33_ep_info->spsr = SPSR_64(MODE_EL2, MODE_SP_ELX,
 				     DISABLE_ALL_EXECPTIONS);
 
-	//disable_interrupts();
-	icache_disable();
-	invalidate_icache_all();
-	dcache_disable();
-	invalidate_dcache_all();
+	// Only data written by the CPU that ATF/Linux will read needs to
+	// reach DRAM. Images loaded via MMC DMA are already there, and
+	// everything else is discarded from the cache by _atf_handoff().
+	mmu_mark_dirty((uintptr_t)bl33_ep_info, sizeof *bl33_ep_info);
+	mmu_mark_dirty(FDT_BLOB_PA, fdt_totalsize((void*)(uintptr_t)FDT_BLOB_PA));
 
-	raw_write_daif(SPSR_EXCEPTION_MASK);
+	ulong ts = timer_get_boot_us();
+	mmu_clean_dirty();
+
+	printf("%d us: jumping to ATF (cache clean %lu us)\n",
+	       timer_get_boot_us() - globals->t0, timer_get_boot_us() - ts);
 
-	atf_entry_point = (void*)(uintptr_t)ATF_PA;
-	atf_entry_point((void *)bl33_ep_info, (void *)(uintptr_t)FDT_BLOB_PA, 0xb001);
+	// messages after boot_finalize() only make it to the serial console,
+	// which must be idle before ATF takes over
+	console_flush();
 
-	panic(5, "ATF entry failed\n");
+	//disable_interrupts();
+	raw_write_daif(SPSR_EXCEPTION_MASK);
+
+	_atf_handoff(bl33_ep_info, (void *)(uintptr_t)FDT_BLOB_PA, 0xb001, ATF_PA);
 }
 
 void boot_perform(struct boot* boot)
@@ -943,6 +1266,15 @@ void boot_perform(struct boot* boot)
 
 	lradc_disable();
 	wdog_disable();
+	smp_fini();
+
+	resident_commit();
+
+#ifdef BOOT_TIMELINE
+	tl_begin(TL_ATF_JUMP, 0);
+	fdt_update_pboot_timings(boot->fdt);
+#endif
+
 	jump_to_atf();
 }
 
@@ -950,6 +1282,8 @@ void boot_perform(struct boot* boot)
 
 void panic_shutdown(uint32_t code)
 {
+	console_flush();
+
         // blink green led in a binary pattern
 
         green_led_set(0);
@@ -974,6 +1308,7 @@ void panic_shutdown(uint32_t code)
         udelay(500000);
 
 	puts("Power off!\n");
+	console_flush();
 	pmic_poweroff();
 }
 
@@ -984,6 +1319,7 @@ void main_sram_only(void)
 
 	green_led_set(1);
 	ccu_init();
+	tl_init();
 	console_init();
 	lradc_enable();
 	wdog_ping();
@@ -999,10 +1335,17 @@ void main_sram_only(void)
 	pmic_init();
 	printf("PMIC ready\n");
 
+	tl_begin(TL_DRAM_INIT, 0);
 	uint64_t dram_size = sunxi_dram_init();
+	tl_end(TL_DRAM_INIT, 0);
 	if (!dram_size)
 		panic(3, "DRAM not detected");
 
+#ifdef MBUS_BOOT_PROFILE
+	// favor CPU and MMC DMA until boot images are loaded
+	mctl_set_mbus_profile(MBUS_PROFILE_BOOT);
+#endif
+
 	// 256MiB from end of DRAM is our heap
 	uint8_t* heap_end = (void*)(CONFIG_SYS_SDRAM_BASE + dram_size - 256 * 1024 * 1024);
 	globals = (void*)heap_end;
@@ -1013,6 +1356,20 @@ void main_sram_only(void)
 	globals->heap_end = heap_end;
 	globals->dram_size = dram_size;
 
+#ifdef BOOT_TIMELINE
+	// move boot timeline out of SRAM
+	tl_set_buffer(malloc(256 * TL_RECORD_SIZE), 256);
+#endif
+
+	// from now on, messages are only formatted by log_flush()
+	log_set_buffer(malloc(64 * 1024), 64 * 1024);
+
+	// serial output doesn't wait for the UART from now on
+	console_set_tx_buffer(malloc(16 * 1024), 16 * 1024);
+
+	// pick up the record of images left in DRAM by the previous boot
+	resident_init();
+
 	icache_enable();
 	mmu_setup(dram_size);
 
@@ -1041,22 +1398,27 @@ void main_sram_only(void)
 
 	ccu_upclock();
 
-	//XXX: set CPU voltage to high and increase the clock to the highest OPP
-	// causes intermittent SD/emmc init/load failures
-	//
-	// udelay(1000);
-	// clock_set_pll1(1152000000);
+#ifdef CPU_FAST_CLOCK
+	// highest OPP, needs DCDC2 at 1.3V; switching via clock_set_pll1()
+	// without waiting for the voltage caused intermittent SD/eMMC
+	// init/load failures. The voltage wait is the suspected cause, but
+	// this has not been validated by repeated boots on hardware yet, so
+	// it's only enabled in p-boot-serial and p-boot-bench.
+	ret = ccu_set_cpux_opp(CPU_FAST_CLOCK, 1300);
+	if (ret)
+		printf("CPU OPP switch failed %d\n", ret);
+#endif
 
 	void* dram_stack = malloc(128 * 1024);
 	extern uint32_t _dram_stack_top;
 	_dram_stack_top = (uintptr_t)((uint8_t*)dram_stack + 128 * 1024);
 }
 
-static void fdt_path_disable(void* fdt, const char* path)
+static void fdt_path_disable(struct fdt_edit* e, const void* fdt, const char* path)
 {
         int node = fdt_path_offset(fdt, path);
 	if (node >= 0)
-		fdt_setprop(fdt, node, "status", "disabled", 9);
+		fdt_edit_setprop(e, node, "status", "disabled", 9);
 }
 
 static const char* priv_nodes[] = {
@@ -1077,6 +1439,47 @@ static const char* priv_nodes[] = {
 	"/soc/csi@1cb0000",
 };
 
+#ifdef ENABLE_GUI
+
+static void splash_commit(void)
+{
+	struct display* d = zalloc(sizeof *d);
+
+	d->planes[0].fb_start = 0x48000000;
+	d->planes[0].fb_pitch = 720 * 4;
+	d->planes[0].src_w = 720;
+	d->planes[0].src_h = 1440;
+	d->planes[0].dst_w = 720;
+	d->planes[0].dst_h = 1440;
+	display_commit(d);
+}
+
+#ifdef BOOT_TASKS
+
+// scheduled by display_init_async() once the panel is ready
+static void splash_run(struct task* t)
+{
+	static bool committed;
+
+	if (!committed) {
+		splash_commit();
+		committed = true;
+	}
+
+	// turn on the backlight only after the splash is on the screen
+	if (!display_frame_done()) {
+		task_schedule(t, 1000);
+		return;
+	}
+
+	backlight_enable(60);
+}
+
+static struct task splash_task = { .run = splash_run };
+
+#endif
+#endif
+
 static void boot_selection(struct bootfs* fs, struct bootfs_conf* sbc, uint32_t splash_fb)
 {
 	//
@@ -1087,19 +1490,33 @@ static void boot_selection(struct bootfs* fs, struct bootfs_conf* sbc, uint32_t
 	if (!boot_prepare(boot, fs, sbc))
 		panic(12, "Failed to load boot images\n");
 
+	// finish display bring-up, if it's still in progress
+	sched_wait_all();
+
+#ifdef MBUS_BOOT_PROFILE
+	mctl_set_mbus_profile(MBUS_PROFILE_LINUX);
+#endif
+
+	pmic_dump_stats();
+
 	if (splash_fb)
 		fdt_setup_framebuffer(boot, splash_fb);
 
 	//boot_append_bootargs(boot, globals->mmc_no == 0 ? "bootdev=sd" : "bootdev=emmc");
 
-	void* fdt = boot->fdt;
+	const void* fdt = boot->fdt;
+	struct fdt_edit* e = boot->fdt_edit;
+
+	tl_begin(TL_FDT_FIXUP, 0);
 
 	// need to remove x-powers,ts-as-gpadc from FDT, because p-boot
 	// configures TS correctly and we want battery thermal protection
-	// to function correctly
-        int adc_node = fdt_path_offset(fdt, "/soc/rsb@1f03400/pmic@3a3/adc");
-	if (adc_node >= 0)
-		fdt_delprop(fdt, adc_node, "x-powers,ts-as-gpadc");
+	// to function correctly (pre-baked DTBs have it removed already)
+	if (!boot->fdt_prebaked) {
+		int adc_node = fdt_path_offset(fdt, "/soc/rsb@1f03400/pmic@3a3/adc");
+		if (adc_node >= 0)
+			fdt_edit_delprop(e, adc_node, "x-powers,ts-as-gpadc");
+	}
 
         const char* model = fdt_getprop(fdt, 0, "model", NULL);
         if (model)
@@ -1107,28 +1524,30 @@ static void boot_selection(struct bootfs* fs, struct bootfs_conf* sbc, uint32_t
 
 	if (rtc_get_flag(BIT(0))) {
 		for (int i = 0; i < ARRAY_SIZE(priv_nodes); i++)
-			fdt_path_disable(fdt, priv_nodes[i]);
+			fdt_path_disable(e, fdt, priv_nodes[i]);
 
 		// Modem power driver
 		int node = fdt_path_offset(fdt, "/soc/serial@1c28c00/modem");
 		if (node >= 0)
-			fdt_setprop_u32(fdt, node, "blocked", 1);
+			fdt_edit_setprop_u32(e, node, "blocked", 1);
 	} else {
 		// Disable modem power driver for eg25-manager using distros
 		if (strstr(boot->bootargs, "eg25-manager")) {
 		        int node = fdt_path_offset(fdt, "/soc/serial@1c28c00/modem");
 			if (node >= 0)
-				fdt_del_node(fdt, node);
+				fdt_edit_del_node(e, node);
 
 		        node = fdt_path_offset(fdt, "/vbat-bb");
 			if (node >= 0)
-				fdt_setprop(fdt, node, "regulator-always-on", NULL, 0);
+				fdt_edit_setprop(e, node, "regulator-always-on", NULL, 0);
 		}
 	}
 
 	if (!boot_finalize(boot))
 		panic(13, "Failed to finalize boot\n");
 
+	tl_end(TL_FDT_FIXUP, 0);
+
 	boot_perform(boot);
 }
 
@@ -1309,6 +1728,7 @@ static void boot_gui(void)
 			if (state == STATE_OFF) {
 				bootfs_load_file(fs, 0x48000000, "off.argb");
 				d->planes[1].fb_start = 0;
+				d->planes[2].fb_start = 0;
 				display_commit(g->display);
 				udelay(1000000);
 				pmic_poweroff();
@@ -1319,13 +1739,14 @@ static void boot_gui(void)
 
 				load_splash(cfs, c, 0x48000000);
 				d->planes[1].fb_start = 0;
+				d->planes[2].fb_start = 0;
 				display_commit(g->display);
 				gui_fini(g);
 				boot_selection(cfs, c, 0x48000000);
 				soc_reset();
 			}
 
-			display_commit(g->display);
+			// menu commits its own page flips from gui_get_events()
 			flips++;
 
 			if (flips == 1) {
@@ -1390,11 +1811,29 @@ spok:
 	gui_fini(g);
 }
 
+#ifdef BOOT_TASKS
+
+static int pressed_key;
+
+static void key_sample_run(struct task* t)
+{
+	pressed_key = lradc_get_pressed_key();
+}
+
+#endif
+
 void main(void)
 {
 	struct bootfs* fs = NULL;
 	int key;
 
+#ifdef BOOT_TASKS
+	struct task key_task = { .run = key_sample_run };
+
+	/* read volume keys status once LRADC has a stable sample */
+	task_schedule(&key_task, 12000);
+#endif
+
 	globals->board_rev = detect_pinephone_revision();
 	globals->boot_source = get_boot_source();
 	get_soc_id(globals->sid);
@@ -1405,9 +1844,14 @@ void main(void)
 
 	printf("Boot Source: %s\n", get_boot_source_name());
 
+#ifdef BOOT_TASKS
+	sched_wait(&key_task);
+	key = pressed_key;
+#else
 	/* read volume keys status */
 	udelay(12000);
 	key = lradc_get_pressed_key();
+#endif
 
 #ifdef ENABLE_GUI
 	if (key == KEY_VOLUMEUP)
@@ -1428,20 +1872,19 @@ void main(void)
 
 	// try to load splashscreen, if successful, init display to show it
 	if (load_splash(fs, sbc, 0x48000000)) {
+#ifdef BOOT_TASKS
+		// panel bring-up is stepped while the rest of the boot
+		// images are being loaded, splash is shown as soon as the
+		// panel is ready
+		display_init_async(&splash_task);
+#else
 		// show splash
 		display_init();
-
-		struct display* d = zalloc(sizeof *d);
-		d->planes[0].fb_start = 0x48000000;
-		d->planes[0].fb_pitch = 720 * 4;
-		d->planes[0].src_w = 720;
-		d->planes[0].src_h = 1440;
-		d->planes[0].dst_w = 720;
-		d->planes[0].dst_h = 1440;
-		display_commit(d);
+		splash_commit();
 
 		while (!display_frame_done());
 		backlight_enable(60);
+#endif
 
 		boot_selection(fs, sbc, 0x48000000);
 		goto boot_ui;
@@ -18,6 +18,8 @@
  */
 
 #include <common.h>
+#include <cpu_func.h>
+#include "mmu.h"
 
 #define ULL(x) x##ull
 
@@ -26,6 +28,10 @@
 #define SCTLR_M_BIT		(ULL(1) << 0)
 #define SCTLR_C_BIT		(ULL(1) << 2)
 
+/* cpuectlr */
+
+#define CPUECTLR_SMPEN_BIT	(ULL(1) << 6)
+
 /* tcr */
 
 #define TCR_RGN_INNER_NC        (ULL(0x0) << 8)
@@ -107,18 +113,69 @@
 	 LOWER_ATTRS(ACCESS_FLAG | ISH | AP_RW | AP_ONE_VA_RANGE_RES1 | \
 		     ATTR_NORMAL))
 
+#define PTE_NC(pa) \
+	(BLOCK_DESC | (pa) | \
+	 LOWER_ATTRS(ACCESS_FLAG | OSH | AP_RW | AP_ONE_VA_RANGE_RES1 | \
+		     ATTR_NC))
+
 #define PTE_TAB(pa) \
 	(TABLE_DESC | (pa))
 
+#ifdef SMP_WORKERS
+/*
+ * MMU register values are kept for secondary cores, which share CPU0's
+ * translation tables. mmu_setup() runs with data cache off, so these
+ * are written straight to memory.
+ */
+static struct {
+	uint64_t mair;
+	uint64_t tcr;
+	uint64_t ttbr;
+} mmu_regs;
+#endif
+
+static void mmu_enable(uint64_t mair, uint64_t tcr, uint64_t ttbr)
+{
+	uint64_t sctlr;
+
+#ifdef SMP_WORKERS
+	uint64_t ectlr;
+
+	/* Take part in coherency before enabling data cache */
+	asm volatile("mrs %0, S3_1_C15_C2_1" : "=r" (ectlr));
+	ectlr |= CPUECTLR_SMPEN_BIT;
+	asm volatile("msr S3_1_C15_C2_1, %0" : : "r" (ectlr));
+#endif
+
+	/* Invalidate all TLB entries */
+	asm volatile("dsb ishst");
+	asm volatile("tlbi alle3");
+
+	/* Setup MMU registers */
+	asm volatile("msr mair_el3, %0" : : "r" (mair) : "cc");
+	asm volatile("msr tcr_el3,  %0" : : "r" (tcr) : "cc");
+	asm volatile("msr ttbr0_el3, %0" : : "r" (ttbr) : "cc");
+
+	asm volatile("dsb ish");
+	asm volatile("isb");
+
+	/* Enable MMU and data cache */
+	asm volatile("mrs %0, sctlr_el3" : "=r" (sctlr) : : "cc");
+	sctlr |= SCTLR_C_BIT | SCTLR_M_BIT;
+	asm volatile("msr sctlr_el3, %0" : : "r" (sctlr) : "cc");
+
+	asm volatile("isb");
+}
+
 /*
  * This function creates an identity map via
  *
- * The size of the table is 8 KiB.
+ * The size of the table is 12 KiB.
  */
 
 void mmu_setup(uint64_t dram_size)
 {
-	uint64_t mair, tcr, ttbr, sctlr;
+	uint64_t mair, tcr, ttbr;
 
 	/*
 	 * Memory Attribute Indirection Register (EL3)
@@ -161,35 +218,52 @@ void mmu_setup(uint64_t dram_size)
 	/*
 	 * Translation table base address.
 	 *
-	 * We place tt_base at the top of DRAM (8KiB from the end)
+	 * We place tt_base at the top of DRAM (12KiB from the end)
 	 */
-	uint64_t* tt_base = (uint64_t*)(uintptr_t)(0x40000000ull + dram_size - 4096 * 2);
+	uint64_t* tt_base = (uint64_t*)(uintptr_t)(0x40000000ull + dram_size - 4096 * 3);
 
 	/*
 	 * Generate the translation tables:
 	 *
 	 * L1 table with:
 	 * - 1x  link to L2 table for the first 1GiB
-	 * - 3x  1GiB blocks (cacheable for DRAM)
+	 * - 1x  link to L2 table for the second 1GiB (start of DRAM)
+	 * - 2x  1GiB blocks (cacheable for DRAM)
 	 *
 	 * L2 table for (0-1GiB) with:
 	 * - 1x    2MiB blocks (cacheable for SRAM areas)
 	 * - 511x  2MiB blocks (non-cacheable for device MMIO)
 	 *
+	 * L2 table for (1-2GiB) with:
+	 * - 512x  2MiB blocks (cacheable for DRAM, except for the framebuffer
+	 *         region, which is mapped as normal non-cacheable memory, so
+	 *         that DE2 can scan it out without any cache maintenance)
+	 *
 	 * Technically, each table has 512 8byte entries, but L1 table really
 	 * only needs to fill in first 4 entries due to t0sz being 32.
 	 */
 	uint64_t* l1 = tt_base;
 	uint64_t* l2 = tt_base + 512;
+	uint64_t* l2_dram = tt_base + 1024;
 
 	*l1++ = PTE_TAB((uintptr_t)l2);
-	for (int i = 1; i < 4; i++)
+	*l1++ = PTE_TAB((uintptr_t)l2_dram);
+	for (int i = 2; i < 4; i++)
 		*l1++ = PTE_MEM((1024ull * i) << 20);
 
 	*l2++ = PTE_MEM((2ull * 0) << 20);
 	for (int i = 1; i < 512; i++)
 		*l2++ = PTE_DEV((2ull * i) << 20);
 
+	for (int i = 0; i < 512; i++) {
+		uint64_t pa = (1024ull << 20) + ((2ull * i) << 20);
+
+		if (mmu_is_uncached(pa))
+			*l2_dram++ = PTE_NC(pa);
+		else
+			*l2_dram++ = PTE_MEM(pa);
+	}
+
 	/*
 	 * Translation Table Base Register 0 (EL3)
 	 *
@@ -198,22 +272,68 @@ void mmu_setup(uint64_t dram_size)
 	 */
 	ttbr = (uintptr_t)tt_base;
 
-	/* Invalidate all TLB entries */
-	asm volatile("dsb ishst");
-	asm volatile("tlbi alle3");
+#ifdef SMP_WORKERS
+	mmu_regs.mair = mair;
+	mmu_regs.tcr = tcr;
+	mmu_regs.ttbr = ttbr;
+#endif
 
-	/* Setup MMU registers */
-	asm volatile("msr mair_el3, %0" : : "r" (mair) : "cc");
-	asm volatile("msr tcr_el3,  %0" : : "r" (tcr) : "cc");
-	asm volatile("msr ttbr0_el3, %0" : : "r" (ttbr) : "cc");
+	mmu_enable(mair, tcr, ttbr);
+}
 
-	asm volatile("dsb ish");
-	asm volatile("isb");
+#ifdef SMP_WORKERS
+/*
+ * Called by secondary cores with MMU and caches off.
+ */
+void mmu_setup_secondary(void)
+{
+	mmu_enable(mmu_regs.mair, mmu_regs.tcr, mmu_regs.ttbr);
+}
+#endif
 
-	/* Enable MMU and data cache */
-	asm volatile("mrs %0, sctlr_el3" : "=r" (sctlr) : : "cc");
-	sctlr |= SCTLR_C_BIT | SCTLR_M_BIT;
-	asm volatile("msr sctlr_el3, %0" : : "r" (sctlr) : "cc");
+/*
+ * Simple bump allocator for framebuffers in the non-cacheable region.
+ * Start of the region is reserved for the background/splash image.
+ */
 
-	asm volatile("isb");
+static uintptr_t fb_alloc_end = FB_REGION_PA + FB_SPLASH_SIZE;
+
+void* mmu_fb_alloc(size_t len)
+{
+	uintptr_t p = fb_alloc_end;
+
+	fb_alloc_end += ALIGN(len, 4096);
+	if (fb_alloc_end > FB_REGION_PA + FB_REGION_SIZE)
+		return NULL;
+
+	return (void*)p;
+}
+
+#define MMU_DIRTY_RANGES 8
+
+static struct {
+	uintptr_t start;
+	uintptr_t end;
+} dirty_ranges[MMU_DIRTY_RANGES];
+static unsigned n_dirty_ranges;
+
+void mmu_mark_dirty(uintptr_t start, size_t len)
+{
+	// out of slots, clean right away
+	if (n_dirty_ranges == MMU_DIRTY_RANGES) {
+		flush_dcache_range(start, start + len);
+		return;
+	}
+
+	dirty_ranges[n_dirty_ranges].start = start;
+	dirty_ranges[n_dirty_ranges].end = start + len;
+	n_dirty_ranges++;
+}
+
+void mmu_clean_dirty(void)
+{
+	for (unsigned i = 0; i < n_dirty_ranges; i++)
+		flush_dcache_range(dirty_ranges[i].start, dirty_ranges[i].end);
+
+	n_dirty_ranges = 0;
 }
@@ -19,4 +19,36 @@
 
 #pragma once
 
+/*
+ * Framebuffer region is mapped as normal non-cacheable memory, so that
+ * CPU writes become visible to DE2 without explicit cache maintenance.
+ * Region must be 2MiB aligned.
+ *
+ * 0x48000000 - background/splash image
+ * 0x48400000 - framebuffers allocated via mmu_fb_alloc()
+ */
+#define FB_REGION_PA	0x48000000u
+#define FB_REGION_SIZE	(32u << 20)
+#define FB_SPLASH_SIZE	(4u << 20)
+
+static inline bool mmu_is_uncached(uint64_t pa)
+{
+	return pa >= FB_REGION_PA && pa < FB_REGION_PA + FB_REGION_SIZE;
+}
+
 void mmu_setup(uint64_t dram_size);
+#ifdef SMP_WORKERS
+void mmu_setup_secondary(void);
+#endif
+void* mmu_fb_alloc(size_t len);
+
+/*
+ * Track ranges written through the data cache, that need to reach DRAM
+ * before handing over control to ATF. mmu_clean_dirty() cleans them by VA.
+ *
+ * _atf_handoff() invalidates the data cache without writing it back, so
+ * any CPU-written data that ATF or Linux reads and that was not passed
+ * to mmu_mark_dirty() is silently lost.
+ */
+void mmu_mark_dirty(uintptr_t start, size_t len);
+void mmu_clean_dirty(void);
@@ -0,0 +1,183 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tool that applies DT overlays to a base DTB the same way p-boot does
+ * during boot (using libfdt's fdt_overlay_apply()), and checks that the
+ * result is a valid FDT and that all properties from the overlay fragments
+ * ended up in their target nodes.
+ *
+ * Usage: overlay-test board.dtb overlay.dtbo [overlay2.dtbo ...]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libfdt.h>
+
+static void* read_file(const char* path, size_t* size)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	void* data = malloc(*size);
+	if (fread(data, 1, *size, f) != *size) {
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+	return data;
+}
+
+// check that properties under @src (recursively) are present in @dst
+static bool check_node(const void* fdto, int src, const void* fdt, int dst, const char* path)
+{
+	bool ok = true;
+	int prop;
+
+	fdt_for_each_property_offset(prop, fdto, src) {
+		const char* name;
+		int len, dlen;
+		const void* val = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		const void* dval = fdt_getprop(fdt, dst, name, &dlen);
+
+		if (!dval || dlen != len || memcmp(val, dval, len)) {
+			printf("  %s/%s: property not applied\n", path, name);
+			ok = false;
+		}
+	}
+
+	int sub;
+	fdt_for_each_subnode(sub, fdto, src) {
+		const char* name = fdt_get_name(fdto, sub, NULL);
+		int dsub = fdt_subnode_offset(fdt, dst, name);
+		char sub_path[512];
+
+		snprintf(sub_path, sizeof sub_path, "%s/%s", path, name);
+		if (dsub < 0) {
+			printf("  %s: node not applied\n", sub_path);
+			ok = false;
+			continue;
+		}
+
+		ok &= check_node(fdto, sub, fdt, dsub, sub_path);
+	}
+
+	return ok;
+}
+
+static bool check_overlay(const void* fdto, const void* fdt)
+{
+	bool ok = true;
+	int frag;
+
+	fdt_for_each_subnode(frag, fdto, 0) {
+		int ovl = fdt_subnode_offset(fdto, frag, "__overlay__");
+		if (ovl < 0)
+			continue;
+
+		const char* path = fdt_getprop(fdto, frag, "target-path", NULL);
+		const fdt32_t* phandle = fdt_getprop(fdto, frag, "target", NULL);
+		int target = -FDT_ERR_NOTFOUND;
+
+		if (path)
+			target = fdt_path_offset(fdt, path);
+		else if (phandle)
+			target = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*phandle));
+
+		if (target < 0) {
+			printf("  %s: target not found\n", fdt_get_name(fdto, frag, NULL));
+			ok = false;
+			continue;
+		}
+
+		char target_path[256];
+		fdt_get_path(fdt, target, target_path, sizeof target_path);
+		ok &= check_node(fdto, ovl, fdt, target, target_path);
+	}
+
+	return ok;
+}
+
+int main(int ac, char* av[])
+{
+	int ret = 0, err;
+
+	if (ac < 3) {
+		fprintf(stderr, "usage: %s board.dtb overlay.dtbo [overlay2.dtbo ...]\n", av[0]);
+		return 1;
+	}
+
+	size_t size;
+	void* dtb = read_file(av[1], &size);
+	if (!dtb || fdt_check_header(dtb) < 0) {
+		printf("%s: not a valid DTB\n", av[1]);
+		return 1;
+	}
+
+	for (int i = 2; i < ac; i++) {
+		size_t ovl_size;
+		void* ovl = read_file(av[i], &ovl_size);
+		if (!ovl || fdt_check_header(ovl) < 0) {
+			printf("%s: not a valid DTB overlay\n", av[i]);
+			ret = 1;
+			continue;
+		}
+
+		// fdt_overlay_apply() clobbers the overlay, keep a copy for
+		// checking the result
+		void* ovl_copy = malloc(ovl_size);
+		memcpy(ovl_copy, ovl, ovl_size);
+
+		// same space reservation as boot_apply_overlays() in main.c
+		int buf_size = size + ovl_size + 64 * 1024;
+		void* fdt = malloc(buf_size);
+
+		err = fdt_open_into(dtb, fdt, buf_size);
+		if (err == 0)
+			err = fdt_overlay_apply(fdt, ovl);
+		if (err == 0)
+			err = fdt_check_full(fdt, buf_size);
+
+		if (err < 0) {
+			printf("%s: failed: %s\n", av[i], fdt_strerror(err));
+			ret = 1;
+		} else if (!check_overlay(ovl_copy, fdt)) {
+			printf("%s: result doesn't match the overlay\n", av[i]);
+			ret = 1;
+		} else {
+			printf("%s: ok (%d bytes)\n", av[i], fdt_totalsize(fdt));
+		}
+
+		free(fdt);
+		free(ovl_copy);
+		free(ovl);
+	}
+
+	free(dtb);
+	return ret;
+}
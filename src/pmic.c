@@ -124,6 +124,24 @@ int rsb_read(uint8_t rt_addr, uint8_t reg_addr)
 	return mmio_read_32(SUNXI_R_RSB_BASE + RSB_DATA0) & 0xff; /* result */
 }
 
+/* read 4 consecutive registers starting at reg_addr */
+static int rsb_read32(uint8_t rt_addr, uint8_t reg_addr, uint32_t* val)
+{
+	int ret;
+
+	mmio_write_32(SUNXI_R_RSB_BASE + RSB_CMD, RSBCMD_RD32);
+	mmio_write_32(SUNXI_R_RSB_BASE + RSB_SADDR, rt_addr << 16);
+	mmio_write_32(SUNXI_R_RSB_BASE + RSB_DADDR0, reg_addr);
+	mmio_write_32(SUNXI_R_RSB_BASE + RSB_CTRL, 0x80);/* start transaction */
+
+	ret = rsb_wait_stat("RSB: read32 command");
+	if (ret)
+		return ret;
+
+	*val = mmio_read_32(SUNXI_R_RSB_BASE + RSB_DATA0);
+	return 0;
+}
+
 int rsb_write(uint8_t rt_addr, uint8_t reg_addr, uint8_t value)
 {
 	mmio_write_32(SUNXI_R_RSB_BASE + RSB_CMD, RSBCMD_WR8);	/* byte write */
@@ -220,6 +238,135 @@ int rsb_init(void)
 					  AXP803_RT_ADDR);
 }
 
+/*
+ * Shadow copy of PMIC configuration registers. After a warm reboot, most
+ * of them already hold the values p-boot programs, so they're read in bulk
+ * once, and writes of unchanged values and reads for read-modify-write
+ * are then served from the shadow. Status, IRQ, ADC, fuel gauge and
+ * BC1.2 detection registers, and registers with self-clearing bits are
+ * not shadowed, because the PMIC changes them on its own.
+ *
+ * Only built with -DPMIC_SHADOW, otherwise all accesses go to the PMIC.
+ */
+
+#ifdef PMIC_SHADOW
+
+// registers from pmic_shadow_ranges, packed back to back
+#define PMIC_SHADOW_SIZE	104
+
+static uint8_t pmic_shadow[PMIC_SHADOW_SIZE];
+static bool pmic_shadow_ready;
+static unsigned pmic_xfers;
+static unsigned pmic_xfers_avoided;
+static const struct {
+	uint8_t start;
+	uint8_t end;
+} pmic_shadow_ranges[] = {
+	{ 0x10, 0x2b }, // output control, voltages
+	{ 0x33, 0x3f }, // charger, POK, TS thresholds
+	{ 0x80, 0x8e }, // DCDC modes, ADC/TS control
+	{ 0x90, 0x9f }, // GPIO LDOs
+	{ 0xc0, 0xdf }, // OCV table
+};
+
+// index of the register in pmic_shadow, or -1 if it's not shadowed
+static int pmic_shadow_index(uint8_t reg)
+{
+	int off = 0;
+
+	if (!pmic_shadow_ready)
+		return -1;
+
+	for (int i = 0; i < ARRAY_SIZE(pmic_shadow_ranges); i++) {
+		if (reg >= pmic_shadow_ranges[i].start &&
+		    reg <= pmic_shadow_ranges[i].end)
+			return off + reg - pmic_shadow_ranges[i].start;
+
+		off += pmic_shadow_ranges[i].end - pmic_shadow_ranges[i].start + 1;
+	}
+
+	return -1;
+}
+
+static void pmic_shadow_init(void)
+{
+	uint8_t start = pmic_shadow_ranges[0].start;
+	uint8_t* p = pmic_shadow;
+	uint32_t val;
+	int ret;
+
+	// make sure the PMIC auto-increments register address on multi-byte
+	// reads, otherwise fall back to not using the shadow
+	pmic_xfers++;
+	if (rsb_read32(AXP803_RT_ADDR, start, &val))
+		return;
+
+	for (int i = 0; i < 4; i++) {
+		pmic_xfers++;
+		ret = rsb_read(AXP803_RT_ADDR, start + i);
+		if (ret < 0 || ret != ((val >> (8 * i)) & 0xff))
+			return;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(pmic_shadow_ranges); i++) {
+		for (unsigned reg = pmic_shadow_ranges[i].start;
+		     reg <= pmic_shadow_ranges[i].end; reg += 4) {
+			pmic_xfers++;
+			if (rsb_read32(AXP803_RT_ADDR, reg, &val))
+				return;
+
+			for (unsigned j = 0; j < 4 && reg + j <= pmic_shadow_ranges[i].end; j++)
+				*p++ = val >> (8 * j);
+		}
+	}
+
+	pmic_shadow_ready = true;
+}
+
+int pmic_write(uint8_t reg, uint8_t val)
+{
+	int idx = pmic_shadow_index(reg);
+	int ret;
+
+	if (idx >= 0 && pmic_shadow[idx] == val) {
+		pmic_xfers_avoided++;
+		return 0;
+	}
+
+	pmic_xfers++;
+	ret = rsb_write(AXP803_RT_ADDR, reg, val);
+	if (ret == 0 && idx >= 0)
+		pmic_shadow[idx] = val;
+
+	return ret;
+}
+
+int pmic_read(uint8_t reg_addr)
+{
+	int idx = pmic_shadow_index(reg_addr);
+
+	if (idx >= 0) {
+		pmic_xfers_avoided++;
+		return pmic_shadow[idx];
+	}
+
+	pmic_xfers++;
+	return rsb_read(AXP803_RT_ADDR, reg_addr);
+}
+
+void pmic_dump_stats(void)
+{
+	printf("PMIC: %u RSB transfers, %u avoided%s\n",
+	       pmic_xfers, pmic_xfers_avoided,
+	       pmic_shadow_ready ? "" : " (no shadow)");
+}
+
+#else
+
+static void pmic_shadow_init(void)
+{
+}
+
 int pmic_write(uint8_t reg, uint8_t val)
 {
 	return rsb_write(AXP803_RT_ADDR, reg, val);
@@ -230,18 +377,24 @@ int pmic_read(uint8_t reg_addr)
 	return rsb_read(AXP803_RT_ADDR, reg_addr);
 }
 
+void pmic_dump_stats(void)
+{
+}
+
+#endif
+
 int pmic_clrsetbits(uint8_t reg, uint8_t clr_mask, uint8_t set_mask)
 {
 	uint8_t regval;
 	int ret;
 
-	ret = rsb_read(AXP803_RT_ADDR, reg);
+	ret = pmic_read(reg);
 	if (ret < 0)
 		return ret;
 
 	regval = (ret & ~clr_mask) | set_mask;
 
-	return rsb_write(AXP803_RT_ADDR, reg, regval);
+	return pmic_write(reg, regval);
 }
 
 void pmic_poweroff(void)
@@ -276,16 +429,81 @@ int pmic_read_data(unsigned off)
 	return pmic_read(0x04 + off);
 }
 
+/*
+ * DCDC2 (CPUX) voltage: 0.5-1.2V in 10mV steps, 1.22-1.3V in 20mV steps.
+ * Output ramps at 2.5mV/us, so we remember when the last increase will be
+ * complete.
+ */
+static uint64_t dcdc2_settled_us;
+
+static unsigned dcdc2_reg_to_mv(unsigned reg)
+{
+	if (reg <= 0x46)
+		return 500 + reg * 10;
+
+	return 1200 + (reg - 0x46) * 20;
+}
+
+static unsigned dcdc2_mv_to_reg(unsigned mv)
+{
+	if (mv <= 1200)
+		return (mv - 500) / 10;
+
+	return 0x46 + (mv - 1200) / 20;
+}
+
+int pmic_set_cpux_voltage(unsigned mv)
+{
+	unsigned cur_mv;
+	int ret;
+
+	if (mv < 500 || mv > 1300)
+		return -EINVAL;
+
+	ret = pmic_read(0x21);
+	if (ret < 0)
+		return ret;
+
+	cur_mv = dcdc2_reg_to_mv(ret & 0x7f);
+
+	ret = pmic_write(0x21, dcdc2_mv_to_reg(mv));
+	if (ret)
+		return ret;
+
+	// verify the actual register, not the shadow
+	ret = rsb_read(AXP803_RT_ADDR, 0x21);
+	if (ret < 0)
+		return ret;
+	if ((ret & 0x7f) != dcdc2_mv_to_reg(mv))
+		return -EIO;
+
+	if (mv > cur_mv)
+		dcdc2_settled_us = timer_get_boot_us() + (mv - cur_mv) * 2 / 5 + 1;
+
+	return 0;
+}
+
+void pmic_wait_cpux_voltage(void)
+{
+	while (timer_get_boot_us() < dcdc2_settled_us);
+}
+
 void pmic_init(void)
 {
+	pmic_shadow_init();
+
         // enable DCDC/PWM chg freq spread
 	pmic_write(0x3b, 0x88);
 
         // up the DCDC2 voltage to 1.3V (CPUX)
         // default is 0.9V, and rampup speed is 2.5mV/us
         // so we need 400mV/2.5mV = 160us before being able to ramp up
-        // CPU frequency
+        // CPU frequency (see pmic_wait_cpux_voltage())
+#ifdef CPU_FAST_CLOCK
+        pmic_set_cpux_voltage(1300);
+#else
         pmic_write(0x21, 0x4b);
+#endif
 
 	// disable temp sensor charger effect
 	//pmic_setbits(0x84, BIT(2));
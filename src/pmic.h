@@ -39,5 +39,12 @@ int pmic_read_data(unsigned off);
 void pmic_dump_registers(void);
 void pmic_dump_status(void);
 
+/* print how many RSB transfers were avoided thanks to the register shadow */
+void pmic_dump_stats(void);
+
+/* set DCDC2 (CPUX) voltage and wait for the ramp-up to finish */
+int pmic_set_cpux_voltage(unsigned mv);
+void pmic_wait_cpux_voltage(void);
+
 /* initialize PMIC  */
 void pmic_init(void);
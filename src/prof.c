@@ -0,0 +1,429 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <endian.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * A tool for aggregating boot profiles collected from many boots.
+ *
+ * Inputs are files copied from /sys/firmware/devicetree/base/p-boot/:
+ *
+ * - timings: binary timeline (see timeline.h), 5 BE32 cells per record
+ * - log: text log from PBOOT_FDT_LOG builds
+ *
+ * Each input file is one boot. The tool prints percentiles of phase
+ * durations, PMU counter deltas, image load throughput and log event
+ * timestamps, optionally compared against a baseline set of boots
+ * (eg. from the previous p-boot build).
+ */
+
+#define RECORD_CELLS	5
+#define TL_FLAG_END	(1u << 0)
+
+// must match the phase enum in timeline.h
+static const char* phase_names[] = {
+	[1] = "dram-init",
+	[2] = "mmc-probe",
+	[3] = "image-load",
+	[4] = "fdt-fixup",
+	[5] = "display-init",
+	[6] = "atf-jump",
+};
+
+struct series {
+	char name[96];
+	const char* unit;
+	uint64_t* v;
+	unsigned n;
+	unsigned cap;
+};
+
+struct profile {
+	struct series* s;
+	unsigned n;
+	unsigned cap;
+	unsigned boots;
+};
+
+static struct profile cur, base;
+
+// {{{ Series
+
+static struct series* series_get(struct profile* p, const char* name, const char* unit)
+{
+	for (unsigned i = 0; i < p->n; i++)
+		if (!strcmp(p->s[i].name, name) && !strcmp(p->s[i].unit, unit))
+			return &p->s[i];
+
+	if (p->n == p->cap) {
+		p->cap = p->cap ? p->cap * 2 : 64;
+		p->s = realloc(p->s, p->cap * sizeof *p->s);
+		assert(p->s != NULL);
+	}
+
+	struct series* s = &p->s[p->n++];
+	memset(s, 0, sizeof *s);
+	snprintf(s->name, sizeof s->name, "%s", name);
+	s->unit = unit;
+	return s;
+}
+
+static void series_add(struct profile* p, const char* name, const char* unit, uint64_t v)
+{
+	struct series* s = series_get(p, name, unit);
+
+	if (s->n == s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 64;
+		s->v = realloc(s->v, s->cap * sizeof *s->v);
+		assert(s->v != NULL);
+	}
+
+	s->v[s->n++] = v;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void series_sort(struct profile* p)
+{
+	for (unsigned i = 0; i < p->n; i++)
+		qsort(p->s[i].v, p->s[i].n, sizeof(uint64_t), cmp_u64);
+}
+
+// nearest-rank percentile of a sorted series
+static uint64_t series_pct(struct series* s, unsigned pct)
+{
+	unsigned rank = (s->n * pct + 99) / 100;
+
+	if (s->n == 0)
+		return 0;
+
+	return s->v[rank ? rank - 1 : 0];
+}
+
+static struct series* series_find(struct profile* p, struct series* like)
+{
+	for (unsigned i = 0; i < p->n; i++)
+		if (!strcmp(p->s[i].name, like->name) && !strcmp(p->s[i].unit, like->unit))
+			return &p->s[i];
+
+	return NULL;
+}
+
+// }}}
+// {{{ Parsers
+
+static const char* phase_name(unsigned phase, unsigned arg, char* buf, size_t len)
+{
+	const char* name = phase < sizeof phase_names / sizeof phase_names[0] && phase_names[phase] ?
+		phase_names[phase] : "unknown";
+
+	if (phase == 2)
+		snprintf(buf, len, "%s/mmc%u", name, arg);
+	else if (phase == 3)
+		snprintf(buf, len, "%s/0x%08x", name, arg << 20);
+	else
+		snprintf(buf, len, "%s", name);
+
+	return buf;
+}
+
+static void parse_timeline(struct profile* p, const uint8_t* data, size_t len)
+{
+	struct {
+		uint32_t c[RECORD_CELLS];
+	} open[32];
+	unsigned n_open = 0;
+	char name[64];
+
+	for (size_t off = 0; off + RECORD_CELLS * 4 <= len; off += RECORD_CELLS * 4) {
+		uint32_t c[RECORD_CELLS];
+
+		for (int i = 0; i < RECORD_CELLS; i++)
+			c[i] = be32toh(*(const uint32_t*)(data + off + i * 4));
+
+		unsigned phase = c[0] >> 24;
+		unsigned flags = (c[0] >> 16) & 0xff;
+		unsigned arg = c[0] & 0xffff;
+
+		phase_name(phase, arg, name, sizeof name);
+
+		// single markers without an end record
+		if (phase == 6) {
+			series_add(p, name, "us@", c[1]);
+			continue;
+		}
+
+		if (!(flags & TL_FLAG_END)) {
+			if (n_open < 32)
+				memcpy(open[n_open++].c, c, sizeof c);
+			continue;
+		}
+
+		for (int i = n_open - 1; i >= 0; i--) {
+			if ((open[i].c[0] & ~0xff0000u) != (c[0] & ~0xff0000u))
+				continue;
+
+			// PMU counters are 32-bit and wrap, unsigned subtraction
+			// handles that
+			series_add(p, name, "us", c[1] - open[i].c[1]);
+			series_add(p, name, "cycles", c[2] - open[i].c[2]);
+			series_add(p, name, "insns", c[3] - open[i].c[3]);
+			series_add(p, name, "l1d-refills", c[4] - open[i].c[4]);
+
+			memmove(&open[i], &open[i + 1], (n_open - i - 1) * sizeof open[0]);
+			n_open--;
+			break;
+		}
+	}
+}
+
+// replace numbers in log messages, so that events can be matched across boots
+static void normalize_msg(char* dst, size_t len, const char* src)
+{
+	size_t j = 0;
+
+	while (*src && j + 1 < len) {
+		if (isdigit((unsigned char)*src)) {
+			dst[j++] = '#';
+			while (isxdigit((unsigned char)*src) || *src == 'x')
+				src++;
+			continue;
+		}
+
+		dst[j++] = *src++;
+	}
+
+	dst[j] = 0;
+}
+
+static void parse_log(struct profile* p, const char* data)
+{
+	char line[512], name[600], msg[512];
+	unsigned long long us, kib, rate;
+	unsigned dest;
+
+	while (*data) {
+		const char* eol = strchr(data, '\n');
+		size_t len = eol ? eol - data : strlen(data);
+
+		if (len >= sizeof line)
+			len = sizeof line - 1;
+		memcpy(line, data, len);
+		line[len] = 0;
+		data = eol ? eol + 1 : data + len;
+
+		// printed by bootfs_load_image()
+		char img[64];
+		if (sscanf(line, "Load %63s (%llu KiB) => 0x%x (%llu KiB/s)", img, &kib, &dest, &rate) == 4) {
+			snprintf(name, sizeof name, "load/%s", img);
+			series_add(p, name, "KiB/s", rate);
+			continue;
+		}
+
+		// "%d us: ..." progress messages
+		int n;
+		if (sscanf(line, "%llu us: %n", &us, &n) == 1) {
+			normalize_msg(msg, sizeof msg, line + n);
+			snprintf(name, sizeof name, "log/%s", msg);
+			series_add(p, name, "us@", us);
+		}
+	}
+}
+
+static void parse_file(struct profile* p, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		printf("ERROR: Can't open file '%s' (%s)\n", path, strerror(errno));
+		exit(1);
+	}
+
+	size_t cap = 64 * 1024, len = 0;
+	uint8_t* data = malloc(cap + 1);
+	assert(data != NULL);
+
+	while (true) {
+		size_t r = fread(data + len, 1, cap - len, f);
+		len += r;
+		if (len < cap)
+			break;
+
+		cap *= 2;
+		data = realloc(data, cap + 1);
+		assert(data != NULL);
+	}
+
+	fclose(f);
+	data[len] = 0;
+
+	// timeline records start with a small phase number, logs are text
+	if (len % (RECORD_CELLS * 4) == 0 && len > 0 && data[0] > 0 && data[0] < 32)
+		parse_timeline(p, data, len);
+	else
+		parse_log(p, (char*)data);
+
+	p->boots++;
+	free(data);
+}
+
+// }}}
+// {{{ Report
+
+static bool csv;
+static unsigned threshold = 5;
+
+static int report(void)
+{
+	int regressions = 0;
+	uint64_t max_p50 = 1;
+
+	series_sort(&cur);
+	series_sort(&base);
+
+	for (unsigned i = 0; i < cur.n; i++)
+		if (!strcmp(cur.s[i].unit, "us") && series_pct(&cur.s[i], 50) > max_p50)
+			max_p50 = series_pct(&cur.s[i], 50);
+
+	if (csv)
+		printf("series,unit,n,p50,p90,p99,max,base_p50,delta_pct\n");
+	else
+		printf("%u boots%s\n\n%-44s %-12s %6s %10s %10s %10s %10s %10s %7s\n",
+		       cur.boots, base.boots ? " (compared to baseline)" : "",
+		       "series", "unit", "n", "p50", "p90", "p99", "max", "base p50", "delta");
+
+	for (unsigned i = 0; i < cur.n; i++) {
+		struct series* s = &cur.s[i];
+		struct series* b = series_find(&base, s);
+		uint64_t p50 = series_pct(s, 50);
+		uint64_t b50 = b ? series_pct(b, 50) : 0;
+		double delta = b50 ? ((double)p50 - b50) * 100 / b50 : 0;
+		bool worse;
+
+		// lower is better, except for throughput
+		if (!strcmp(s->unit, "KiB/s"))
+			worse = b50 && -delta >= threshold;
+		else
+			worse = b50 && delta >= threshold;
+		if (worse)
+			regressions++;
+
+		if (csv) {
+			printf("\"%s\",%s,%u,%llu,%llu,%llu,%llu,%llu,%.1f\n",
+			       s->name, s->unit, s->n,
+			       (unsigned long long)p50,
+			       (unsigned long long)series_pct(s, 90),
+			       (unsigned long long)series_pct(s, 99),
+			       (unsigned long long)series_pct(s, 100),
+			       (unsigned long long)b50, delta);
+			continue;
+		}
+
+		printf("%-44.44s %-12s %6u %10llu %10llu %10llu %10llu",
+		       s->name, s->unit, s->n,
+		       (unsigned long long)p50,
+		       (unsigned long long)series_pct(s, 90),
+		       (unsigned long long)series_pct(s, 99),
+		       (unsigned long long)series_pct(s, 100));
+		if (b)
+			printf(" %10llu %+6.1f%%%s", (unsigned long long)b50, delta,
+			       worse ? " REGRESSION" : "");
+		printf("\n");
+	}
+
+	if (csv)
+		return regressions;
+
+	// flame-style overview of where the boot time goes
+	printf("\nPhase durations (p50):\n\n");
+	for (unsigned i = 0; i < cur.n; i++) {
+		struct series* s = &cur.s[i];
+		if (strcmp(s->unit, "us"))
+			continue;
+
+		uint64_t p50 = series_pct(s, 50);
+		int w = (int)(p50 * 60 / max_p50);
+
+		printf("%-32.32s %8llu us |", s->name, (unsigned long long)p50);
+		for (int j = 0; j < w; j++)
+			putchar('#');
+		printf("\n");
+	}
+
+	if (regressions)
+		printf("\n%d regressions over %u%%\n", regressions, threshold);
+
+	return regressions;
+}
+
+// }}}
+
+static void usage(const char* msg)
+{
+	printf("ERROR: %s\n", msg);
+	printf("Usage: p-boot-prof [-c] [-t <pct>] [-b <baseline-file>]... <file>...\n\n");
+	printf("Files are /sys/firmware/devicetree/base/p-boot/{timings,log} copies,\n");
+	printf("one file per boot.\n\n");
+	printf("  -c  CSV output\n");
+	printf("  -t  regression threshold in %% (default 5)\n");
+	printf("  -b  add a baseline boot profile\n");
+	exit(1);
+}
+
+int main(int ac, char* av[])
+{
+	int opt;
+
+	while ((opt = getopt(ac, av, "ct:b:")) != -1) {
+		switch (opt) {
+		case 'c':
+			csv = true;
+			break;
+		case 't':
+			threshold = atoi(optarg);
+			break;
+		case 'b':
+			parse_file(&base, optarg);
+			break;
+		default:
+			usage("invalid option");
+		}
+	}
+
+	if (optind >= ac)
+		usage("no input files");
+
+	for (int i = optind; i < ac; i++)
+		parse_file(&cur, av[i]);
+
+	return report() ? 2 : 0;
+}
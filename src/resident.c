@@ -0,0 +1,208 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <asm/io.h>
+#include <linux/libfdt.h>
+#include "debug.h"
+#include "mmu.h"
+#include "resident.h"
+
+/*
+ * A64 has no CRC engine. This runs over each image chunk as it's loaded on
+ * a cold boot, so it has to keep up with DRAM read bandwidth (p-boot-bench
+ * reports its throughput).
+ */
+uint64_t resident_csum(const void* p, size_t len)
+{
+	const uint64_t* w = p;
+	const uint8_t* t = p;
+	uint64_t a = 0, b = 0;
+	size_t i;
+
+	for (i = 0; i < len / 8; i++) {
+		a += w[i];
+		b += a;
+	}
+
+	for (i = len & ~7ul; i < len; i++) {
+		a += t[i];
+		b += a;
+	}
+
+	return a ^ (b << 32 | b >> 32);
+}
+
+#ifdef RESIDENT_IMAGES
+
+// descriptor area, not used by p-boot for anything else
+#define RESIDENT_DESC_PA	0x4bff0000u
+#define RESIDENT_DESC_SIZE	(16u << 10)
+
+#define RESIDENT_MAGIC_REG	((ulong)SUNXI_RTC_BASE + 0x110)
+#define RESIDENT_CSUM_REG	((ulong)SUNXI_RTC_BASE + 0x114)
+#define RESIDENT_MAGIC		0xb0070000u
+
+struct resident_chunk {
+	uint32_t off; // offset within bootfs
+	uint32_t dest;
+	uint32_t len;
+	uint32_t res;
+	uint64_t csum;
+};
+
+struct resident_desc {
+	uint64_t fs_id;
+	uint32_t n_chunks;
+	uint32_t res;
+	struct resident_chunk chunks[];
+};
+
+#define RESIDENT_MAX_CHUNKS \
+	((RESIDENT_DESC_SIZE - sizeof(struct resident_desc)) / \
+	 sizeof(struct resident_chunk))
+
+static struct resident_desc* prev_desc; // from the previous boot
+static struct resident_desc* next_desc; // for the next boot
+static uint32_t reused_kib;
+static uint32_t loaded_kib;
+static ulong csum_us; // checksumming of newly loaded chunks
+
+static size_t resident_desc_size(unsigned n_chunks)
+{
+	return sizeof(struct resident_desc) +
+		n_chunks * sizeof(struct resident_chunk);
+}
+
+// identifies bootfs contents, 0 = unknown
+static uint64_t resident_fs_id(struct bootfs* fs)
+{
+	if (!fs->sb->generation)
+		return 0;
+
+	return resident_csum(fs->sb, offsetof(struct bootfs_sb, res)) ^
+		resident_csum(fs->mmc->cid, sizeof fs->mmc->cid) * 31 ^
+		fs->mmc_offset;
+}
+
+void resident_init(void)
+{
+	struct resident_desc* d = (void*)(uintptr_t)RESIDENT_DESC_PA;
+	uint32_t magic = readl(RESIDENT_MAGIC_REG);
+	size_t size;
+
+	next_desc = zalloc(RESIDENT_DESC_SIZE);
+
+	if ((magic & 0xffff0000u) != RESIDENT_MAGIC)
+		return;
+
+	if (d->n_chunks != (magic & 0xffff) || d->n_chunks > RESIDENT_MAX_CHUNKS)
+		return;
+
+	size = resident_desc_size(d->n_chunks);
+	if ((uint32_t)resident_csum(d, size) != readl(RESIDENT_CSUM_REG))
+		return;
+
+	prev_desc = malloc(size);
+	memcpy(prev_desc, d, size);
+}
+
+static bool resident_chunk_valid(uint64_t fs_id, uint32_t dest, uint32_t off,
+				 uint32_t len, uint64_t* csum)
+{
+	if (!prev_desc || prev_desc->fs_id != fs_id)
+		return false;
+
+	for (unsigned i = 0; i < prev_desc->n_chunks; i++) {
+		struct resident_chunk* c = &prev_desc->chunks[i];
+
+		if (c->off == off && c->dest == dest && c->len == len) {
+			*csum = resident_csum((void*)(uintptr_t)dest, len);
+			return *csum == c->csum;
+		}
+	}
+
+	return false;
+}
+
+bool resident_load(struct bootfs* fs, uint32_t dest, uint32_t off, uint32_t len)
+{
+	uint64_t fs_id = resident_fs_id(fs);
+	uint64_t csum;
+
+	// reading back non-cacheable memory is too slow to be worth it
+	if (!fs_id || mmu_is_uncached(dest))
+		return mmc_read_data(fs->mmc, dest, fs->mmc_offset + off, len);
+
+	if (resident_chunk_valid(fs_id, dest, off, len, &csum)) {
+		reused_kib += len / 1024;
+	} else {
+		if (!mmc_read_data(fs->mmc, dest, fs->mmc_offset + off, len))
+			return false;
+
+		ulong ts = timer_get_boot_us();
+		csum = resident_csum((void*)(uintptr_t)dest, len);
+		csum_us += timer_get_boot_us() - ts;
+		loaded_kib += len / 1024;
+	}
+
+	// only images from the last used bootfs are recorded
+	if (next_desc->fs_id != fs_id) {
+		next_desc->fs_id = fs_id;
+		next_desc->n_chunks = 0;
+	}
+
+	if (next_desc->n_chunks < RESIDENT_MAX_CHUNKS) {
+		struct resident_chunk* c = &next_desc->chunks[next_desc->n_chunks++];
+
+		c->off = off;
+		c->dest = dest;
+		c->len = len;
+		c->csum = csum;
+	}
+
+	return true;
+}
+
+int resident_fdt_reserve(struct fdt_edit* e)
+{
+	return fdt_edit_add_mem_rsv(e, RESIDENT_DESC_PA, RESIDENT_DESC_SIZE);
+}
+
+void resident_commit(void)
+{
+	size_t size = resident_desc_size(next_desc->n_chunks);
+
+	printf("Resident images: %u KiB reused, %u KiB loaded (checksums %lu us)\n",
+	       reused_kib, loaded_kib, csum_us);
+
+	if (!next_desc->n_chunks) {
+		writel(0, RESIDENT_MAGIC_REG);
+		return;
+	}
+
+	memcpy((void*)(uintptr_t)RESIDENT_DESC_PA, next_desc, size);
+	mmu_mark_dirty(RESIDENT_DESC_PA, size);
+
+	writel((uint32_t)resident_csum(next_desc, size), RESIDENT_CSUM_REG);
+	writel(RESIDENT_MAGIC | next_desc->n_chunks, RESIDENT_MAGIC_REG);
+}
+
+#endif
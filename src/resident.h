@@ -0,0 +1,55 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "storage.h"
+#include "fdtedit.h"
+
+/*
+ * Resident images
+ *
+ * DRAM contents usually survive a watchdog reset or a crash reboot. p-boot
+ * records where each chunk of each boot image was loaded and its checksum,
+ * and on the next boot skips reading chunks that are still intact in
+ * DRAM. The record is kept in a small DRAM area reserved in the FDT, and
+ * is validated via RTC data registers 4 and 5.
+ *
+ * Chunks are only reused if the bootfs was written by a p-boot-conf that
+ * stores a generation number in the superblock.
+ */
+
+uint64_t resident_csum(const void* p, size_t len);
+
+#ifdef RESIDENT_IMAGES
+
+void resident_init(void);
+bool resident_load(struct bootfs* fs, uint32_t dest, uint32_t off, uint32_t len);
+int resident_fdt_reserve(struct fdt_edit* e);
+void resident_commit(void);
+
+#else
+
+#define resident_init() do {} while (0)
+#define resident_load(fs, dest, off, len) \
+	mmc_read_data((fs)->mmc, dest, (fs)->mmc_offset + (off), len)
+#define resident_fdt_reserve(e) 0
+#define resident_commit() do {} while (0)
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <common.h>
+#include "sched.h"
+
+#ifdef BOOT_TASKS
+
+static struct task* sched_queue;
+
+void task_schedule_at(struct task* t, uint64_t at_us)
+{
+	struct task** p;
+
+	if (t->pending) {
+		for (p = &sched_queue; *p != t; p = &(*p)->next);
+		*p = t->next;
+	}
+
+	// keep FIFO order for tasks with the same deadline
+	for (p = &sched_queue; *p && (*p)->at <= at_us; p = &(*p)->next);
+
+	t->at = at_us;
+	t->next = *p;
+	t->pending = true;
+	*p = t;
+}
+
+void task_schedule(struct task* t, unsigned delay_us)
+{
+	task_schedule_at(t, timer_get_boot_us() + delay_us);
+}
+
+void sched_poll(void)
+{
+	uint64_t now = timer_get_boot_us();
+
+	while (sched_queue && sched_queue->at <= now) {
+		struct task* t = sched_queue;
+
+		sched_queue = t->next;
+		t->pending = false;
+		t->run(t);
+	}
+}
+
+void sched_wait(struct task* t)
+{
+	while (t->pending)
+		sched_poll();
+}
+
+void sched_wait_all(void)
+{
+	while (sched_queue)
+		sched_poll();
+}
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common.h>
+
+/*
+ * Tiny run-to-completion task scheduler
+ *
+ * Tasks are queued ordered by the time (in timer_get_boot_us() units)
+ * at which they should run. Nothing is preemptive: queued tasks only
+ * run from sched_poll()/sched_wait(), which the main flow calls whenever
+ * it would otherwise just wait. A task that needs to wait for hardware
+ * re-schedules itself and returns.
+ *
+ * Only built with -DBOOT_TASKS, otherwise the boot flow waits in place,
+ * and sched_poll()/sched_wait_all() do nothing.
+ */
+
+struct task {
+	void (*run)(struct task* t);
+	uint64_t at;
+	struct task* next;
+	bool pending;
+};
+
+#ifdef BOOT_TASKS
+
+void task_schedule_at(struct task* t, uint64_t at_us);
+void task_schedule(struct task* t, unsigned delay_us);
+
+static inline bool task_pending(struct task* t)
+{
+	return t->pending;
+}
+
+/* run all tasks that are due now */
+void sched_poll(void);
+
+/* run tasks until t has run */
+void sched_wait(struct task* t);
+
+/* run tasks until the queue is empty */
+void sched_wait_all(void);
+
+#else
+
+#define sched_poll()
+#define sched_wait_all()
+
+#endif
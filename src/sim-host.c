@@ -0,0 +1,361 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "sim.h"
+
+/*
+ * Host side of p-boot-sim: runs the p-boot boot flow against disk image
+ * files, with a simple MMC latency/throughput model, and reports simulated
+ * time spent in each boot phase.
+ *
+ * Each boot runs in a forked process, so that p-boot's static data starts
+ * fresh, like after a SoC reset. DRAM and register files are shared between
+ * boots, so that what p-boot leaves in DRAM and RTC survives a reboot.
+ *
+ * Usage: p-boot-sim [options] -s sd.img [-e emmc.img]
+ */
+
+// physical memory regions used by p-boot
+#define SRAM_PA		0x00010000ul	// SRAM A1, SRAM C (SPL_ADDR)
+#define SRAM_SIZE	0x00040000ul
+#define IO_PA		0x01c00000ul	// SID, CCU, PIO, timer, RTC, R_PIO
+#define IO_SIZE		0x00400000ul
+#define DRAM_PA		0x40000000ul
+
+#define SID_PA		0x01c14200ul
+#define RTC_PA		0x01f00000ul
+
+// images that only contain bootfs get a virtual MBR with one partition
+// starting at 1 MiB
+#define VIRT_PART_OFF	(1024 * 1024)
+
+struct sim_opts sim_opts = {
+	.dram_size = 2048ul << 20,
+	.board_rev = 2,
+};
+
+struct sim_mmc {
+	const char* path;
+	int fd;
+	uint64_t size;
+	bool virt_mbr;
+
+	// model
+	unsigned probe_us;
+	unsigned latency_us;	// per read request
+	unsigned kib_per_s;
+
+	// stats
+	unsigned reads;
+	uint64_t bytes;
+};
+
+// rough numbers for HS SD cards and eMMC on the PinePhone
+static struct sim_mmc mmcs[3] = {
+	[0] = { .fd = -1, .probe_us = 30000, .latency_us = 150, .kib_per_s = 21000 },
+	[2] = { .fd = -1, .probe_us = 40000, .latency_us = 100, .kib_per_s = 42000 },
+};
+
+// {{{ Time
+
+static uint64_t model_us;
+static double cpu_scale;
+static uint64_t host_start_us;
+static uint64_t host_excluded_us;
+
+static uint64_t host_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+unsigned long sim_time_us(void)
+{
+	uint64_t cpu_us = 0;
+
+	if (cpu_scale > 0)
+		cpu_us = (host_us() - host_start_us - host_excluded_us) * cpu_scale;
+
+	// each timer read costs 1 us, so that busy-waiting loops finish
+	return ++model_us + cpu_us;
+}
+
+void sim_advance_us(unsigned long us)
+{
+	model_us += us;
+}
+
+// }}}
+// {{{ MMC
+
+int sim_mmc_probe(int mmc_no)
+{
+	struct sim_mmc* m = &mmcs[mmc_no];
+
+	// failed probe times out in about the same time
+	model_us += m->probe_us;
+
+	return m->fd >= 0 ? 0 : -1;
+}
+
+static void virt_mbr(struct sim_mmc* m, uint8_t* sector)
+{
+	uint8_t* p = sector + 0x1be;
+	uint32_t start = VIRT_PART_OFF / 512;
+	uint32_t size = (m->size + 511) / 512;
+
+	memset(sector, 0, 512);
+	p[0] = 0x80;
+	p[4] = 0x83;
+	memcpy(p + 8, &start, 4);
+	memcpy(p + 12, &size, 4);
+	sector[0x1fe] = 0x55;
+	sector[0x1ff] = 0xaa;
+}
+
+int sim_mmc_read(int mmc_no, unsigned long long off, unsigned long len, void* dst)
+{
+	struct sim_mmc* m = &mmcs[mmc_no];
+	uint64_t t0 = host_us();
+	uint8_t* d = dst;
+	ssize_t ret;
+
+	if (m->fd < 0)
+		return -1;
+
+	m->reads++;
+	m->bytes += len;
+	model_us += m->latency_us + (uint64_t)len * 1000000 / 1024 / m->kib_per_s;
+
+	if (m->virt_mbr) {
+		if (off < VIRT_PART_OFF) {
+			unsigned long n = len < VIRT_PART_OFF - off ? len : VIRT_PART_OFF - off;
+
+			memset(d, 0, n);
+			if (off == 0)
+				virt_mbr(m, d);
+
+			d += n;
+			off += n;
+			len -= n;
+		}
+
+		off -= VIRT_PART_OFF;
+	}
+
+	// reads past the end of the image return zeroes
+	memset(d, 0, len);
+	ret = len ? pread(m->fd, d, len, off) : 0;
+
+	host_excluded_us += host_us() - t0;
+
+	return ret < 0 ? -1 : 0;
+}
+
+static void mmc_open(struct sim_mmc* m, const char* path)
+{
+	struct stat st;
+	char magic[8];
+
+	m->path = path;
+	m->fd = open(path, O_RDONLY);
+	if (m->fd < 0 || fstat(m->fd, &st) < 0) {
+		fprintf(stderr, "ERROR: Can't open '%s' (%s)\n", path, strerror(errno));
+		exit(1);
+	}
+
+	m->size = st.st_size;
+	m->virt_mbr = pread(m->fd, magic, 8, 0) == 8 && !memcmp(magic, ":BOOTFS:", 8);
+}
+
+// }}}
+// {{{ Boot
+
+// main.c
+void main_sram_only(void);
+void pboot_main(void);
+
+int sim_write_file(const char* path, const void* data, unsigned long len)
+{
+	FILE* f = fopen(path, "wb");
+
+	if (!f || fwrite(data, 1, len, f) != len) {
+		fprintf(stderr, "ERROR: Can't write '%s' (%s)\n", path, strerror(errno));
+		if (f)
+			fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+void sim_exit(int code)
+{
+	for (int i = 0; i < 3; i++)
+		if (mmcs[i].reads)
+			printf("sim: %s: %u reads, %llu KiB\n", i ? "eMMC" : "SD",
+			       mmcs[i].reads, (unsigned long long)mmcs[i].bytes / 1024);
+
+	fflush(stdout);
+	_exit(code);
+}
+
+static void* map_region(unsigned long pa, unsigned long size)
+{
+	void* p = mmap((void*)pa, size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE,
+		       -1, 0);
+	if (p != (void*)pa) {
+		fprintf(stderr, "ERROR: Can't map 0x%08lx-0x%08lx (%s)\n",
+			pa, pa + size, strerror(errno));
+		exit(1);
+	}
+
+	return p;
+}
+
+static void usage(void)
+{
+	printf(
+		"Usage: p-boot-sim [options] -s sd.img [-e emmc.img]\n\n"
+		"Images are either whole disk images, or bootfs images created\n"
+		"by p-boot-conf.\n\n"
+		"Options:\n"
+		"  -s IMG     SD card image\n"
+		"  -e IMG     eMMC image\n"
+		"  -S/-E L,T,P  SD/eMMC model: latency per read (us),\n"
+		"             throughput (KiB/s), probe time (us)\n"
+		"  -c SCALE   also charge host CPU time multiplied by SCALE\n"
+		"  -b N       boot configuration selected via RTC (0-31 eMMC, 32-63 SD)\n"
+		"  -k KEY     pressed key (none, up, down)\n"
+		"  -p         privacy mode\n"
+		"  -r REV     board revision (1 or 2)\n"
+		"  -m MIB     DRAM size\n"
+		"  -n N       number of consecutive (warm) boots\n"
+		"  -o FILE    write the final FDT\n"
+		"  -t FILE    write /p-boot/timings\n"
+		"  -q         don't print p-boot console output\n");
+	exit(1);
+}
+
+static void parse_model(struct sim_mmc* m, char* arg)
+{
+	if (sscanf(arg, "%u,%u,%u", &m->latency_us, &m->kib_per_s, &m->probe_us) < 2 ||
+	    !m->kib_per_s)
+		usage();
+}
+
+int main(int ac, char* av[])
+{
+	uint32_t rtc_flags = 0;
+	int bootsel = -1;
+	int boots = 1;
+	int ret = 0;
+	int opt;
+
+	while ((opt = getopt(ac, av, "s:e:S:E:c:b:k:pr:m:n:o:t:qh")) != -1) {
+		switch (opt) {
+		case 's': mmc_open(&mmcs[0], optarg); break;
+		case 'e': mmc_open(&mmcs[2], optarg); break;
+		case 'S': parse_model(&mmcs[0], optarg); break;
+		case 'E': parse_model(&mmcs[2], optarg); break;
+		case 'c': cpu_scale = atof(optarg); break;
+		case 'b': bootsel = atoi(optarg); break;
+		case 'k':
+			if (!strcmp(optarg, "down"))
+				sim_opts.key = 1;
+			else if (!strcmp(optarg, "up"))
+				sim_opts.key = 2;
+			else if (strcmp(optarg, "none"))
+				usage();
+			break;
+		case 'p': rtc_flags |= 1; break;
+		case 'r': sim_opts.board_rev = atoi(optarg); break;
+		case 'm': sim_opts.dram_size = strtoul(optarg, NULL, 0) << 20; break;
+		case 'n': boots = atoi(optarg); break;
+		case 'o': sim_opts.dtb_out = optarg; break;
+		case 't': sim_opts.timings_out = optarg; break;
+		case 'q': sim_opts.quiet = 1; break;
+		default: usage();
+		}
+	}
+
+	if (optind != ac || (mmcs[0].fd < 0 && mmcs[2].fd < 0))
+		usage();
+
+	uint8_t* sram = map_region(SRAM_PA, SRAM_SIZE);
+	map_region(IO_PA, IO_SIZE);
+	map_region(DRAM_PA, sim_opts.dram_size);
+
+	// eGON header of the SPL, booted from the SD card
+	memcpy(sram + 4, "eGON.BT0", 8);
+	sram[0x28] = mmcs[0].fd >= 0 ? 0 : 2;
+
+	static const uint32_t sid[4] = { 0x92c000ba, 0x2c4c0304, 0x75b3004d, 0x0c8e0a4c };
+	memcpy((void*)SID_PA, sid, sizeof sid);
+
+	// persistent boot selection and flags
+	*(volatile uint32_t*)(RTC_PA + 0x100) = (rtc_flags << 16) | ((bootsel + 1) & 0xff);
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	for (int i = 0; i < boots; i++) {
+		int status;
+
+		printf("sim: boot %d\n", i);
+		fflush(stdout);
+
+		pid_t pid = fork();
+		if (pid == 0) {
+			host_start_us = host_us();
+			main_sram_only();
+			pboot_main();
+			sim_exit(1);
+		} else if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+			perror("fork");
+			return 1;
+		}
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			printf("sim: boot %d failed\n", i);
+			ret = 1;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+// }}}
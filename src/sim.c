@@ -0,0 +1,373 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <common.h>
+#include <stdarg.h>
+#include <asm/io.h>
+#include <asm/arch/gpio.h>
+#include <asm/arch/dram.h>
+#include <asm-generic/gpio.h>
+#include <cpu_func.h>
+#include <mmc.h>
+#include <atf_common.h>
+#include <linux/libfdt.h>
+#include "debug.h"
+#include "mmu.h"
+#include "pmic.h"
+#include "ccu.h"
+#include "lradc.h"
+#include "timeline.h"
+#include "sim.h"
+
+/*
+ * Stand-ins for p-boot's hardware drivers, see sim.h.
+ */
+
+// host libc (libfdt_env.h maps strtoul to simple_strtoul)
+#undef strtoul
+int vprintf(const char *fmt, va_list ap);
+int putchar(int c);
+int fflush(void *stream);
+unsigned long strtoul(const char *cp, char **endp, int base);
+
+// {{{ Timer
+
+ulong timer_get_boot_us(void)
+{
+	return sim_time_us();
+}
+
+void udelay(unsigned long usec)
+{
+	sim_advance_us(usec);
+}
+
+// }}}
+// {{{ Console
+
+void console_init(void)
+{
+}
+
+void console_flush(void)
+{
+	fflush(NULL);
+}
+
+void real_putc(char c)
+{
+	if (!sim_opts.quiet)
+		putchar(c);
+}
+
+void real_puts(const char* s)
+{
+	while (*s)
+		real_putc(*s++);
+}
+
+void real_printf(const char* fmt, ...)
+{
+	va_list ap;
+
+	if (sim_opts.quiet)
+		return;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+void real_put_hex(unsigned long long value, int align, int pad0)
+{
+	real_printf(pad0 ? "%0*llx" : "%*llx", align, value);
+}
+
+// }}}
+// {{{ SoC
+
+void ccu_init(void)
+{
+}
+
+void ccu_upclock(void)
+{
+}
+
+int ccu_set_cpux_opp(unsigned int clk, unsigned int mv)
+{
+	return 0;
+}
+
+unsigned long sunxi_dram_init(void)
+{
+	return sim_opts.dram_size;
+}
+
+void mctl_set_mbus_profile(int profile)
+{
+}
+
+void icache_enable(void)
+{
+}
+
+void mmu_setup(uint64_t dram_size)
+{
+}
+
+void mmu_mark_dirty(uintptr_t start, size_t len)
+{
+}
+
+void mmu_clean_dirty(void)
+{
+}
+
+// p-boot-sim starts each boot from main_sram_only()
+uint32_t _dram_stack_top;
+
+void _atf_handoff(struct entry_point_info *ep_info, void *fdt_blob,
+		  uintptr_t magic, uintptr_t atf_entry)
+{
+	static const char* phase_names[] = {
+		[TL_DRAM_INIT] = "dram-init",
+		[TL_MMC_PROBE] = "mmc-probe",
+		[TL_IMAGE_LOAD] = "image-load",
+		[TL_FDT_FIXUP] = "fdt-fixup",
+		[TL_DISPLAY_INIT] = "display-init",
+		[TL_ATF_JUMP] = "atf-jump",
+	};
+	const fdt32_t* r = tl_data();
+	unsigned n = tl_size() / TL_RECORD_SIZE;
+	ulong now = sim_time_us();
+
+	sim_opts.quiet = 0;
+	printf("sim: boot phases:\n");
+
+	// pair each begin record with the next matching end record
+	for (unsigned i = 0; i < n; i++) {
+		uint32_t id = fdt32_to_cpu(r[i * 5]);
+		unsigned phase = id >> 24;
+		uint32_t begin = fdt32_to_cpu(r[i * 5 + 1]);
+		uint32_t end = now;
+
+		if (id & (TL_FLAG_END << 16))
+			continue;
+
+		for (unsigned j = i + 1; j < n; j++) {
+			if (fdt32_to_cpu(r[j * 5]) == (id | (TL_FLAG_END << 16))) {
+				end = fdt32_to_cpu(r[j * 5 + 1]);
+				break;
+			}
+		}
+
+		printf("sim:   %-12s %5u %8u us @ %8u us\n",
+		       phase < ARRAY_SIZE(phase_names) && phase_names[phase] ?
+		       phase_names[phase] : "unknown",
+		       id & 0xffff, end - begin, begin);
+	}
+
+	printf("sim: jump to ATF at %lu us, FDT %u bytes\n",
+	       now, fdt_totalsize(fdt_blob));
+
+	if (sim_opts.dtb_out)
+		sim_write_file(sim_opts.dtb_out, fdt_blob, fdt_totalsize(fdt_blob));
+	if (sim_opts.timings_out)
+		sim_write_file(sim_opts.timings_out, tl_data(), tl_size());
+
+	sim_exit(0);
+}
+
+// fdt_overlay.c needs this, see lib.c
+unsigned long simple_strtoul(const char *cp, char **endp, unsigned int base)
+{
+	return strtoul(cp, endp, base);
+}
+
+// }}}
+// {{{ GPIO, LRADC
+
+void sunxi_gpio_set_cfgpin(u32 pin, u32 val)
+{
+}
+
+int sunxi_gpio_set_drv(u32 pin, u32 val)
+{
+	return 0;
+}
+
+int sunxi_gpio_set_pull(u32 pin, u32 val)
+{
+	return 0;
+}
+
+int gpio_direction_output(unsigned gpio, int value)
+{
+	return 0;
+}
+
+int gpio_get_value(unsigned gpio)
+{
+	/* PL6 is pulled low by the modem on v1.2. */
+	if (gpio == SUNXI_GPL(6))
+		return sim_opts.board_rev != 2;
+
+	return 0;
+}
+
+void lradc_enable(void)
+{
+}
+
+void lradc_disable(void)
+{
+}
+
+int lradc_get_pressed_key(void)
+{
+	return sim_opts.key;
+}
+
+// }}}
+// {{{ PMIC
+
+// register file of the PMIC, each RSB transfer takes about 20 us
+#define PMIC_ACCESS_US 20
+
+static uint8_t pmic_regs[256];
+
+int rsb_init(void)
+{
+	// battery present, powered up by the power key
+	pmic_regs[0x00] = 0x00;
+	pmic_regs[0x01] = BIT(5) | BIT(4);
+	pmic_regs[0x02] = BIT(0);
+
+	// battery capacity is valid, 80%
+	pmic_regs[0xb9] = 0x80 | 80;
+
+	return 0;
+}
+
+void pmic_init(void)
+{
+}
+
+int pmic_read(uint8_t reg_addr)
+{
+	sim_advance_us(PMIC_ACCESS_US);
+	return pmic_regs[reg_addr];
+}
+
+int pmic_write(uint8_t reg, uint8_t val)
+{
+	sim_advance_us(PMIC_ACCESS_US);
+	pmic_regs[reg] = val;
+	return 0;
+}
+
+int pmic_clrsetbits(uint8_t reg, uint8_t clr_mask, uint8_t set_mask)
+{
+	return pmic_write(reg, (pmic_read(reg) & ~clr_mask) | set_mask);
+}
+
+void pmic_dump_stats(void)
+{
+}
+
+void pmic_poweroff(void)
+{
+	printf("sim: power off at %lu us\n", sim_time_us());
+	sim_exit(1);
+}
+
+void pmic_reboot(void)
+{
+	printf("sim: reboot at %lu us\n", sim_time_us());
+	sim_exit(1);
+}
+
+// }}}
+// {{{ MMC
+
+static int sim_mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
+			    struct mmc_data *data)
+{
+	return -1;
+}
+
+static const struct mmc_ops sim_mmc_ops = {
+	.send_cmd = sim_mmc_send_cmd,
+};
+
+static const struct mmc_config sim_mmc_configs[3] = {
+	[0] = {
+		.name = "SD",
+		.ops = &sim_mmc_ops,
+		.f_min = 400000,
+		.f_max = 52000000,
+		.b_max = 65535,
+	},
+	[2] = {
+		.name = "eMMC",
+		.ops = &sim_mmc_ops,
+		.f_min = 400000,
+		.f_max = 52000000,
+		.b_max = 65535,
+	},
+};
+
+struct mmc *sunxi_mmc_init(int sdc_no)
+{
+	struct mmc* mmc;
+
+	if (sdc_no != 0 && sdc_no != 2)
+		return NULL;
+
+	if (sim_mmc_probe(sdc_no) < 0)
+		return NULL;
+
+	mmc = mmc_create(&sim_mmc_configs[sdc_no], NULL);
+	if (!mmc)
+		return NULL;
+
+	mmc->read_bl_len = 512;
+	mmc->block_dev.blksz = 512;
+	mmc->block_dev.devnum = sdc_no;
+
+	return mmc;
+}
+
+int mmc_init(struct mmc *mmc)
+{
+	return 0;
+}
+
+ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
+		void *dst)
+{
+	if (sim_mmc_read(block_dev->devnum, (uint64_t)start * 512,
+			 blkcnt * 512, dst) < 0)
+		return 0;
+
+	return blkcnt;
+}
+
+// }}}
@@ -0,0 +1,70 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * p-boot host simulation
+ *
+ * p-boot-sim runs main.c, storage.c, resident.c and libfdt on the host.
+ * sim.c replaces the hardware drivers and is built in the same U-Boot
+ * environment as p-boot itself (this header is force-included there).
+ * sim-host.c is built against the host libc. It sets up the DRAM arena and
+ * fake register files at their physical addresses, keeps the simulated
+ * time and backs MMC devices with disk image files.
+ *
+ * Only plain C types are used in the interface between the two.
+ */
+
+#ifdef __UBOOT__
+
+// barriers are not needed on the host, and the ARM ones don't assemble
+#include <asm/barriers.h>
+#undef ISB
+#undef DSB
+#undef DMB
+#define ISB	asm volatile ("" : : : "memory")
+#define DSB	asm volatile ("" : : : "memory")
+#define DMB	asm volatile ("" : : : "memory")
+
+#endif
+
+struct sim_opts {
+	unsigned long dram_size;
+	int board_rev;
+	int key;		// KEY_* from lradc.h
+	int quiet;		// don't print p-boot's console output
+
+	// output files, NULL if not requested
+	const char* dtb_out;
+	const char* timings_out;
+};
+
+extern struct sim_opts sim_opts;
+
+// simulated time since SoC reset, also charges CPU time if enabled
+unsigned long sim_time_us(void);
+void sim_advance_us(unsigned long us);
+
+// MMC devices backed by disk image files (mmc_no 0 = SD, 2 = eMMC)
+int sim_mmc_probe(int mmc_no);
+int sim_mmc_read(int mmc_no, unsigned long long off, unsigned long len, void* dst);
+
+int sim_write_file(const char* path, const void* data, unsigned long len);
+void sim_exit(int code) __attribute__((noreturn));
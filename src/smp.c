@@ -0,0 +1,211 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef SMP_WORKERS
+
+#include <common.h>
+#include <malloc.h>
+#include <asm/io.h>
+#include <asm/system.h>
+#include <cpu_func.h>
+#include "mmu.h"
+#include "smp.h"
+
+#define CPUCFG_BASE		0x01700000ul
+#define CPUCFG_CLS_CTRL0	(CPUCFG_BASE + 0x0000)
+#define CPUCFG_DBG_CTRL1	(CPUCFG_BASE + 0x0024)
+#define CPUCFG_CPU_STATUS	(CPUCFG_BASE + 0x0030)
+#define CPUCFG_RST_CTRL		(CPUCFG_BASE + 0x0080)
+#define CPUCFG_RVBAR_LO(n)	(CPUCFG_BASE + 0x00a0 + (n) * 8)
+#define CPUCFG_RVBAR_HI(n)	(CPUCFG_BASE + 0x00a4 + (n) * 8)
+
+#define R_CPUCFG_PWRON_RST	(0x01f01c00ul + 0x0030)
+#define R_PRCM_PWROFF_GATING	(0x01f01400ul + 0x0100)
+#define R_PRCM_PWR_SWITCH(n)	(0x01f01400ul + 0x0140 + (n) * 4)
+
+#define CPU_STATUS_STANDBYWFI(n)	BIT(16 + (n))
+
+#define SMP_STACK_SIZE		(16 * 1024)
+
+struct smp_cpu {
+	smp_work_fn fn; // NULL when idle
+	void* arg;
+	bool online;
+} __aligned(64);
+
+static struct smp_cpu smp_cpus[SMP_CPUS];
+static bool smp_started;
+
+// read by secondary cores before their MMU is on (see start.S)
+uint64_t smp_stack_tops[SMP_CPUS];
+
+extern char _secondary_reset[];
+void __asm_dcache_level(int level, int invalidate_only);
+
+static void smp_off_work(void* arg)
+{
+	uint64_t ectlr;
+
+	// leave coherency with everything written back to L2
+	set_sctlr(get_sctlr() & ~CR_C);
+	__asm_dcache_level(0, 0);
+
+	asm volatile("mrs %0, S3_1_C15_C2_1" : "=r" (ectlr));
+	ectlr &= ~BIT(6); // SMPEN
+	asm volatile("msr S3_1_C15_C2_1, %0" : : "r" (ectlr));
+	asm volatile("isb; dsb sy");
+
+	while (true)
+		asm volatile("wfi");
+}
+
+void smp_secondary_main(unsigned cpu)
+{
+	struct smp_cpu* c = &smp_cpus[cpu];
+
+	mmu_setup_secondary();
+
+	__atomic_store_n(&c->online, true, __ATOMIC_RELEASE);
+	asm volatile("dsb ish; sev");
+
+	while (true) {
+		smp_work_fn fn;
+
+		while (!(fn = __atomic_load_n(&c->fn, __ATOMIC_ACQUIRE)))
+			asm volatile("wfe");
+
+		fn(c->arg);
+
+		__atomic_store_n(&c->fn, NULL, __ATOMIC_RELEASE);
+		asm volatile("dsb ish; sev");
+	}
+}
+
+static void smp_cpu_on(unsigned cpu)
+{
+	uintptr_t entry = (uintptr_t)_secondary_reset;
+
+	writel(entry, CPUCFG_RVBAR_LO(cpu));
+	writel(0, CPUCFG_RVBAR_HI(cpu));
+
+	// assert core and power-on reset, start in AArch64
+	clrbits_le32(CPUCFG_RST_CTRL, BIT(cpu));
+	clrbits_le32(R_CPUCFG_PWRON_RST, BIT(cpu));
+	setbits_le32(CPUCFG_CLS_CTRL0, BIT(24 + cpu));
+
+	// power on sequence from the Allwinner BSP
+	if (readl(R_PRCM_PWR_SWITCH(cpu))) {
+		writel(0xfe, R_PRCM_PWR_SWITCH(cpu));
+		writel(0xf8, R_PRCM_PWR_SWITCH(cpu));
+		writel(0xe0, R_PRCM_PWR_SWITCH(cpu));
+		writel(0x80, R_PRCM_PWR_SWITCH(cpu));
+		writel(0x00, R_PRCM_PWR_SWITCH(cpu));
+		udelay(1);
+	}
+
+	// release output clamps and resets
+	clrbits_le32(R_PRCM_PWROFF_GATING, BIT(cpu));
+	setbits_le32(R_CPUCFG_PWRON_RST, BIT(cpu));
+	setbits_le32(CPUCFG_RST_CTRL, BIT(cpu));
+}
+
+static void smp_cpu_off(unsigned cpu)
+{
+	clrbits_le32(CPUCFG_DBG_CTRL1, BIT(cpu));
+	setbits_le32(R_PRCM_PWROFF_GATING, BIT(cpu));
+	clrbits_le32(R_CPUCFG_PWRON_RST, BIT(cpu));
+	clrbits_le32(CPUCFG_RST_CTRL, BIT(cpu));
+	writel(0xff, R_PRCM_PWR_SWITCH(cpu));
+}
+
+void smp_init(void)
+{
+	if (smp_started)
+		return;
+
+	size_t stacks_size = SMP_STACK_SIZE * (SMP_CPUS - 1);
+	uintptr_t stacks = (uintptr_t)malloc(stacks_size);
+
+	for (unsigned cpu = 1; cpu < SMP_CPUS; cpu++)
+		smp_stack_tops[cpu] = stacks + SMP_STACK_SIZE * cpu;
+
+	// secondary cores read these and push their first frames with
+	// caches off
+	flush_dcache_range((uintptr_t)smp_stack_tops,
+			   (uintptr_t)smp_stack_tops + sizeof smp_stack_tops);
+	flush_dcache_range(stacks, stacks + stacks_size);
+
+	for (unsigned cpu = 1; cpu < SMP_CPUS; cpu++)
+		smp_cpu_on(cpu);
+
+	smp_started = true;
+}
+
+// returns false if the core is not (yet) online or is busy
+bool smp_run(unsigned cpu, smp_work_fn fn, void* arg)
+{
+	struct smp_cpu* c = &smp_cpus[cpu];
+
+	if (cpu == 0 || cpu >= SMP_CPUS)
+		return false;
+	if (!__atomic_load_n(&c->online, __ATOMIC_ACQUIRE) ||
+	    __atomic_load_n(&c->fn, __ATOMIC_ACQUIRE))
+		return false;
+
+	c->arg = arg;
+	__atomic_store_n(&c->fn, fn, __ATOMIC_RELEASE);
+	asm volatile("dsb ish; sev");
+
+	return true;
+}
+
+void smp_wait(unsigned cpu)
+{
+	struct smp_cpu* c = &smp_cpus[cpu];
+
+	while (__atomic_load_n(&c->fn, __ATOMIC_ACQUIRE))
+		asm volatile("wfe");
+}
+
+void smp_fini(void)
+{
+	if (!smp_started)
+		return;
+
+	for (unsigned cpu = 1; cpu < SMP_CPUS; cpu++) {
+		struct smp_cpu* c = &smp_cpus[cpu];
+
+		if (__atomic_load_n(&c->online, __ATOMIC_ACQUIRE)) {
+			smp_wait(cpu);
+			smp_run(cpu, smp_off_work, NULL);
+
+			ulong end = timer_get_boot_us() + 10000;
+			while (!(readl(CPUCFG_CPU_STATUS) & CPU_STATUS_STANDBYWFI(cpu)))
+				if (timer_get_boot_us() > end)
+					break;
+		}
+
+		smp_cpu_off(cpu);
+		c->online = false;
+	}
+
+	smp_started = false;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common.h>
+
+/*
+ * Secondary core worker pool
+ *
+ * smp_init() releases CPU1-3 from reset. Each core enables the MMU with
+ * CPU0's page tables and waits in wfe for a work item. Work functions
+ * run at EL3 with the same memory map as CPU0 and must not call into
+ * non-reentrant code (printf, malloc, MMC, libfdt on a shared blob, ...).
+ *
+ * smp_fini() must be called before jumping to ATF, it puts the cores
+ * back into reset and removes their power, so that PSCI owns them.
+ *
+ * The pool is only built with -DSMP_WORKERS (p-boot-dtest), other
+ * variants get an empty smp_fini().
+ */
+
+#define SMP_CPUS 4
+
+typedef void (*smp_work_fn)(void* arg);
+
+#ifdef SMP_WORKERS
+void smp_init(void);
+bool smp_run(unsigned cpu, smp_work_fn fn, void* arg);
+void smp_wait(unsigned cpu);
+void smp_fini(void);
+#else
+static inline void smp_fini(void) {}
+#endif
@@ -1,4 +1,7 @@
 #include "storage.h"
+#include "sched.h"
+#include "timeline.h"
+#include "resident.h"
 
 // {{{ U-Boot MMC driver wrapper
 
@@ -49,6 +52,8 @@ struct mmc* mmc_probe(int mmc_no)
 	const char* name = mmc_no ? "eMMC" : "SD";
 	int ret;
 
+	tl_begin(TL_MMC_PROBE, mmc_no);
+
 	if (mmc_no == 0) {
 		/* SDC0: PF0-PF5 */
 		for (pin = SUNXI_GPF(0); pin <= SUNXI_GPF(5); pin++) {
@@ -76,10 +81,12 @@ struct mmc* mmc_probe(int mmc_no)
 		goto err;
 
 	//printf("%d us: %s ready\n", timer_get_boot_us() - globals->t0, name);
+	tl_end(TL_MMC_PROBE, mmc_no);
 	return mmc;
 
 err:
 	printf("Can't init %s\n", name);
+	tl_end(TL_MMC_PROBE, mmc_no);
 	return NULL;
 }
 
@@ -183,6 +190,8 @@ struct bootfs* bootfs_open(struct mmc* mmc)
 	return NULL;
 }
 
+#define LOAD_CHUNK_SIZE (1024 * 1024)
+
 ssize_t bootfs_load_image(struct bootfs* fs, uint32_t dest, uint64_t off, uint32_t len, const char* name)
 {
 	if (len == 0)
@@ -197,8 +206,22 @@ ssize_t bootfs_load_image(struct bootfs* fs, uint32_t dest, uint64_t off, uint32
 
 	ulong s = timer_get_boot_us();
 
-	if (!mmc_read_data(fs->mmc, dest, fs->mmc_offset + off, len))
-		return -1;
+	tl_begin(TL_IMAGE_LOAD, dest >> 20);
+
+	for (uint32_t done = 0; done < len; done += LOAD_CHUNK_SIZE) {
+		uint32_t chunk = min(len - done, (uint32_t)LOAD_CHUNK_SIZE);
+
+		if (!resident_load(fs, dest + done, off + done, chunk)) {
+			tl_end(TL_IMAGE_LOAD, dest >> 20);
+			return -1;
+		}
+
+		// overlap other work (like display bring-up) with the MMC
+		// transfers
+		sched_poll();
+	}
+
+	tl_end(TL_IMAGE_LOAD, dest >> 20);
 
 	printf("Load %s (%u KiB) => 0x%x (%llu KiB/s)\n",
 	       name, len / 1024, dest,
@@ -207,7 +230,7 @@ ssize_t bootfs_load_image(struct bootfs* fs, uint32_t dest, uint64_t off, uint32
 	return len;
 }
 
-ssize_t bootfs_load_file(struct bootfs* fs, uint32_t dest, const char* name)
+struct bootfs_file* bootfs_find_file(struct bootfs* fs, const char* name)
 {
 	struct bootfs_files* bf = fs->files_blocks;
 
@@ -221,17 +244,24 @@ ssize_t bootfs_load_file(struct bootfs* fs, uint32_t dest, const char* name)
 			if (!f->name[0])
                                 break;
 
-			if (strcmp((char*)f->name, name))
-				continue;
-
-			uint64_t img_off = __be32_to_cpu(f->data_off);
-			uint32_t img_len = __be32_to_cpu(f->data_len);
-
-			return bootfs_load_image(fs, dest, img_off, img_len, (char*)f->name);
+			if (!strcmp((char*)f->name, name))
+				return f;
 		}
 	}
 
-	return -1;
+	return NULL;
+}
+
+ssize_t bootfs_load_file(struct bootfs* fs, uint32_t dest, const char* name)
+{
+	struct bootfs_file* f = bootfs_find_file(fs, name);
+	if (!f)
+		return -1;
+
+	uint64_t img_off = __be32_to_cpu(f->data_off);
+	uint32_t img_len = __be32_to_cpu(f->data_len);
+
+	return bootfs_load_image(fs, dest, img_off, img_len, (char*)f->name);
 }
 
 // }}}
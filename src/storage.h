@@ -39,10 +39,17 @@ struct bootfs {
 	struct bootfs_files* files_blocks;
 };
 
+// version 1 bootfs has longer boot_args in place of overlays/preload
+static inline bool bootfs_has_conf_lists(struct bootfs* fs)
+{
+	return __be32_to_cpu(fs->sb->version) >= 2;
+}
+
 struct mmc* mmc_probe(int mmc_no);
 bool mmc_read_data(struct mmc* mmc, uintptr_t dest, uint64_t off, uint32_t len);
 
 struct bootfs* bootfs_open(struct mmc* mmc);
 ssize_t bootfs_load_image(struct bootfs* fs, uint32_t dest,
 			  uint64_t off, uint32_t len, const char* name);
+struct bootfs_file* bootfs_find_file(struct bootfs* fs, const char* name);
 ssize_t bootfs_load_file(struct bootfs* fs, uint32_t dest, const char* name);
@@ -0,0 +1,100 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef BOOT_TIMELINE
+
+#include <common.h>
+#include <linux/libfdt.h>
+#include "timeline.h"
+
+#define MDCR_EL3_SPME		BIT(17)
+
+#define PMCR_E			BIT(0)
+#define PMCR_P			BIT(1)
+#define PMCR_C			BIT(2)
+
+#define PMU_EV_L1D_CACHE_REFILL	0x03
+#define PMU_EV_INST_RETIRED	0x08
+
+// records taken before DRAM is available live here
+#define TL_EARLY_RECORDS	4
+
+static fdt32_t tl_early[TL_EARLY_RECORDS * 5];
+static fdt32_t* tl_buf = tl_early;
+static unsigned tl_len;
+static unsigned tl_max = TL_EARLY_RECORDS;
+
+void tl_init(void)
+{
+#ifndef PBOOT_SIM
+	uint64_t v;
+
+	// allow counting at secure EL3
+	asm volatile("mrs %0, mdcr_el3" : "=r" (v));
+	asm volatile("msr mdcr_el3, %0" : : "r" (v | MDCR_EL3_SPME));
+
+	asm volatile("msr pmevtyper0_el0, %0" : : "r" ((uint64_t)PMU_EV_INST_RETIRED));
+	asm volatile("msr pmevtyper1_el0, %0" : : "r" ((uint64_t)PMU_EV_L1D_CACHE_REFILL));
+	asm volatile("msr pmccfiltr_el0, xzr");
+	asm volatile("msr pmcntenset_el0, %0" : : "r" ((uint64_t)(BIT(31) | BIT(1) | BIT(0))));
+	asm volatile("msr pmcr_el0, %0" : : "r" ((uint64_t)(PMCR_E | PMCR_P | PMCR_C)));
+	asm volatile("isb");
+#endif
+}
+
+void tl_set_buffer(void* buf, unsigned max_records)
+{
+	memcpy(buf, tl_buf, tl_len * TL_RECORD_SIZE);
+	tl_buf = buf;
+	tl_max = max_records;
+}
+
+void tl_record(unsigned phase, unsigned flags, unsigned arg)
+{
+	uint64_t cyc = 0, ins = 0, ref = 0;
+	fdt32_t* r;
+
+	if (tl_len >= tl_max)
+		return;
+
+#ifndef PBOOT_SIM
+	asm volatile("mrs %0, pmccntr_el0" : "=r" (cyc));
+	asm volatile("mrs %0, pmevcntr0_el0" : "=r" (ins));
+	asm volatile("mrs %0, pmevcntr1_el0" : "=r" (ref));
+#endif
+
+	r = tl_buf + tl_len++ * 5;
+	r[0] = cpu_to_fdt32(phase << 24 | flags << 16 | (arg & 0xffff));
+	r[1] = cpu_to_fdt32(timer_get_boot_us());
+	r[2] = cpu_to_fdt32(cyc);
+	r[3] = cpu_to_fdt32(ins);
+	r[4] = cpu_to_fdt32(ref);
+}
+
+const void* tl_data(void)
+{
+	return tl_buf;
+}
+
+unsigned tl_size(void)
+{
+	return tl_len * TL_RECORD_SIZE;
+}
+
+#endif
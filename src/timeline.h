@@ -0,0 +1,85 @@
+/**
+ * p-boot - pico sized bootloader
+ *
+ * Copyright (C) 2020  Ondřej Jirman <megi@xff.cz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common.h>
+
+/*
+ * Boot timeline
+ *
+ * Begin/end markers for boot phases, exported to Linux as /p-boot/timings.
+ * Each record is 5 big-endian 32-bit cells:
+ *
+ *   phase << 24 | flags << 16 | arg
+ *   timer_get_boot_us()
+ *   PMU cycle counter
+ *   PMU instructions retired
+ *   PMU L1D cache refills
+ *
+ * PMU counters are free-running 32-bit values, only differences between
+ * records are meaningful.
+ *
+ * Only built with -DBOOT_TIMELINE, otherwise the markers compile to
+ * nothing.
+ */
+
+enum {
+	TL_DRAM_INIT = 1,
+	TL_MMC_PROBE,		// arg = mmc number
+	TL_IMAGE_LOAD,		// arg = destination address in MiB
+	TL_FDT_FIXUP,
+	TL_DISPLAY_INIT,
+	TL_ATF_JUMP,
+};
+
+#define TL_FLAG_END		BIT(0)
+
+#define TL_RECORD_SIZE		(5 * 4)
+
+#ifdef BOOT_TIMELINE
+
+// records taken after the final FDT is written out (FDT fixup end,
+// ATF jump begin), the FDT has space reserved for this many
+#define TL_MAX_LATE		4
+
+void tl_init(void);
+void tl_set_buffer(void* buf, unsigned max_records);
+void tl_record(unsigned phase, unsigned flags, unsigned arg);
+const void* tl_data(void);
+unsigned tl_size(void);
+
+#else
+
+#define TL_MAX_LATE		0
+
+static inline void tl_init(void) {}
+static inline void tl_record(unsigned phase, unsigned flags, unsigned arg) {}
+
+#endif
+
+static inline void tl_begin(unsigned phase, unsigned arg)
+{
+	tl_record(phase, 0, arg);
+}
+
+static inline void tl_end(unsigned phase, unsigned arg)
+{
+	tl_record(phase, TL_FLAG_END, arg);
+}
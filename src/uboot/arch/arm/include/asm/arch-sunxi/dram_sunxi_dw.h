@@ -240,4 +240,12 @@ static inline int ns_to_t(int nanoseconds)
 
 void mctl_set_timing_params(uint16_t socid, struct dram_para *para);
 
+/* MBUS master priority profiles (A64), selected after sunxi_dram_init() */
+enum {
+	MBUS_PROFILE_LINUX,
+	MBUS_PROFILE_BOOT,
+};
+
+void mctl_set_mbus_profile(int profile);
+
 #endif /* _SUNXI_DRAM_SUN8I_H3_H */
@@ -158,6 +158,43 @@ static void mctl_set_master_priority_a64(void)
 	writel(0x81000004, &mctl_com->mdfs_bwlr[2]);
 }
 
+/*
+ * While the bootloader runs, the only busy masters are the CPU, MMC
+ * IDMACs (which are AHB masters that reach DRAM via the DMA port) and
+ * DE scanout of the splash screen. Remove bandwidth limits from the CPU
+ * and DMA ports and push idle masters to the lowest priority. DE keeps
+ * its Linux settings, so that scanout doesn't underflow.
+ */
+static void mctl_set_master_priority_a64_boot(void)
+{
+	struct sunxi_mctl_com_reg * const mctl_com =
+			(struct sunxi_mctl_com_reg *)SUNXI_DRAM_COM_BASE;
+
+	writel(399, &mctl_com->tmr);
+	writel((1 << 16), &mctl_com->bwcr);
+
+	MBUS_CONF(   CPU, false, HIGHEST, 0,  160,  100,   80);
+	MBUS_CONF(   GPU,  true,  LOWEST, 0,  256,  128,   64);
+	MBUS_CONF(UNUSED,  true,  LOWEST, 0,  256,  128,   64);
+	MBUS_CONF(   DMA, false, HIGHEST, 0,  256,   80,  100);
+	MBUS_CONF(    VE,  true,  LOWEST, 0,  256,  128,   64);
+	MBUS_CONF(   CSI,  true,  LOWEST, 0,  256,  128,    0);
+	MBUS_CONF(  NAND,  true,  LOWEST, 0,  256,  128,   64);
+	MBUS_CONF(    SS,  true,  LOWEST, 0,  256,  128,   64);
+	MBUS_CONF(    TS,  true,  LOWEST, 0,  256,  128,   64);
+	MBUS_CONF(    DI,  true,  LOWEST, 0,  256,  128,   64);
+	MBUS_CONF(    DE,  true,    HIGH, 2, 8192, 6144, 2048);
+	MBUS_CONF(DE_CFD,  true,  LOWEST, 0,  256,  128,   64);
+}
+
+void mctl_set_mbus_profile(int profile)
+{
+	if (profile == MBUS_PROFILE_BOOT)
+		mctl_set_master_priority_a64_boot();
+	else
+		mctl_set_master_priority_a64();
+}
+
 static void mctl_set_master_priority_h5(void)
 {
 	struct sunxi_mctl_com_reg * const mctl_com =
@@ -644,6 +681,126 @@ static void mctl_auto_detect_dram_size(uint16_t socid, struct dram_para *para)
 	}
 }
 
+#ifdef DRAM_PARAM_CACHE
+/*
+ * Rank, bus width and size detection gives the same result on every boot
+ * of a given board. The results are kept in RTC general purpose registers
+ * (which survive reboots and power off as long as the RTC domain stays
+ * powered), keyed by a hash of the SoC ID, so that the next boot can
+ * program them right away. They are only trusted after a quick pattern
+ * test, otherwise full detection runs again.
+ */
+#define DRAM_CACHE_KEY_REG	((ulong)SUNXI_RTC_BASE + 0x108)
+#define DRAM_CACHE_PARA_REG	((ulong)SUNXI_RTC_BASE + 0x10c)
+#define DRAM_CACHE_MAGIC	0xd1u
+
+static u32 dram_cache_key(u32 para)
+{
+	u32 h = 0, sum;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		h ^= readl((ulong)SUNXI_SID_BASE + 4 * i);
+	h = (h ^ h >> 16) & 0xffff;
+
+	sum = para ^ para >> 16;
+	sum = (sum ^ sum >> 8) & 0xff;
+
+	return DRAM_CACHE_MAGIC << 24 | h << 8 | sum;
+}
+
+static u32 dram_cache_encode(struct dram_para *para)
+{
+	u32 v = para->dual_rank | para->bus_full_width << 1;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct rank_para *rank = &para->ranks[i];
+
+		v |= (rank->row_bits - 11) << (8 + 12 * i);
+		v |= (rank->bank_bits - 2) << (12 + 12 * i);
+		v |= (__builtin_ctz(rank->page_size) - 9) << (16 + 12 * i);
+	}
+
+	return v;
+}
+
+static bool dram_cache_load(struct dram_para *para)
+{
+	u32 v = readl(DRAM_CACHE_PARA_REG);
+	int i;
+
+	if (readl(DRAM_CACHE_KEY_REG) != dram_cache_key(v))
+		return false;
+
+	para->dual_rank = v & 1;
+	para->bus_full_width = !!(v & 2);
+
+	for (i = 0; i < 2; i++) {
+		struct rank_para *rank = &para->ranks[i];
+
+		rank->row_bits = ((v >> (8 + 12 * i)) & 0xf) + 11;
+		rank->bank_bits = ((v >> (12 + 12 * i)) & 0xf) + 2;
+		rank->page_size = 512 << ((v >> (16 + 12 * i)) & 0xf);
+	}
+
+	return true;
+}
+
+static void dram_cache_store(struct dram_para *para)
+{
+	u32 v = dram_cache_encode(para);
+
+	writel(v, DRAM_CACHE_PARA_REG);
+	writel(dram_cache_key(v), DRAM_CACHE_KEY_REG);
+}
+
+static void dram_cache_invalidate(void)
+{
+	writel(0, DRAM_CACHE_KEY_REG);
+}
+
+/*
+ * Write a distinct pattern to each power of 2 offset within the rank,
+ * so that any address line that doesn't exist shows up as aliasing.
+ */
+static bool mctl_mem_pattern_ok(ulong base, unsigned long size)
+{
+	unsigned long off;
+
+	writel(0x5aa5a55a, base);
+	for (off = 4; off < size; off <<= 1)
+		writel(0x5aa5a55a ^ off, base + off);
+	dsb();
+
+	if (readl(base) != 0x5aa5a55a)
+		return false;
+	for (off = 4; off < size; off <<= 1)
+		if (readl(base + off) != (u32)(0x5aa5a55a ^ off))
+			return false;
+
+	return true;
+}
+
+static bool dram_cache_verify(uint16_t socid, struct dram_para *para)
+{
+	ulong base = CONFIG_SYS_SDRAM_BASE;
+
+	mctl_set_cr(socid, para);
+
+	if (!mctl_mem_pattern_ok(base, mctl_calc_rank_size(&para->ranks[0])))
+		return false;
+
+	if ((socid == SOCID_A64 || socid == SOCID_R40) && para->dual_rank) {
+		base += mctl_calc_rank_size(&para->ranks[0]);
+		if (!mctl_mem_pattern_ok(base, mctl_calc_rank_size(&para->ranks[1])))
+			return false;
+	}
+
+	return true;
+}
+#endif
+
 /*
  * The actual values used here are taken from Allwinner provided boot0
  * binaries, though they are probably board specific, so would likely benefit
@@ -778,9 +935,19 @@ unsigned long sunxi_dram_init(void)
 	uint16_t socid = SOCID_H5;
 #endif
 
+#ifdef DRAM_PARAM_CACHE
+	bool cached = dram_cache_load(&para);
+	u8 cached_dual_rank = para.dual_rank;
+	u8 cached_full_width = para.bus_full_width;
+#endif
+
 	mctl_sys_init(socid, &para);
-	if (mctl_channel_init(socid, &para))
+	if (mctl_channel_init(socid, &para)) {
+#ifdef DRAM_PARAM_CACHE
+		dram_cache_invalidate();
+#endif
 		return 0;
+	}
 
 	if (para.dual_rank)
 		writel(0x00000303, &mctl_ctl->odtmap);
@@ -804,7 +971,20 @@ unsigned long sunxi_dram_init(void)
 	setbits_le32(&mctl_com->cccr, 1 << 31);
 	udelay(10);
 
+#ifdef DRAM_PARAM_CACHE
+	/*
+	 * mctl_channel_init() corrects rank/width if training fails with
+	 * the cached values, in which case the cache is stale.
+	 */
+	if (!cached || para.dual_rank != cached_dual_rank ||
+	    para.bus_full_width != cached_full_width ||
+	    !dram_cache_verify(socid, &para)) {
+		mctl_auto_detect_dram_size(socid, &para);
+		dram_cache_store(&para);
+	}
+#else
 	mctl_auto_detect_dram_size(socid, &para);
+#endif
 	mctl_set_cr(socid, &para);
 
 	size = mctl_calc_rank_size(&para.ranks[0]);
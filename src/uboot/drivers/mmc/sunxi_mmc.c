@@ -29,12 +29,14 @@
 #define DMA_CONFIG_ERROR BIT(30) // flag: out: error happened
 #define DMA_CONFIG_HOLD BIT(31) // flag: desc owned by IDMAC (set to 1)
 
+#ifndef DMA_BUF_MAX_SIZE
 #if defined(CONFIG_MACH_SUN50I) || defined(CONFIG_MACH_SUN50I_H6)
 // mmc2 on A64 only allows for 8k
 #define DMA_BUF_MAX_SIZE (1 << 13)
 #else
 #define DMA_BUF_MAX_SIZE (1 << 16)
 #endif
+#endif
 
 struct sunxi_idma_desc {
         u32 config;
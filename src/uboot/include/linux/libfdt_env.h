@@ -24,8 +24,8 @@ typedef __be64 unaligned_fdt64_t __aligned(4);
 #define fdt64_to_cpu(x) be64_to_cpu(x)
 #define cpu_to_fdt64(x) cpu_to_be64(x)
 
-/* U-Boot: for strtoul in fdt_overlay.c */
-//#include <vsprintf.h>
+/* U-Boot: for strtoul in fdt_overlay.c (p-boot: implemented in lib.c) */
+unsigned long simple_strtoul(const char *cp, char **endp, unsigned int base);
 
 #define strtoul(cp, endp, base)	simple_strtoul(cp, endp, base)
 
@@ -23,6 +23,7 @@
 #include <asm/armv8/mmu.h>
 #include <asm/system.h>
 #include <cpu_func.h>
+#include "mmu.h"
 #include "vidconsole.h"
 
 #include "font.h"
@@ -78,7 +79,9 @@ void vidconsole_init(struct vidconsole* c, uint32_t w, uint32_t h, uint32_t scal
 	c->fb_width = w * FONT_WIDTH * scale;
 	c->fb_height = h * FONT_HEIGHT * scale;
 	c->fb_pitch = c->fb_width * 4;
-	c->fb_start = (uintptr_t)malloc(c->fb_pitch * c->fb_height);
+	c->fb_start = (uintptr_t)mmu_fb_alloc(c->fb_pitch * c->fb_height);
+	if (!c->fb_start)
+		c->fb_start = (uintptr_t)malloc(c->fb_pitch * c->fb_height);
 
 	c->screen = malloc(c->size);
 	for (int i = 0; i < c->size; i++)
@@ -93,32 +96,19 @@ void vidconsole_init(struct vidconsole* c, uint32_t w, uint32_t h, uint32_t scal
 		c->bg_color[i] = bg;
 	}
 
-	// extract font
-	c->font = malloc(FONT_HEIGHT * FONT_CHARS);
-	unrle(c->font, font_data, sizeof font_data);
-
-        // build glyph atlas
-
-	// in pixels
-	unsigned char_stride = FONT_WIDTH * scale;
-	unsigned char_size = char_stride * FONT_HEIGHT;
-
-	c->atlas = malloc(char_size * FONT_CHARS * 4);
-
-	for (unsigned ch = 0; ch < FONT_CHARS; ch++) {
-		for (unsigned y = 0; y < FONT_HEIGHT; y++) {
-			uint8_t ln_data = c->font[ch * FONT_HEIGHT + y];
-
-			for (unsigned x = 0; x < FONT_WIDTH; x++) {
-				uint32_t pix = ln_data & 0x80 ? 0xffffffff : 0;
-
-				for (unsigned s = 0; s < c->scale; s++)
-					c->atlas[ch * char_size + y * char_stride + c->scale * x + s] = pix;
-
-				ln_data <<= 1;
-			}
-		}
+	// extract font (shared by all consoles)
+	static uint8_t* font;
+	if (!font) {
+		font = malloc(FONT_HEIGHT * FONT_CHARS);
+		unrle(font, font_data, sizeof font_data);
 	}
+	c->font = font;
+
+	// font bit mask for each pixel of a scaled glyph row, glyphs are
+	// expanded from 1bpp font rows on the fly during redraw
+	c->bit_masks = malloc(FONT_WIDTH * scale * 4);
+	for (unsigned x = 0; x < FONT_WIDTH * scale; x++)
+		c->bit_masks[x] = 0x80 >> (x / scale);
 }
 
 void vidconsole_set_xy(struct vidconsole* c, unsigned x, unsigned y, char ch, uint32_t fg, uint32_t bg)
@@ -134,43 +124,42 @@ void vidconsole_redraw(struct vidconsole* c)
 {
 	uint32_t* fb = (uint32_t*)(uintptr_t)c->fb_start;
 	unsigned char_stride = FONT_WIDTH * c->scale;
-	unsigned char_size = char_stride * FONT_HEIGHT;
 
-	for (unsigned x = 0; x < c->w; x++) {
-		for (unsigned y = 0; y < c->h; y++) {
+	for (unsigned y = 0; y < c->h; y++) {
+		for (unsigned x = 0; x < c->w; x++) {
 			unsigned pos = y * c->w + x;
 			unsigned ch = c->screen[pos];
-			if (ch > FONT_CHARS)
+			if (ch >= FONT_CHARS)
 				ch = '?';
 			uint32x4_t bg_v = vdupq_n_u32(c->bg_color[pos]);
 			uint32x4_t fg_v = vdupq_n_u32(c->fg_color[pos]);
+			uint8_t* glyph = c->font + ch * FONT_HEIGHT;
 
 			uint32_t *con_p = fb + c->fb_width * y * FONT_HEIGHT * c->scale + x * char_stride;
 
 			for (unsigned cy = 0; cy < FONT_HEIGHT; cy++) {
-				for (unsigned s = 0; s < c->scale; s++) {
-					uint32_t *dst = con_p + c->fb_width * (c->scale * cy + s);
-					uint32_t *src = c->atlas + char_size * ch + char_stride * cy;
-					uint32_t len = char_stride;
-
-					while (len >= 4 * 2) {
-						uint32x4_t v0 = vld1q_u32(src);
-						v0 = vbslq_u32(v0, fg_v, bg_v);
-						uint32x4_t v1 = vld1q_u32(src + 4);
-						v1 = vbslq_u32(v1, fg_v, bg_v);
-						vst1q_u32(dst, v0);
-						vst1q_u32(dst + 4, v1);
-
-						src += 4 * 2;
-						dst += 4 * 2;
-						len -= 4 * 2;
+				uint32x4_t ln_v = vdupq_n_u32(glyph[cy]);
+				uint32_t *dst = con_p + c->fb_width * c->scale * cy;
+
+				for (unsigned i = 0; i < char_stride; i += 4 * 2) {
+					// expand font bits to pixel masks
+					uint32x4_t v0 = vtstq_u32(ln_v, vld1q_u32(c->bit_masks + i));
+					uint32x4_t v1 = vtstq_u32(ln_v, vld1q_u32(c->bit_masks + i + 4));
+					v0 = vbslq_u32(v0, fg_v, bg_v);
+					v1 = vbslq_u32(v1, fg_v, bg_v);
+
+					// store the row scale times
+					for (unsigned s = 0; s < c->scale; s++) {
+						vst1q_u32(dst + c->fb_width * s + i, v0);
+						vst1q_u32(dst + c->fb_width * s + i + 4, v1);
 					}
 				}
 			}
 		}
 	}
 
-	flush_cache_auto_align(fb, c->fb_height * c->fb_pitch);
+	if (!mmu_is_uncached(c->fb_start))
+		flush_cache_auto_align(fb, c->fb_height * c->fb_pitch);
 }
 
 void vidconsole_putc(struct vidconsole* c, char ch)
@@ -33,7 +33,7 @@ struct vidconsole {
 
 	unsigned scale;
 	uint8_t* font;
-	uint32_t* atlas;
+	uint32_t* bit_masks; // FONT_WIDTH * scale font bit masks
 
 	unsigned char* screen;
 	uint32_t* fg_color;